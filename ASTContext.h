@@ -0,0 +1,97 @@
+/** @file ASTContext.h
+* @brief Owns the memory of one AST
+**/
+
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#pragma warning(push, 0)
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/StringSaver.h"
+#pragma warning(pop)
+
+/**
+ * @brief Nodes, child lists and names of an AST all live in one bump-pointer
+ * arena, so building the tree costs no malloc per node and destroying the
+ * context frees all of it at once.
+ *
+ * Node destructors never run: nodes may only hold pointers, StringRefs and
+ * ArrayRefs into the same context.
+*/
+class ASTContext
+{
+    llvm::BumpPtrAllocator allocator;
+    /// Every distinct name is stored once.
+    llvm::UniqueStringSaver names;
+    /// Arenas filled by other threads with nodes of the same AST.
+    std::vector<std::unique_ptr<ASTContext>> children;
+
+public:
+    ASTContext() : names(allocator) {}
+    ASTContext(const ASTContext&) = delete;
+    ASTContext& operator=(const ASTContext&) = delete;
+
+    void* allocate(size_t size, size_t alignment)
+    {
+        return allocator.Allocate(size, alignment);
+    }
+
+    /// Copies a child list built up during parsing into the arena.
+    template <typename T>
+    llvm::ArrayRef<T> copyArray(const llvm::SmallVectorImpl<T>& elems)
+    {
+        return copyArray(llvm::makeArrayRef(elems));
+    }
+
+    template <typename T>
+    llvm::ArrayRef<T> copyArray(llvm::ArrayRef<T> elems)
+    {
+        if (elems.empty())
+        {
+            return {};
+        }
+        T* mem = allocator.Allocate<T>(elems.size());
+        std::uninitialized_copy(elems.begin(), elems.end(), mem);
+        return llvm::ArrayRef<T>(mem, elems.size());
+    }
+
+    llvm::StringRef intern(llvm::StringRef name)
+    {
+        return names.save(name);
+    }
+
+    /// A separate arena for a thread that builds part of this AST. It is freed
+    /// together with this context, so its nodes may point into either.
+    ASTContext& createChild()
+    {
+        children.push_back(std::make_unique<ASTContext>());
+        return *children.back();
+    }
+
+    /// Bytes taken from the system for the arena and its children.
+    size_t getTotalMemory() const
+    {
+        size_t total = allocator.getTotalMemory();
+        for (const auto& child : children)
+        {
+            total += child->getTotalMemory();
+        }
+        return total;
+    }
+};
+
+/// Placement new for AST nodes: `new (Ctx) IntegerLiteral(1)`.
+inline void* operator new(size_t size, ASTContext& C, size_t alignment = alignof(std::max_align_t))
+{
+    return C.allocate(size, alignment);
+}
+
+/// Only called if a node constructor throws; the arena reclaims the memory anyway.
+inline void operator delete(void*, ASTContext&, size_t)
+{
+}
@@ -0,0 +1,467 @@
+/** @file ASTFolder.cpp
+* @brief Evaluating constant operators, identities, and pruning decided branches
+**/
+
+#include <climits>
+#include <cstdint>
+#include <iostream>
+#include "ASTFolder.h"
+
+bool ASTFolder::traverseVarDecl(const VarDecl& decl)
+{
+    inGlobalInitializer = decl.isFileScope();
+    traverse(decl.getInit());
+    modify(decl).setInit(fold(decl.getInit()));
+    inGlobalInitializer = false;
+    return true;
+}
+
+bool ASTFolder::traverseValueStmt(const ValueStmt& stmt)
+{
+    traverse(stmt.getExpr());
+    modify(stmt).setExpr(fold(stmt.getExpr()));
+    return true;
+}
+
+bool ASTFolder::traverseIfStmt(const IfStmt& stmt)
+{
+    traverse(stmt.getCond());
+    traverse(stmt.getThen());
+    traverse(stmt.getElse());
+    IfStmt& ifStmt = modify(stmt);
+    ifStmt.setCond(fold(stmt.getCond()));
+    ifStmt.setThen(prune(stmt.getThen()));
+    ifStmt.setElse(prune(stmt.getElse()));
+    return true;
+}
+
+bool ASTFolder::traverseWhileStmt(const WhileStmt& stmt)
+{
+    traverse(stmt.getCond());
+    traverse(stmt.getBody());
+    WhileStmt& whileStmt = modify(stmt);
+    whileStmt.setCond(fold(stmt.getCond()));
+    whileStmt.setBody(prune(stmt.getBody()));
+    return true;
+}
+
+bool ASTFolder::traverseCompoundStmt(const CompoundStmt& stmt)
+{
+    for (size_t i = 0; i < stmt.body.size(); i++)
+    {
+        traverse(stmt.body[i]);
+        modify(stmt).setStmt(i, prune(stmt.body[i]));
+    }
+    return true;
+}
+
+bool ASTFolder::traverseReturnStmt(const ReturnStmt& stmt)
+{
+    traverse(stmt.getRetValue());
+    modify(stmt).setRetValue(fold(stmt.getRetValue()));
+    return true;
+}
+
+bool ASTFolder::traverseBinaryOperator(const AST::BinaryOperator& expr)
+{
+    traverse(expr.getLHS());
+    traverse(expr.getRHS());
+    AST::BinaryOperator& op = modify(expr);
+    op.setLHS(fold(op.getLHS()));
+    op.setRHS(fold(op.getRHS()));
+    return true;
+}
+
+bool ASTFolder::traverseUnaryOperator(const AST::UnaryOperator& expr)
+{
+    traverse(expr.getSubExpr());
+    modify(expr).setSubExpr(fold(expr.getSubExpr()));
+    return true;
+}
+
+bool ASTFolder::traverseParenExpr(const ParenExpr& expr)
+{
+    // Nested parentheses are walked in a loop, as in Sema, innermost first.
+    SmallVector<ParenExpr*, 4> parens;
+    const Expr* inner = &expr;
+    while (auto* paren = dyn_cast_or_null<ParenExpr>(inner))
+    {
+        parens.push_back(&modify(*paren));
+        inner = paren->getSubExpr();
+    }
+    traverse(inner);
+    for (ParenExpr* paren : llvm::reverse(parens))
+    {
+        paren->setSubExpr(fold(paren->getSubExpr()));
+    }
+    return true;
+}
+
+bool ASTFolder::traverseCallExpr(const CallExpr& expr)
+{
+    CallExpr& call = modify(expr);
+    for (size_t i = 0; i < call.getArgs().size(); i++)
+    {
+        traverse(call.getArgs()[i]);
+        call.setArg(i, fold(call.getArgs()[i]));
+    }
+    return true;
+}
+
+bool ASTFolder::traverseImplicitCastExpr(const ImplicitCastExpr& expr)
+{
+    traverse(expr.getSubExpr());
+    modify(expr).setSubExpr(fold(expr.getSubExpr()));
+    return true;
+}
+
+Expr* ASTFolder::fold(Expr* E)
+{
+    if (!E)
+    {
+        return nullptr;
+    }
+    switch (E->getKind())
+    {
+        case ASTNode::Kind::ParenExpr:
+        {
+            // the parentheses of a constant are of no more use
+            Expr* sub = cast<ParenExpr>(E)->getSubExpr();
+            int value;
+            return getConstant(sub, value) ? sub : E;
+        }
+        case ASTNode::Kind::BinaryOperator:
+            return foldBinaryOperator(*cast<AST::BinaryOperator>(E));
+        case ASTNode::Kind::UnaryOperator:
+            return foldUnaryOperator(*cast<AST::UnaryOperator>(E));
+        case ASTNode::Kind::ImplicitCastExpr:
+            return foldCast(*cast<ImplicitCastExpr>(E));
+        default:
+            return E;
+    }
+}
+
+/// op applied to two constants whose result C defines, and so fits in an
+/// int: isUndefined has ruled out overflow.
+static int evaluate(BinaryOperatorKind op, int lhs, int rhs)
+{
+    int64_t a = lhs, b = rhs;
+    switch (op)
+    {
+        case BinaryOperatorKind::BO_Mul: return static_cast<int>(a * b);
+        case BinaryOperatorKind::BO_Div: return lhs / rhs;
+        case BinaryOperatorKind::BO_Rem: return lhs % rhs;
+        case BinaryOperatorKind::BO_Add: return static_cast<int>(a + b);
+        case BinaryOperatorKind::BO_Sub: return static_cast<int>(a - b);
+        case BinaryOperatorKind::BO_Shl: return static_cast<int>(a << rhs);
+        case BinaryOperatorKind::BO_Shr: return lhs >> rhs;
+        case BinaryOperatorKind::BO_LT: return lhs < rhs;
+        case BinaryOperatorKind::BO_GT: return lhs > rhs;
+        case BinaryOperatorKind::BO_LE: return lhs <= rhs;
+        case BinaryOperatorKind::BO_GE: return lhs >= rhs;
+        case BinaryOperatorKind::BO_EQ: return lhs == rhs;
+        case BinaryOperatorKind::BO_NE: return lhs != rhs;
+        case BinaryOperatorKind::BO_And: return lhs & rhs;
+        case BinaryOperatorKind::BO_Xor: return lhs ^ rhs;
+        case BinaryOperatorKind::BO_Or: return lhs | rhs;
+        case BinaryOperatorKind::BO_LAnd: return lhs && rhs;
+        case BinaryOperatorKind::BO_LOr: return lhs || rhs;
+        default: return 0;
+    }
+}
+
+Expr* ASTFolder::foldBinaryOperator(AST::BinaryOperator& op)
+{
+    Expr* L = op.getLHS();
+    Expr* R = op.getRHS();
+    int lhs = 0, rhs = 0;
+    bool lhsConst = getConstant(L, lhs);
+    bool rhsConst = getConstant(R, rhs);
+    if ((rhsConst && isUndefined(op, lhs, lhsConst, rhs)) || op.isAssignment())
+    {
+        return &op;
+    }
+    if (lhsConst && rhsConst)
+    {
+        return makeConstant(evaluate(op.getOpKind(), lhs, rhs), op.getType());
+    }
+
+    // One operand is constant at most. The other may only be dropped if
+    // evaluating it does nothing.
+    switch (op.getOpKind())
+    {
+        case BinaryOperatorKind::BO_Add:
+        case BinaryOperatorKind::BO_Or:
+        case BinaryOperatorKind::BO_Xor:
+            if (rhsConst && rhs == 0)
+            {
+                return L;
+            }
+            if (lhsConst && lhs == 0)
+            {
+                return R;
+            }
+            if (op.getOpKind() == BinaryOperatorKind::BO_Or &&
+                ((rhsConst && rhs == -1 && !hasSideEffects(L)) || (lhsConst && lhs == -1 && !hasSideEffects(R))))
+            {
+                return makeConstant(-1, TypeKind::Int);
+            }
+            break;
+        case BinaryOperatorKind::BO_Sub:
+        case BinaryOperatorKind::BO_Shl:
+        case BinaryOperatorKind::BO_Shr:
+            if (rhsConst && rhs == 0)
+            {
+                return L;
+            }
+            break;
+        case BinaryOperatorKind::BO_Mul:
+        case BinaryOperatorKind::BO_And:
+        {
+            // 1 is the identity of *, and -1, all bits set, that of &
+            int identity = op.getOpKind() == BinaryOperatorKind::BO_Mul ? 1 : -1;
+            if (rhsConst && rhs == identity)
+            {
+                return L;
+            }
+            if (lhsConst && lhs == identity)
+            {
+                return R;
+            }
+            if ((rhsConst && rhs == 0 && !hasSideEffects(L)) || (lhsConst && lhs == 0 && !hasSideEffects(R)))
+            {
+                return makeConstant(0, TypeKind::Int);
+            }
+            break;
+        }
+        case BinaryOperatorKind::BO_Div:
+            if (rhsConst && rhs == 1)
+            {
+                return L;
+            }
+            break;
+        case BinaryOperatorKind::BO_Rem:
+            if (rhsConst && rhs == 1 && !hasSideEffects(L))
+            {
+                return makeConstant(0, TypeKind::Int);
+            }
+            break;
+        case BinaryOperatorKind::BO_LAnd:
+        case BinaryOperatorKind::BO_LOr:
+        {
+            // A left operand that decides the result leaves the right one
+            // unevaluated; one that does not leaves the right one as the result.
+            bool decisive = op.getOpKind() == BinaryOperatorKind::BO_LOr;
+            if (lhsConst)
+            {
+                return (lhs != 0) == decisive ? makeConstant(decisive, TypeKind::Bool) : R;
+            }
+            if (rhsConst && (rhs != 0) != decisive)
+            {
+                return L;
+            }
+            if (rhsConst && !hasSideEffects(L))
+            {
+                return makeConstant(decisive, TypeKind::Bool);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return &op;
+}
+
+Expr* ASTFolder::foldUnaryOperator(AST::UnaryOperator& op)
+{
+    int value;
+    if (op.isIncrementDecrementOp() || !getConstant(op.getSubExpr(), value))
+    {
+        return &op;
+    }
+    uint32_t bits = value;
+    switch (op.getOpKind())
+    {
+        case UnaryOperatorKind::UO_Plus:
+            return makeConstant(value, op.getType());
+        case UnaryOperatorKind::UO_Minus:
+            return makeConstant(static_cast<int>(0u - bits), op.getType());
+        case UnaryOperatorKind::UO_Not:
+            return makeConstant(static_cast<int>(~bits), op.getType());
+        case UnaryOperatorKind::UO_LNot:
+            return makeConstant(!value, op.getType());
+        default:
+            return &op;
+    }
+}
+
+Expr* ASTFolder::foldCast(ImplicitCastExpr& cast)
+{
+    // An IntegralToBoolean of a literal already is a bool constant, and an
+    // LValueToRValue is never constant.
+    int value;
+    if (cast.getCastKind() == "IntegralCast" && getConstant(cast.getSubExpr(), value))
+    {
+        return makeConstant(value, TypeKind::Int);
+    }
+    return &cast;
+}
+
+Stmt* ASTFolder::prune(Stmt* S)
+{
+    int value;
+    auto* ifStmt = dyn_cast_or_null<IfStmt>(S);
+    if (ifStmt && getConstant(ifStmt->getCond(), value))
+    {
+        Stmt* taken = value ? ifStmt->getThen() : ifStmt->getElse();
+        return taken ? taken : new (Ctx) NullStmt();
+    }
+    auto* whileStmt = dyn_cast_or_null<WhileStmt>(S);
+    if (whileStmt && getConstant(whileStmt->getCond(), value) && !value)
+    {
+        return new (Ctx) NullStmt();
+    }
+    return S;
+}
+
+bool ASTFolder::isUndefined(const AST::BinaryOperator& op, int lhs, bool lhsConst, int rhs)
+{
+    uint32_t offset = op.getOperatorOffset();
+    // +, - and * of two ints cannot overflow in 64 bits
+    int64_t a = lhs, b = rhs;
+    switch (op.getOpKind())
+    {
+        case BinaryOperatorKind::BO_Add:
+        case BinaryOperatorKind::BO_Sub:
+        case BinaryOperatorKind::BO_Mul:
+        {
+            if (!lhsConst)
+            {
+                return false;
+            }
+            int64_t result = op.getOpKind() == BinaryOperatorKind::BO_Add ? a + b :
+                op.getOpKind() == BinaryOperatorKind::BO_Sub ? a - b : a * b;
+            if (result < INT_MIN || result > INT_MAX)
+            {
+                report("overflow in expression; the result is undefined", offset);
+                return true;
+            }
+            return false;
+        }
+        case BinaryOperatorKind::BO_Div:
+        case BinaryOperatorKind::BO_Rem:
+        case BinaryOperatorKind::BO_DivAssign:
+        case BinaryOperatorKind::BO_RemAssign:
+            if (rhs == 0)
+            {
+                report("division by zero is undefined", offset);
+                return true;
+            }
+            if (lhsConst && lhs == INT_MIN && rhs == -1)
+            {
+                report("overflow in division; the result is undefined", offset);
+                return true;
+            }
+            return false;
+        case BinaryOperatorKind::BO_Shl:
+        case BinaryOperatorKind::BO_Shr:
+        case BinaryOperatorKind::BO_ShlAssign:
+        case BinaryOperatorKind::BO_ShrAssign:
+            if (rhs < 0)
+            {
+                report("shift count is negative", offset);
+                return true;
+            }
+            if (rhs >= 32)
+            {
+                report("shift count >= width of type", offset);
+                return true;
+            }
+            if (!lhsConst || op.getOpKind() != BinaryOperatorKind::BO_Shl)
+            {
+                return false;
+            }
+            if (lhs < 0)
+            {
+                report("shifting a negative value is undefined", offset);
+                return true;
+            }
+            if ((a << rhs) > INT_MAX)
+            {
+                report("overflow in shift; the result is undefined", offset);
+                return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+void ASTFolder::report(const std::string& message, uint32_t offset)
+{
+    // the initializer of a global has to be a constant
+    failed |= inGlobalInitializer;
+    Location loc = SM.getLocation(offset);
+    std::cerr << fileName << ":" << loc.row << ":" << loc.col << (inGlobalInitializer ? ": error: " : ": warning: ")
+        << message << std::endl;
+}
+
+bool ASTFolder::getConstant(const Expr* E, int& value)
+{
+    if (auto* literal = dyn_cast_or_null<IntegerLiteral>(E))
+    {
+        value = literal->getValue();
+        return true;
+    }
+    auto* cast = dyn_cast_or_null<ImplicitCastExpr>(E);
+    auto* literal = cast && cast->getCastKind() == "IntegralToBoolean" ? dyn_cast_or_null<IntegerLiteral>(cast->getSubExpr()) : nullptr;
+    if (literal)
+    {
+        value = literal->getValue() != 0;
+        return true;
+    }
+    return false;
+}
+
+Expr* ASTFolder::makeConstant(int value, TypeKind type)
+{
+    Expr* literal = new (Ctx) IntegerLiteral(type == TypeKind::Bool ? value != 0 : value);
+    if (type != TypeKind::Bool)
+    {
+        return literal;
+    }
+    Expr* E = new (Ctx) ImplicitCastExpr(literal, "IntegralToBoolean");
+    E->setType(TypeKind::Bool);
+    return E;
+}
+
+bool ASTFolder::hasSideEffects(const Expr* E)
+{
+    while (auto* paren = dyn_cast_or_null<ParenExpr>(E))
+    {
+        E = paren->getSubExpr();
+    }
+    if (!E)
+    {
+        return false;
+    }
+    switch (E->getKind())
+    {
+        case ASTNode::Kind::CallExpr:
+            return true;
+        case ASTNode::Kind::BinaryOperator:
+        {
+            auto* op = cast<AST::BinaryOperator>(E);
+            return op->isAssignment() || hasSideEffects(op->getLHS()) || hasSideEffects(op->getRHS());
+        }
+        case ASTNode::Kind::UnaryOperator:
+        {
+            auto* op = cast<AST::UnaryOperator>(E);
+            return op->isIncrementDecrementOp() || hasSideEffects(op->getSubExpr());
+        }
+        case ASTNode::Kind::ImplicitCastExpr:
+            return hasSideEffects(cast<ImplicitCastExpr>(E)->getSubExpr());
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,93 @@
+/** @file ASTFolder.h
+* @brief Folds constant expressions of a bound AST and drops the branches they decide
+**/
+
+#pragma once
+#include <string>
+#include "ASTContext.h"
+#include "ASTVisitor.h"
+#include "SourceManager.h"
+
+using namespace AST;
+
+/**
+ * @brief Evaluates constant subtrees the way C does for int, and simplifies
+ * identities such as x*1, x+0 and x&0.
+ *
+ * It runs after Sema, and like Sema replaces the children of a node through
+ * its setters, bottom-up, so that a parent sees its operands already folded.
+ * An int constant becomes an IntegerLiteral; a bool constant an
+ * IntegralToBoolean cast of 0 or 1, which is what Sema would have made of a
+ * literal used as a condition. An operation whose result C leaves undefined
+ * is not folded: division by zero, a result outside the range of int, or a
+ * shift by a negative count, by 32 or more, or of a negative value. It is
+ * warned about on std::cerr at its operator; in the initializer of a global,
+ * which must be constant, it is an error instead.
+ *
+ * An operand is only dropped, as x in x*0, if evaluating it has no side
+ * effects. An if or while whose condition is constant is replaced by the
+ * branch it takes, or by a NullStmt.
+*/
+class ASTFolder : public RecursiveASTVisitor<ASTFolder>
+{
+    ASTContext& Ctx;
+    /// Locates the operators diagnostics point at.
+    const SourceManager& SM;
+    /// Prefixes the diagnostics.
+    std::string fileName;
+    bool inGlobalInitializer = false;
+    /// Whether fold has reported an error.
+    bool failed = false;
+
+    /// E with its children folded, simplified, or E itself.
+    Expr* fold(Expr* E);
+    Expr* foldBinaryOperator(AST::BinaryOperator& op);
+    Expr* foldUnaryOperator(AST::UnaryOperator& op);
+    Expr* foldCast(ImplicitCastExpr& cast);
+    /// What replaces S, a statement whose children are folded.
+    Stmt* prune(Stmt* S);
+    /// Reports an operation C leaves undefined for the constant right
+    /// operand rhs, and lhs if lhsConst, and returns whether there is one.
+    /// Compound assignments are checked as their operation.
+    bool isUndefined(const AST::BinaryOperator& op, int lhs, bool lhsConst, int rhs);
+    /// A warning at the source offset, or an error in a global initializer.
+    void report(const std::string& message, uint32_t offset);
+
+    /// The value of a folded constant, as fold leaves it.
+    static bool getConstant(const Expr* E, int& value);
+    Expr* makeConstant(int value, TypeKind type);
+    static bool hasSideEffects(const Expr* E);
+
+    template <typename T>
+    static T& modify(const T& node)
+    {
+        return const_cast<T&>(node);
+    }
+
+public:
+    /// New nodes are allocated in Ctx, the context of the AST.
+    /// SM holds the source the AST was parsed from.
+    ASTFolder(ASTContext& Ctx, const SourceManager& SM, std::string fileName) : Ctx(Ctx), SM(SM), fileName(std::move(fileName)) {}
+
+    /// Folds root, which Sema has bound: usually a TranslationUnitDecl, or
+    /// a declaration or statement body of the REPL. Returns false after
+    /// reporting an error, in which case no code should be generated.
+    bool fold(const ASTNode& root)
+    {
+        failed = false;
+        traverse(&root);
+        return !failed;
+    }
+
+    bool traverseVarDecl(const VarDecl& decl);
+    bool traverseValueStmt(const ValueStmt& stmt);
+    bool traverseIfStmt(const IfStmt& stmt);
+    bool traverseWhileStmt(const WhileStmt& stmt);
+    bool traverseCompoundStmt(const CompoundStmt& stmt);
+    bool traverseReturnStmt(const ReturnStmt& stmt);
+    bool traverseBinaryOperator(const AST::BinaryOperator& expr);
+    bool traverseUnaryOperator(const AST::UnaryOperator& expr);
+    bool traverseParenExpr(const ParenExpr& expr);
+    bool traverseCallExpr(const CallExpr& expr);
+    bool traverseImplicitCastExpr(const ImplicitCastExpr& expr);
+};
@@ -0,0 +1,40 @@
+/**
+* @file ASTNode.cpp
+* Dispatching toJson to the class of each node
+**/
+
+#include "ASTVisitor.h"
+
+using namespace AST;
+
+namespace
+{
+    /// Forwards each node to toJson of its own class.
+    class JSONDispatcher : public ASTVisitor<JSONDispatcher, json>
+    {
+    public:
+#define AST_NODE(Class, Base) \
+        json visit##Class(const AST::Class& node) \
+        { \
+            return node.toJson(); \
+        }
+#include "ASTNodes.def"
+    };
+}
+
+const char* ASTNode::getKindName(Kind kind)
+{
+    switch (kind)
+    {
+#define AST_NODE(Class, Base) \
+        case Kind::Class: \
+            return #Class;
+#include "ASTNodes.def"
+    }
+    return "";
+}
+
+json ASTNode::toJson() const
+{
+    return JSONDispatcher().visit(this);
+}
@@ -12,61 +12,52 @@
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Support/Casting.h"
 #pragma warning(pop)
 
 using namespace llvm;
 
 using json = nlohmann::ordered_json;
 
-class CodeGeneratorBase;
-
 /**
  * @class ASTNode
  * @brief ﷨Ļࡣ
  *
- * нӹͬĻ̳ҪΪ˷ʹ麯toJsongenCodeʵֶ̬;
- * genCodeʹ÷ģʽ
+ * ÿ¼ԼKindASTNodes.defɣisa/cast/dyn_cast
+ * ASTVisitorݴڱڷɣ㱾û麯
 */
 namespace AST
 {
     class ASTNode
     {
     public:
-        virtual json toJson() const = 0;
-        virtual Value* genCode(CodeGeneratorBase& generator) const = 0;
-        virtual Function* genFunc(CodeGeneratorBase& generator) const
+        enum class Kind : uint8_t
+        {
+#define AST_NODE(Class, Base) Class,
+#define NODE_RANGE(Class, First, Last) first##Class = First, last##Class = Last,
+#include "ASTNodes.def"
+        };
+
+    private:
+        Kind kind;
+
+    protected:
+        ASTNode(Kind kind) : kind(kind) {}
+
+    public:
+        Kind getKind() const
         {
-            return nullptr;
+            return kind;
         }
+        /// The class name of the node, such as "IntegerLiteral".
+        static const char* getKindName(Kind kind);
+
+        /// Dispatches to toJson of the dynamic class through the JSON visitor.
+        json toJson() const;
     };
-    class IntegerLiteral;
-    class DeclRefExpr;
-    class BinaryOperator;
-    class UnaryOperator;
-    class CallExpr;
-    class IfStmt;
-    class WhileStmt;
-    class ReturnStmt;
-    class CompoundStmt;
-    class FunctionDecl;
-    class VarDecl;
-    class ImplicitCastExpr;
 
-}; // namespace AST
+#define AST_NODE(Class, Base) class Class;
+#define ABSTRACT_NODE(Class, Base) class Class;
+#include "ASTNodes.def"
 
-class CodeGeneratorBase
-{
-public:
-    virtual Value* gen(const AST::IntegerLiteral& expr) = 0;
-    virtual Value* gen(const AST::DeclRefExpr& expr) = 0;
-    virtual Value* gen(const AST::BinaryOperator& expr) = 0;
-    virtual Value* gen(const AST::CallExpr& expr) = 0;
-    virtual Value* gen(const AST::IfStmt& stmt) = 0;
-    virtual Value* gen(const AST::WhileStmt& stmt) = 0;
-    virtual Value* gen(const AST::ReturnStmt& stmt) = 0;
-    virtual Value* gen(const AST::VarDecl& decl) = 0;
-    virtual Value* gen(const AST::CompoundStmt& decl) = 0;
-    virtual Value* gen(const AST::UnaryOperator& expr) = 0;
-    virtual Function* gen(const AST::FunctionDecl& decl) = 0;
-    virtual Value* gen(const AST::ImplicitCastExpr& expr) = 0;
-};
+}; // namespace AST
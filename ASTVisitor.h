@@ -0,0 +1,201 @@
+/** @file ASTVisitor.h
+* @brief Visitors over the AST dispatched on ASTNode::Kind at compile time
+**/
+
+#pragma once
+#include "Decl.h"
+#include "Expr.h"
+#include "Stmt.h"
+
+namespace AST
+{
+    /**
+     * @brief Calls Derived::visitX for a node of class X.
+     *
+     * visit() switches on the kind of the node and calls the visit method of
+     * its class on Derived directly, so no call is virtual. A visit method
+     * Derived does not declare falls back to that of the base class in
+     * ASTNodes.def, ending at visitASTNode, which returns RetTy().
+    */
+    template <typename Derived, typename RetTy = void>
+    class ASTVisitor
+    {
+        Derived& getDerived()
+        {
+            return *static_cast<Derived*>(this);
+        }
+
+    public:
+        RetTy visit(const ASTNode* node)
+        {
+            switch (node->getKind())
+            {
+#define AST_NODE(Class, Base) \
+                case ASTNode::Kind::Class: \
+                    return getDerived().visit##Class(static_cast<const Class&>(*node));
+#include "ASTNodes.def"
+            }
+            llvm_unreachable("unknown AST node kind");
+        }
+
+#define AST_NODE(Class, Base) \
+        RetTy visit##Class(const Class& node) \
+        { \
+            return getDerived().visit##Base(node); \
+        }
+#define ABSTRACT_NODE(Class, Base) AST_NODE(Class, Base)
+#include "ASTNodes.def"
+
+        RetTy visitASTNode(const ASTNode&)
+        {
+            return RetTy();
+        }
+    };
+
+    /**
+     * @brief Walks a whole tree in pre-order.
+     *
+     * traverse() calls Derived::traverseX for a node of class X, which by
+     * default calls walkUpFromX and then traverses the children. walkUpFromX
+     * calls visitX of every class from ASTNode down to X, most general first.
+     * Any of them returning false stops the walk, and traverse returns false.
+     * Null children, which parse errors can leave behind, are skipped.
+    */
+    template <typename Derived>
+    class RecursiveASTVisitor
+    {
+        Derived& getDerived()
+        {
+            return *static_cast<Derived*>(this);
+        }
+
+        template <typename T>
+        bool traverseAll(ArrayRef<T*> nodes)
+        {
+            for (const T* node : nodes)
+            {
+                if (!getDerived().traverse(node))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    public:
+        bool traverse(const ASTNode* node)
+        {
+            if (!node)
+            {
+                return true;
+            }
+            switch (node->getKind())
+            {
+#define AST_NODE(Class, Base) \
+                case ASTNode::Kind::Class: \
+                    return getDerived().traverse##Class(static_cast<const Class&>(*node));
+#include "ASTNodes.def"
+            }
+            llvm_unreachable("unknown AST node kind");
+        }
+
+#define AST_NODE(Class, Base) \
+        bool walkUpFrom##Class(const Class& node) \
+        { \
+            return getDerived().walkUpFrom##Base(node) && getDerived().visit##Class(node); \
+        } \
+        bool visit##Class(const Class&) \
+        { \
+            return true; \
+        }
+#define ABSTRACT_NODE(Class, Base) AST_NODE(Class, Base)
+#include "ASTNodes.def"
+
+        bool walkUpFromASTNode(const ASTNode& node)
+        {
+            return getDerived().visitASTNode(node);
+        }
+        bool visitASTNode(const ASTNode&)
+        {
+            return true;
+        }
+
+        bool traverseTranslationUnitDecl(const TranslationUnitDecl& decl)
+        {
+            return getDerived().walkUpFromTranslationUnitDecl(decl) && traverseAll(decl.getDecls());
+        }
+        bool traverseFunctionDecl(const FunctionDecl& decl)
+        {
+            return getDerived().walkUpFromFunctionDecl(decl) && traverseAll(decl.getParams()) &&
+                getDerived().traverse(decl.getBody());
+        }
+        bool traverseVarDecl(const VarDecl& decl)
+        {
+            return getDerived().walkUpFromVarDecl(decl) && getDerived().traverse(decl.getInit());
+        }
+        bool traverseParmVarDecl(const ParmVarDecl& decl)
+        {
+            return getDerived().walkUpFromParmVarDecl(decl);
+        }
+        bool traverseNullStmt(const NullStmt& stmt)
+        {
+            return getDerived().walkUpFromNullStmt(stmt);
+        }
+        bool traverseValueStmt(const ValueStmt& stmt)
+        {
+            return getDerived().walkUpFromValueStmt(stmt) && getDerived().traverse(stmt.getExpr());
+        }
+        bool traverseIfStmt(const IfStmt& stmt)
+        {
+            return getDerived().walkUpFromIfStmt(stmt) && getDerived().traverse(stmt.getCond()) &&
+                getDerived().traverse(stmt.getThen()) && getDerived().traverse(stmt.getElse());
+        }
+        bool traverseWhileStmt(const WhileStmt& stmt)
+        {
+            return getDerived().walkUpFromWhileStmt(stmt) && getDerived().traverse(stmt.getCond()) &&
+                getDerived().traverse(stmt.getBody());
+        }
+        bool traverseDeclStmt(const DeclStmt& stmt)
+        {
+            return getDerived().walkUpFromDeclStmt(stmt) && traverseAll(stmt.getDecls());
+        }
+        bool traverseCompoundStmt(const CompoundStmt& stmt)
+        {
+            return getDerived().walkUpFromCompoundStmt(stmt) && traverseAll(stmt.body);
+        }
+        bool traverseReturnStmt(const ReturnStmt& stmt)
+        {
+            return getDerived().walkUpFromReturnStmt(stmt) && getDerived().traverse(stmt.getRetValue());
+        }
+        bool traverseIntegerLiteral(const IntegerLiteral& expr)
+        {
+            return getDerived().walkUpFromIntegerLiteral(expr);
+        }
+        bool traverseDeclRefExpr(const DeclRefExpr& expr)
+        {
+            return getDerived().walkUpFromDeclRefExpr(expr);
+        }
+        bool traverseBinaryOperator(const BinaryOperator& expr)
+        {
+            return getDerived().walkUpFromBinaryOperator(expr) && getDerived().traverse(expr.getLHS()) &&
+                getDerived().traverse(expr.getRHS());
+        }
+        bool traverseUnaryOperator(const UnaryOperator& expr)
+        {
+            return getDerived().walkUpFromUnaryOperator(expr) && getDerived().traverse(expr.getSubExpr());
+        }
+        bool traverseParenExpr(const ParenExpr& expr)
+        {
+            return getDerived().walkUpFromParenExpr(expr) && getDerived().traverse(expr.getSubExpr());
+        }
+        bool traverseCallExpr(const CallExpr& expr)
+        {
+            return getDerived().walkUpFromCallExpr(expr) && getDerived().traverse(expr.getCallee()) &&
+                traverseAll(expr.getArgs());
+        }
+        bool traverseImplicitCastExpr(const ImplicitCastExpr& expr)
+        {
+            return getDerived().walkUpFromImplicitCastExpr(expr) && getDerived().traverse(expr.getSubExpr());
+        }
+    };
+}; // namespace AST
@@ -0,0 +1,243 @@
+/**
+* @file CharInfo.cpp
+* SSE2/AVX2 run scanners for the lexer, with a scalar fallback
+**/
+
+#include "CharInfo.h"
+
+#pragma warning(push, 0)
+#include "llvm/Support/MathExtras.h"
+#pragma warning(pop)
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define TOYCC_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(TOYCC_HAS_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define TOYCC_HAS_AVX2 1
+#include <immintrin.h>
+#define TOYCC_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+using namespace charinfo;
+
+static const char* scalarSkipAlnum(const char* p, const char* end)
+{
+    while (p != end && classify(*p) <= CC_Digit)
+    {
+        p++;
+    }
+    return p;
+}
+
+static const char* scalarSkipDigits(const char* p, const char* end)
+{
+    while (p != end && classify(*p) == CC_Digit)
+    {
+        p++;
+    }
+    return p;
+}
+
+static const char* scalarSkipHorizontalSpace(const char* p, const char* end)
+{
+    while (p != end && isHorizontalSpace(*p))
+    {
+        p++;
+    }
+    return p;
+}
+
+static const char* scalarSkipCommentBody(const char* p, const char* end)
+{
+    while (p != end && *p != '*' && *p != '/' && *p != '\n')
+    {
+        p++;
+    }
+    return p;
+}
+
+static const Kernels scalarKernels = {
+    "scalar", scalarSkipAlnum, scalarSkipDigits, scalarSkipHorizontalSpace, scalarSkipCommentBody
+};
+
+// The vector kernels compute a mask of the bytes that continue the run and
+// stop at the first zero bit. Ranges are tested with the unsigned-min trick:
+// lo <= c <= hi  <=>  min(c - lo, hi - lo) == c - lo.
+
+#ifdef TOYCC_HAS_SSE2
+
+static inline __m128i inRange128(__m128i v, char lo, char hi)
+{
+    __m128i d = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(hi - lo)), d);
+}
+
+static inline __m128i isAlnum128(__m128i v)
+{
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    return _mm_or_si128(inRange128(lower, 'a', 'z'), inRange128(v, '0', '9'));
+}
+
+static inline __m128i isDigit128(__m128i v)
+{
+    return inRange128(v, '0', '9');
+}
+
+static inline __m128i isSpace128(__m128i v)
+{
+    __m128i space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    __m128i ctrl = _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), inRange128(v, '\t', '\r'));
+    return _mm_or_si128(space, ctrl);
+}
+
+static inline __m128i isCommentBody128(__m128i v)
+{
+    __m128i star = _mm_cmpeq_epi8(v, _mm_set1_epi8('*'));
+    __m128i slash = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));
+    __m128i newline = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+    return _mm_xor_si128(_mm_or_si128(_mm_or_si128(star, slash), newline), _mm_set1_epi8(-1));
+}
+
+template <__m128i (*Match)(__m128i), const char* (*Tail)(const char*, const char*)>
+static const char* sse2Skip(const char* p, const char* end)
+{
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned stop = ~static_cast<unsigned>(_mm_movemask_epi8(Match(v))) & 0xFFFF;
+        if (stop)
+        {
+            return p + llvm::countTrailingZeros(stop);
+        }
+    }
+    return Tail(p, end);
+}
+
+static const Kernels sse2Kernels = {
+    "sse2",
+    sse2Skip<isAlnum128, scalarSkipAlnum>,
+    sse2Skip<isDigit128, scalarSkipDigits>,
+    sse2Skip<isSpace128, scalarSkipHorizontalSpace>,
+    sse2Skip<isCommentBody128, scalarSkipCommentBody>
+};
+
+#endif // TOYCC_HAS_SSE2
+
+#ifdef TOYCC_HAS_AVX2
+
+TOYCC_TARGET_AVX2 static inline __m256i inRange256(__m256i v, char lo, char hi)
+{
+    __m256i d = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(hi - lo)), d);
+}
+
+TOYCC_TARGET_AVX2 static inline __m256i isAlnum256(__m256i v)
+{
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    return _mm256_or_si256(inRange256(lower, 'a', 'z'), inRange256(v, '0', '9'));
+}
+
+TOYCC_TARGET_AVX2 static inline __m256i isDigit256(__m256i v)
+{
+    return inRange256(v, '0', '9');
+}
+
+TOYCC_TARGET_AVX2 static inline __m256i isSpace256(__m256i v)
+{
+    __m256i space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    __m256i ctrl = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), inRange256(v, '\t', '\r'));
+    return _mm256_or_si256(space, ctrl);
+}
+
+TOYCC_TARGET_AVX2 static inline __m256i isCommentBody256(__m256i v)
+{
+    __m256i star = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('*'));
+    __m256i slash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/'));
+    __m256i newline = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+    return _mm256_xor_si256(_mm256_or_si256(_mm256_or_si256(star, slash), newline), _mm256_set1_epi8(-1));
+}
+
+// Spelled out instead of templated: GCC does not propagate the target
+// attribute into template instantiations.
+#define TOYCC_AVX2_SKIP(Name, Match, Tail)                                                      \
+    TOYCC_TARGET_AVX2 static const char* Name(const char* p, const char* end)                  \
+    {                                                                                           \
+        for (; end - p >= 32; p += 32)                                                          \
+        {                                                                                       \
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));                \
+            unsigned stop = ~static_cast<unsigned>(_mm256_movemask_epi8(Match(v)));             \
+            if (stop)                                                                           \
+            {                                                                                   \
+                return p + llvm::countTrailingZeros(stop);                                      \
+            }                                                                                   \
+        }                                                                                       \
+        return Tail(p, end);                                                                    \
+    }
+
+TOYCC_AVX2_SKIP(avx2SkipAlnum, isAlnum256, (sse2Skip<isAlnum128, scalarSkipAlnum>))
+TOYCC_AVX2_SKIP(avx2SkipDigits, isDigit256, (sse2Skip<isDigit128, scalarSkipDigits>))
+TOYCC_AVX2_SKIP(avx2SkipHorizontalSpace, isSpace256, (sse2Skip<isSpace128, scalarSkipHorizontalSpace>))
+TOYCC_AVX2_SKIP(avx2SkipCommentBody, isCommentBody256, (sse2Skip<isCommentBody128, scalarSkipCommentBody>))
+
+#undef TOYCC_AVX2_SKIP
+
+static const Kernels avx2Kernels = {
+    "avx2", avx2SkipAlnum, avx2SkipDigits, avx2SkipHorizontalSpace, avx2SkipCommentBody
+};
+
+#endif // TOYCC_HAS_AVX2
+
+static const Kernels* detectKernels()
+{
+#ifdef TOYCC_HAS_AVX2
+    // may run from a static initializer, before the runtime has probed the CPU
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return &avx2Kernels;
+    }
+#endif
+#ifdef TOYCC_HAS_SSE2
+    return &sse2Kernels;
+#else
+    return &scalarKernels;
+#endif
+}
+
+static const Kernels* currentKernels = detectKernels();
+
+const Kernels& charinfo::getKernels()
+{
+    return *currentKernels;
+}
+
+bool charinfo::selectKernels(llvm::StringRef name)
+{
+    if (name == "auto")
+    {
+        currentKernels = detectKernels();
+        return true;
+    }
+    if (name == "scalar")
+    {
+        currentKernels = &scalarKernels;
+        return true;
+    }
+#ifdef TOYCC_HAS_SSE2
+    if (name == "sse2")
+    {
+        currentKernels = &sse2Kernels;
+        return true;
+    }
+#endif
+#ifdef TOYCC_HAS_AVX2
+    if (name == "avx2" && __builtin_cpu_supports("avx2"))
+    {
+        currentKernels = &avx2Kernels;
+        return true;
+    }
+#endif
+    return false;
+}
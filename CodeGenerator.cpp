@@ -1,307 +1,770 @@
 #include "CodeGenerator.h"
 
+#pragma warning(push, 0)
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Transforms/Utils/Local.h"
+#pragma warning(pop)
+
 /// CreateEntryBlockAlloca - Create an alloca instruction in the entry block of
 /// the function.  This is used for mutable variables etc.
 /// Ŀǰֻint˲ָ
 AllocaInst* CodeGenerator::CreateEntryBlockAlloca(Function* TheFunction,
-    const std::string& VarName) {
+    StringRef VarName) {
     IRBuilder<> TmpB(&TheFunction->getEntryBlock(),
         TheFunction->getEntryBlock().begin());
     return TmpB.CreateAlloca(Type::getInt32Ty(TheContext), 0,
-        VarName.c_str());
+        VarName);
 }
 
-Value* CodeGenerator::gen(const IntegerLiteral& expr)
+AllocaInst* CodeGenerator::createVariable(Function* TheFunction, StringRef name)
 {
-    return ConstantInt::get(TheContext, APInt(32, expr.getValue(), true));
+    if (!ssa)
+    {
+        return CreateEntryBlockAlloca(TheFunction, name);
+    }
+    // Only stands for the variable; it is never inserted or used.
+    auto* var = new AllocaInst(Type::getInt32Ty(TheContext), 0, nullptr, Align(4), name);
+    ssaVars.push_back(var);
+    return var;
 }
 
-Value* CodeGenerator::gen(const DeclRefExpr& expr)
+Value* CodeGenerator::loadVar(Value* var)
 {
-    if (Value* V = getVar(expr.getName()))
+    if (ssa && isa<AllocaInst>(var))
     {
-        return V;
-        //return Builder->CreateLoad(V, expr.getName().c_str());
+        return readVariable(var, Builder->GetInsertBlock());
+    }
+    return Builder->CreateLoad(Type::getInt32Ty(TheContext), var);
+}
+
+Value* CodeGenerator::storeVar(Value* var, Value* val)
+{
+    if (!val)
+    {
+        return nullptr;
+    }
+    if (ssa && isa<AllocaInst>(var))
+    {
+        currentDef[{ Builder->GetInsertBlock(), var }] = val;
+        return val;
+    }
+    return Builder->CreateStore(val, var);
+}
+
+Value* CodeGenerator::readVariable(Value* var, BasicBlock* BB)
+{
+    auto it = currentDef.find({ BB, var });
+    if (it != currentDef.end())
+    {
+        return it->second = getReplacement(it->second);
+    }
+    return readVariableRecursive(var, BB);
+}
+
+Value* CodeGenerator::getReplacement(Value* val)
+{
+    auto* phi = dyn_cast<PHINode>(val);
+    while (phi && !replacedPhis.empty())
+    {
+        auto it = replacedPhis.find(phi);
+        if (it == replacedPhis.end())
+        {
+            break;
+        }
+        val = it->second;
+        phi = dyn_cast<PHINode>(val);
+    }
+    return val;
+}
+
+Value* CodeGenerator::readVariableRecursive(Value* var, BasicBlock* BB)
+{
+    Value* val;
+    if (!sealedBlocks.count(BB))
+    {
+        // more predecessors may come; sealBlock fills in the operands
+        PHINode* phi = createPhi(var, BB);
+        incompletePhis[BB].emplace_back(var, phi);
+        val = phi;
     }
-    return logErrorV("Unknown variable " + expr.getName());
+    else if (pred_empty(BB))
+    {
+        // read before any assignment, or in unreachable code
+        val = UndefValue::get(Type::getInt32Ty(TheContext));
+    }
+    else if (BasicBlock* pred = BB->getSinglePredecessor())
+    {
+        val = readVariable(var, pred);
+    }
+    else if (loopHeaders.count(BB))
+    {
+        // the phi is defined first so that a loop back to BB ends at it
+        PHINode* phi = createPhi(var, BB);
+        currentDef[{ BB, var }] = phi;
+        val = addPhiOperands(var, phi);
+    }
+    else
+    {
+        // Any way back to BB passes a loop header, where the recursion stops,
+        // so the predecessors can be asked first and a phi made only if
+        // they disagree.
+        SmallVector<std::pair<Value*, BasicBlock*>, 4> incoming;
+        for (BasicBlock* pred : predecessors(BB))
+        {
+            incoming.emplace_back(readVariable(var, pred), pred);
+        }
+        bool differ = false;
+        for (auto& in : incoming)
+        {
+            // reading a later predecessor may have removed a phi read earlier
+            in.first = getReplacement(in.first);
+            differ |= in.first != incoming.front().first;
+        }
+        val = incoming.front().first;
+        if (differ)
+        {
+            PHINode* phi = createPhi(var, BB);
+            for (auto& in : incoming)
+            {
+                phi->addIncoming(in.first, in.second);
+            }
+            val = phi;
+        }
+    }
+    currentDef[{ BB, var }] = val;
+    return val;
 }
 
-Value* CodeGenerator::getVar(const std::string& varName)
+PHINode* CodeGenerator::createPhi(Value* var, BasicBlock* BB)
 {
-    if(auto global = TheModule->getGlobalVariable(varName))
+    if (BB->empty())
     {
-        return global;
+        return PHINode::Create(Type::getInt32Ty(TheContext), 0, var->getName(), BB);
     }
-    if(auto local = NamedValues[varName])
+    return PHINode::Create(Type::getInt32Ty(TheContext), 0, var->getName(), &BB->front());
+}
+
+Value* CodeGenerator::addPhiOperands(Value* var, PHINode* phi)
+{
+    for (BasicBlock* pred : predecessors(phi->getParent()))
     {
-        return local;
+        phi->addIncoming(readVariable(var, pred), pred);
+    }
+    return tryRemoveTrivialPhi(phi);
+}
+
+Value* CodeGenerator::tryRemoveTrivialPhi(PHINode* phi)
+{
+    Value* same = nullptr;
+    for (Value* op : phi->incoming_values())
+    {
+        if (op == same || op == phi)
+        {
+            continue;
+        }
+        if (same)
+        {
+            // merges at least two values
+            return phi;
+        }
+        same = op;
+    }
+    if (!same)
+    {
+        // unreachable, or only reached before any assignment
+        same = UndefValue::get(phi->getType());
+    }
+    // phis using this one may become trivial in turn
+    SmallVector<PHINode*, 4> users;
+    for (User* user : phi->users())
+    {
+        if (user != phi && isa<PHINode>(user))
+        {
+            users.push_back(cast<PHINode>(user));
+        }
+    }
+    // Kept until the function is done, as currentDef may still name it.
+    phi->replaceAllUsesWith(same);
+    phi->dropAllReferences();
+    phi->removeFromParent();
+    replacedPhis[phi] = same;
+    for (PHINode* user : users)
+    {
+        if (!replacedPhis.count(user))
+        {
+            tryRemoveTrivialPhi(user);
+        }
+    }
+    return same;
+}
+
+void CodeGenerator::sealBlock(BasicBlock* BB)
+{
+    if (!ssa)
+    {
+        return;
+    }
+    auto it = incompletePhis.find(BB);
+    if (it != incompletePhis.end())
+    {
+        // completing them may add incomplete phis to other blocks
+        auto phis = std::move(it->second);
+        incompletePhis.erase(it);
+        for (auto& varPhi : phis)
+        {
+            addPhiOperands(varPhi.first, varPhi.second);
+        }
+    }
+    sealedBlocks.insert(BB);
+}
+
+void CodeGenerator::finishSSAFunction()
+{
+    currentDef.clear();
+    incompletePhis.clear();
+    sealedBlocks.clear();
+    loopHeaders.clear();
+    for (auto& replaced : replacedPhis)
+    {
+        replaced.first->deleteValue();
+    }
+    replacedPhis.clear();
+    for (AllocaInst* var : ssaVars)
+    {
+        var->deleteValue();
+    }
+    ssaVars.clear();
+}
+
+Value* CodeGenerator::visitTranslationUnitDecl(const TranslationUnitDecl& decl)
+{
+    for (const Decl* child : decl.getDecls())
+    {
+        visit(child);
     }
     return nullptr;
 }
 
-Value* CodeGenerator::gen(const AST::BinaryOperator& expr)
+Value* CodeGenerator::visitDeclStmt(const DeclStmt& stmt)
+{
+    for (const Decl* decl : stmt.getDecls())
+    {
+        visit(decl);
+    }
+    return nullptr;
+}
+
+Value* CodeGenerator::visitValueStmt(const ValueStmt& stmt)
+{
+    return visit(stmt.getExpr());
+}
+
+Value* CodeGenerator::visitParenExpr(const ParenExpr& expr)
+{
+    // Nested parentheses are skipped in a loop; they may go deeper than the stack.
+    const Expr* inner = &expr;
+    while (auto* paren = dyn_cast_or_null<ParenExpr>(inner))
+    {
+        inner = paren->getSubExpr();
+    }
+    return visit(inner);
+}
+
+Value* CodeGenerator::visitIntegerLiteral(const IntegerLiteral& expr)
+{
+    return emitIntegerLiteral(expr.getValue());
+}
+
+Value* CodeGenerator::emitIntegerLiteral(int value)
+{
+    return ConstantInt::get(TheContext, APInt(32, value, true));
+}
+
+Value* CodeGenerator::visitDeclRefExpr(const DeclRefExpr& expr)
+{
+    return emitDeclRef(expr.getName(), getVar(expr.getDecl()));
+}
+
+Value* CodeGenerator::emitDeclRef(StringRef name, Value* var)
+{
+    if (var)
+    {
+        return var;
+        //return Builder->CreateLoad(V, expr.getName().c_str());
+    }
+    return logErrorV("Unknown variable " + name.str());
+}
+
+Value*& CodeGenerator::getSlot(const VarDecl& var)
+{
+    std::vector<Value*>& slots = var.isFileScope() ? globals : locals;
+    if (var.getSlot() >= slots.size())
+    {
+        slots.resize(var.getSlot() + 1);
+    }
+    return slots[var.getSlot()];
+}
+
+Value*& CodeGenerator::getSlot(const FunctionDecl& function)
+{
+    if (function.getSlot() >= functions.size())
+    {
+        functions.resize(function.getSlot() + 1);
+    }
+    return functions[function.getSlot()];
+}
+
+Value* CodeGenerator::getVar(const AST::Decl* decl)
+{
+    auto* var = dyn_cast_or_null<VarDecl>(decl);
+    if (!var)
+    {
+        return nullptr;
+    }
+    Value*& slot = getSlot(*var);
+    if (!slot && var->isFileScope() && var->getSlot() < earlierGlobals.size() && earlierGlobals[var->getSlot()])
+    {
+        slot = new GlobalVariable(*TheModule, Type::getInt32Ty(TheContext), false, GlobalValue::ExternalLinkage, nullptr,
+            var->getName());
+    }
+    return slot;
+}
+
+Function* CodeGenerator::getFunction(const FunctionDecl& function)
+{
+    Value*& slot = getSlot(function);
+    if (!slot && function.getSlot() < earlierFunctions.size() && earlierFunctions[function.getSlot()])
+    {
+        slot = Function::Create(getFunctionType(function.getReturnType(), function.getParams().size()),
+            Function::ExternalLinkage, function.getName(), TheModule.get());
+    }
+    return cast_or_null<Function>(slot);
+}
+
+FunctionType* CodeGenerator::getFunctionType(StringRef returnType, size_t numParams)
+{
+    std::vector<Type*> Args(numParams,
+        Type::getInt32Ty(TheContext));//Ŀǰֻint
+
+    return FunctionType::get(returnType == "void" ? Type::getVoidTy(TheContext) : Type::getInt32Ty(TheContext),
+        Args, false);
+}
+
+/// Clears the slots that hold something, marking them in earlier.
+static void forgetSlots(std::vector<Value*>& slots, BitVector& earlier)
+{
+    if (earlier.size() < slots.size())
+    {
+        earlier.resize(slots.size());
+    }
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        if (slots[i])
+        {
+            earlier.set(i);
+            slots[i] = nullptr;
+        }
+    }
+}
+
+orc::ThreadSafeModule CodeGenerator::takeModule()
+{
+    auto next = std::make_unique<Module>("", TheContext);
+    next->setTargetTriple(TheModule->getTargetTriple());
+    next->setDataLayout(TheModule->getDataLayout());
+    orc::ThreadSafeModule res(std::move(TheModule), TSContext);
+    TheModule = std::move(next);
+    errors.clear();
+    forgetSlots(globals, earlierGlobals);
+    forgetSlots(functions, earlierFunctions);
+    return res;
+}
+
+Value* CodeGenerator::getCompactVar(const CompactAST& ast, NodeIndex decl)
+{
+    if (decl == NoNode || (ast.getKind(decl) != CompactAST::Kind::VarDecl && ast.getKind(decl) != CompactAST::Kind::ParmVarDecl))
+    {
+        return nullptr;
+    }
+    return compactValues[decl];
+}
+
+Value* CodeGenerator::visitBinaryOperator(const AST::BinaryOperator& expr)
 {
     if (expr.isAssignment())
     {
-        DeclRefExpr* LHSE = dynamic_cast<DeclRefExpr*>(expr.LHS.get());
+        auto* LHSE = dyn_cast<DeclRefExpr>(expr.LHS);
         if (!LHSE)
         {
             return logErrorV("Required lvalue at left of assignment.");
         }
         
-        Value* Val = expr.RHS->genCode(*this);
-
-        Value* Var = getVar(LHSE->getName());
-        if (!Var)
+        Value* Val = visit(expr.RHS);
+        return emitAssignment(expr.getOpKind(), LHSE->getName(), getVar(LHSE->getDecl()), Val);
+    }
+    if (AST::BinaryOperator::isLogicalOp(expr.getOpKind()) && Builder->GetInsertBlock())
+    {
+        return emitLogicalOperator(expr.getOpKind(),
+            [&](BasicBlock* trueBB, BasicBlock* falseBB) { return genCondBr(expr.LHS, trueBB, falseBB); },
+            [&] { return visit(expr.RHS); });
+    }
+    // A left-leaning chain such as a+a+...+a, as generated code has, is
+    // walked down its left operands in a loop rather than by recursion, and
+    // emitted innermost first, in the order recursion would.
+    SmallVector<const AST::BinaryOperator*, 8> chain{ &expr };
+    const Expr* inner = expr.LHS;
+    while (true)
+    {
+        while (auto* paren = dyn_cast_or_null<ParenExpr>(inner))
         {
-            return logErrorV("Undefined references of " + LHSE->getName());
+            inner = paren->getSubExpr();
         }
-        switch (expr.getOpKind())
+        auto* op = dyn_cast_or_null<AST::BinaryOperator>(inner);
+        if (!op || op->isAssignment() || AST::BinaryOperator::isLogicalOp(op->getOpKind()))
         {
-            case AST::BinaryOperatorKind::BO_Assign:
-            {
-                Builder->CreateStore(Val, Var);
-                return Val;
-            }
-            case AST::BinaryOperatorKind::BO_MulAssign:
-            {
-                Value* VarVal = Builder->CreateLoad(Var);
-                Value* tmp = Builder->CreateMul(VarVal, Val, "mulassigntmp");
-                Builder->CreateStore(tmp, Var);
-                return tmp;
-            }
-            case AST::BinaryOperatorKind::BO_DivAssign:
-            {
-                Value* VarVal = Builder->CreateLoad(Var);
-                Value* tmp = Builder->CreateSDiv(VarVal, Val, "divassigntmp");
-                Builder->CreateStore(tmp, Var);
-                return tmp;
-            }
-            case AST::BinaryOperatorKind::BO_RemAssign:
-            {
-                Value* VarVal = Builder->CreateLoad(Var);
-                Value* tmp = Builder->CreateSRem(VarVal, Val, "remassigntmp");
-                Builder->CreateStore(tmp, Var);
-                return tmp;
-            }
-            case AST::BinaryOperatorKind::BO_AddAssign:
-            {
-                Value* VarVal = Builder->CreateLoad(Var);
-                Value* tmp = Builder->CreateAdd(VarVal, Val, "addassigntmp");
-                Builder->CreateStore(tmp, Var);
-                return tmp;
-            }
-            case AST::BinaryOperatorKind::BO_SubAssign:
-            {
-                Value* VarVal = Builder->CreateLoad(Var);
-                Value* tmp = Builder->CreateSub(VarVal, Val, "subassigntmp");
-                Builder->CreateStore(tmp, Var);
-                return tmp;
-            }
-            case AST::BinaryOperatorKind::BO_ShlAssign:
-            {
-                Value* VarVal = Builder->CreateLoad(Var);
-                Value* tmp = Builder->CreateShl(VarVal, Val, "shlassigntmp");
-                Builder->CreateStore(tmp, Var);
-                return tmp;
-            }
-            case AST::BinaryOperatorKind::BO_ShrAssign:
-            {
-                Value* VarVal = Builder->CreateLoad(Var);
-                Value* tmp = Builder->CreateAShr(VarVal, Val, "shrassigntmp");
-                Builder->CreateStore(tmp, Var);
-                return tmp;
-            }
-            case AST::BinaryOperatorKind::BO_AndAssign:
-            {
-                Value* VarVal = Builder->CreateLoad(Var);
-                Value* tmp = Builder->CreateAnd(VarVal, Val, "andassigntmp");
-                Builder->CreateStore(tmp, Var);
-                return tmp;
-            }
-            case AST::BinaryOperatorKind::BO_XorAssign:
-            {
-                Value* VarVal = Builder->CreateLoad(Var);
-                Value* tmp = Builder->CreateXor(VarVal, Val, "xorassigntmp");
-                Builder->CreateStore(tmp, Var);
-                return tmp;
-            }
-            case AST::BinaryOperatorKind::BO_OrAssign:
-            {
-                Value* VarVal = Builder->CreateLoad(Var);
-                Value* tmp = Builder->CreateOr(VarVal, Val, "orassigntmp");
-                Builder->CreateStore(tmp, Var);
-                return tmp;
-            }
-            default:
-                return nullptr;
+            break;
         }
+        chain.push_back(op);
+        inner = op->LHS;
     }
-    else
+    Value* L = visit(inner);
+    for (const AST::BinaryOperator* op : llvm::reverse(chain))
     {
-        Value* L = expr.LHS->genCode(*this);
-        Value* R = expr.RHS->genCode(*this);
-        if (!L || !R)
+        Value* R = visit(op->RHS);
+        L = L && R ? emitBinaryOperator(op->getOpKind(), L, R) : nullptr;
+    }
+    return L;
+}
+
+Value* CodeGenerator::emitAssignment(BinaryOperatorKind op, StringRef varName, Value* Var, Value* Val)
+{
+    if (!Var)
+    {
+        return logErrorV("Undefined references of " + varName.str());
+    }
+    switch (op)
+    {
+        case AST::BinaryOperatorKind::BO_Assign:
         {
-            return nullptr;
+            storeVar(Var, Val);
+            return Val;
         }
-        if (L->getType()->getIntegerBitWidth() < 32)
-        {
-            L = Builder->CreateIntCast(L, Type::getInt32Ty(TheContext), true);
-        }
-        if (R->getType()->getIntegerBitWidth() < 32)
-        {
-            R = Builder->CreateIntCast(R, Type::getInt32Ty(TheContext), true);
-        }
-        switch (expr.getOpKind())
-        {
-            
-            case AST::BinaryOperatorKind::BO_Mul:
-                return Builder->CreateMul(L, R, "multmp");
-            case AST::BinaryOperatorKind::BO_Div:
-                return Builder->CreateSDiv(L, R, "divtmp");
-            case AST::BinaryOperatorKind::BO_Rem:
-                return Builder->CreateSRem(L, R, "remtmp");
-            case AST::BinaryOperatorKind::BO_Add:
-                return Builder->CreateAdd(L, R, "addtmp");
-            case AST::BinaryOperatorKind::BO_Sub:
-                return Builder->CreateSub(L, R, "subtmp");
-            case AST::BinaryOperatorKind::BO_Shl:
-                return Builder->CreateShl(L, R, "shltmp");
-            case AST::BinaryOperatorKind::BO_Shr:
-                return Builder->CreateAShr(L, R, "shrtmp");
-            case AST::BinaryOperatorKind::BO_LT:
-                return Builder->CreateICmpSLT(L, R, "lttmp");
-            case AST::BinaryOperatorKind::BO_GT:
-                return Builder->CreateICmpSGT(L, R, "gttmp");
-            case AST::BinaryOperatorKind::BO_LE:
-                return Builder->CreateICmpSLE(L, R, "letmp");
-            case AST::BinaryOperatorKind::BO_GE:
-                return Builder->CreateICmpSGE(L, R, "getmp");
-            case AST::BinaryOperatorKind::BO_EQ:
-                return Builder->CreateICmpEQ(L, R, "eqtmp");
-            case AST::BinaryOperatorKind::BO_NE:
-                return Builder->CreateICmpNE(L, R, "netmp");
-            case AST::BinaryOperatorKind::BO_And:
-                return Builder->CreateAnd(L, R, "andtmp");
-            case AST::BinaryOperatorKind::BO_Xor:
-                return Builder->CreateXor(L, R, "xortmp");
-            case AST::BinaryOperatorKind::BO_Or:
-                return Builder->CreateOr(L, R, "ortmp");
-            case AST::BinaryOperatorKind::BO_LAnd:
-            {
-                // todo: ʵ֡·
-                Value* op1 = Builder->CreateICmpNE(L, ConstantInt::get(TheContext, APInt(32, 0, true)));
-                Value* op2 = Builder->CreateICmpNE(R, ConstantInt::get(TheContext, APInt(32, 0, true)));
-                return Builder->CreateAnd(op1, op2, "landtmp");
-            }
-            case AST::BinaryOperatorKind::BO_LOr:
-            {
-                // todo: ʵ֡·
-                Value* op1 = Builder->CreateICmpNE(L, ConstantInt::get(TheContext, APInt(32, 0, true)));
-                Value* op2 = Builder->CreateICmpNE(R, ConstantInt::get(TheContext, APInt(32, 0, true)));
-                return Builder->CreateOr(op1, op2, "lortmp");
-            }
-            default:
-                break;
+        case AST::BinaryOperatorKind::BO_MulAssign:
+        {
+            Value* VarVal = loadVar(Var);
+            Value* tmp = Builder->CreateMul(VarVal, Val, "mulassigntmp");
+            storeVar(Var, tmp);
+            return tmp;
+        }
+        case AST::BinaryOperatorKind::BO_DivAssign:
+        {
+            Value* VarVal = loadVar(Var);
+            Value* tmp = Builder->CreateSDiv(VarVal, Val, "divassigntmp");
+            storeVar(Var, tmp);
+            return tmp;
+        }
+        case AST::BinaryOperatorKind::BO_RemAssign:
+        {
+            Value* VarVal = loadVar(Var);
+            Value* tmp = Builder->CreateSRem(VarVal, Val, "remassigntmp");
+            storeVar(Var, tmp);
+            return tmp;
         }
+        case AST::BinaryOperatorKind::BO_AddAssign:
+        {
+            Value* VarVal = loadVar(Var);
+            Value* tmp = Builder->CreateAdd(VarVal, Val, "addassigntmp");
+            storeVar(Var, tmp);
+            return tmp;
+        }
+        case AST::BinaryOperatorKind::BO_SubAssign:
+        {
+            Value* VarVal = loadVar(Var);
+            Value* tmp = Builder->CreateSub(VarVal, Val, "subassigntmp");
+            storeVar(Var, tmp);
+            return tmp;
+        }
+        case AST::BinaryOperatorKind::BO_ShlAssign:
+        {
+            Value* VarVal = loadVar(Var);
+            Value* tmp = Builder->CreateShl(VarVal, Val, "shlassigntmp");
+            storeVar(Var, tmp);
+            return tmp;
+        }
+        case AST::BinaryOperatorKind::BO_ShrAssign:
+        {
+            Value* VarVal = loadVar(Var);
+            Value* tmp = Builder->CreateAShr(VarVal, Val, "shrassigntmp");
+            storeVar(Var, tmp);
+            return tmp;
+        }
+        case AST::BinaryOperatorKind::BO_AndAssign:
+        {
+            Value* VarVal = loadVar(Var);
+            Value* tmp = Builder->CreateAnd(VarVal, Val, "andassigntmp");
+            storeVar(Var, tmp);
+            return tmp;
+        }
+        case AST::BinaryOperatorKind::BO_XorAssign:
+        {
+            Value* VarVal = loadVar(Var);
+            Value* tmp = Builder->CreateXor(VarVal, Val, "xorassigntmp");
+            storeVar(Var, tmp);
+            return tmp;
+        }
+        case AST::BinaryOperatorKind::BO_OrAssign:
+        {
+            Value* VarVal = loadVar(Var);
+            Value* tmp = Builder->CreateOr(VarVal, Val, "orassigntmp");
+            storeVar(Var, tmp);
+            return tmp;
+        }
+        default:
+            return nullptr;
+    }
+}
+
+Value* CodeGenerator::emitBinaryOperator(BinaryOperatorKind op, Value* L, Value* R)
+{
+    // Sema has converted the operands: i1 for && and ||, and for == and !=
+    // on two bools; i32 otherwise.
+    switch (op)
+    {
+        
+        case AST::BinaryOperatorKind::BO_Mul:
+            return Builder->CreateMul(L, R, "multmp");
+        case AST::BinaryOperatorKind::BO_Div:
+            return Builder->CreateSDiv(L, R, "divtmp");
+        case AST::BinaryOperatorKind::BO_Rem:
+            return Builder->CreateSRem(L, R, "remtmp");
+        case AST::BinaryOperatorKind::BO_Add:
+            return Builder->CreateAdd(L, R, "addtmp");
+        case AST::BinaryOperatorKind::BO_Sub:
+            return Builder->CreateSub(L, R, "subtmp");
+        case AST::BinaryOperatorKind::BO_Shl:
+            return Builder->CreateShl(L, R, "shltmp");
+        case AST::BinaryOperatorKind::BO_Shr:
+            return Builder->CreateAShr(L, R, "shrtmp");
+        case AST::BinaryOperatorKind::BO_LT:
+            return Builder->CreateICmpSLT(L, R, "lttmp");
+        case AST::BinaryOperatorKind::BO_GT:
+            return Builder->CreateICmpSGT(L, R, "gttmp");
+        case AST::BinaryOperatorKind::BO_LE:
+            return Builder->CreateICmpSLE(L, R, "letmp");
+        case AST::BinaryOperatorKind::BO_GE:
+            return Builder->CreateICmpSGE(L, R, "getmp");
+        case AST::BinaryOperatorKind::BO_EQ:
+            return Builder->CreateICmpEQ(L, R, "eqtmp");
+        case AST::BinaryOperatorKind::BO_NE:
+            return Builder->CreateICmpNE(L, R, "netmp");
+        case AST::BinaryOperatorKind::BO_And:
+            return Builder->CreateAnd(L, R, "andtmp");
+        case AST::BinaryOperatorKind::BO_Xor:
+            return Builder->CreateXor(L, R, "xortmp");
+        case AST::BinaryOperatorKind::BO_Or:
+            return Builder->CreateOr(L, R, "ortmp");
+        case AST::BinaryOperatorKind::BO_LAnd:
+            // Only outside of functions, in the initializer of a global,
+            // where there are no blocks to branch between; see emitLogicalOperator.
+            return Builder->CreateAnd(L, R, "landtmp");
+        case AST::BinaryOperatorKind::BO_LOr:
+            return Builder->CreateOr(L, R, "lortmp");
+        default:
+            break;
     }
     return nullptr;
 }
 
-Value* CodeGenerator::gen(const CallExpr& expr)
+Value* CodeGenerator::emitLogicalBr(BinaryOperatorKind op, CondBrGen genLHS, CondBrGen genRHS, BasicBlock* trueBB, BasicBlock* falseBB)
+{
+    bool isAnd = op == AST::BinaryOperatorKind::BO_LAnd;
+    BasicBlock* rhsBB = BasicBlock::Create(TheContext, isAnd ? "land.rhs" : "lor.rhs");
+    if (!(isAnd ? genLHS(rhsBB, falseBB) : genLHS(trueBB, rhsBB)))
+    {
+        return nullptr;
+    }
+    // however deep the left operand, all its branches to rhsBB are there now
+    sealBlock(rhsBB);
+    appendBlock(rhsBB);
+    Builder->SetInsertPoint(rhsBB);
+    return genRHS(trueBB, falseBB);
+}
+
+Value* CodeGenerator::emitLogicalOperator(BinaryOperatorKind op, CondBrGen genLHS, function_ref<Value*()> genRHS)
+{
+    bool isAnd = op == AST::BinaryOperatorKind::BO_LAnd;
+    BasicBlock* rhsBB = BasicBlock::Create(TheContext, isAnd ? "land.rhs" : "lor.rhs");
+    BasicBlock* endBB = BasicBlock::Create(TheContext, isAnd ? "land.end" : "lor.end");
+    if (!(isAnd ? genLHS(rhsBB, endBB) : genLHS(endBB, rhsBB)))
+    {
+        return nullptr;
+    }
+    sealBlock(rhsBB);
+    appendBlock(rhsBB);
+    Builder->SetInsertPoint(rhsBB);
+    Value* R = genRHS();
+    if (!R)
+    {
+        return nullptr;
+    }
+    BasicBlock* rhsEnd = Builder->GetInsertBlock();
+    Builder->CreateBr(endBB);
+    sealBlock(endBB);
+    appendBlock(endBB);
+    Builder->SetInsertPoint(endBB);
+    // Every other way in is the left operand deciding: false for &&, true for ||.
+    PHINode* phi = Builder->CreatePHI(Type::getInt1Ty(TheContext), pred_size(endBB), isAnd ? "land" : "lor");
+    for (BasicBlock* pred : predecessors(endBB))
+    {
+        phi->addIncoming(pred == rhsEnd ? R : ConstantInt::getBool(TheContext, !isAnd), pred);
+    }
+    return phi;
+}
+
+void CodeGenerator::appendBlock(BasicBlock* BB)
+{
+    Function* TheFunction = Builder->GetInsertBlock()->getParent();
+    TheFunction->getBasicBlockList().insert(std::prev(TheFunction->end()), BB);
+}
+
+Value* CodeGenerator::genCondBr(const Expr* cond, BasicBlock* trueBB, BasicBlock* falseBB)
+{
+    while (auto* paren = dyn_cast_or_null<ParenExpr>(cond))
+    {
+        cond = paren->getSubExpr();
+    }
+    if (auto* op = dyn_cast_or_null<AST::BinaryOperator>(cond); op && AST::BinaryOperator::isLogicalOp(op->getOpKind()))
+    {
+        return emitLogicalBr(op->getOpKind(),
+            [&](BasicBlock* T, BasicBlock* F) { return genCondBr(op->getLHS(), T, F); },
+            [&](BasicBlock* T, BasicBlock* F) { return genCondBr(op->getRHS(), T, F); }, trueBB, falseBB);
+    }
+    if (auto* op = dyn_cast_or_null<AST::UnaryOperator>(cond); op && op->getOpKind() == UnaryOperatorKind::UO_LNot)
+    {
+        return genCondBr(op->getSubExpr(), falseBB, trueBB);
+    }
+    Value* CondV = visit(cond);
+    return CondV ? Builder->CreateCondBr(CondV, trueBB, falseBB) : nullptr;
+}
+
+Value* CodeGenerator::visitCallExpr(const CallExpr& expr)
+{
+    auto* callee = dyn_cast_or_null<FunctionDecl>(cast<DeclRefExpr>(expr.function)->getDecl());
+    return emitCall(callee ? getFunction(*callee) : nullptr, expr.paras.size(),
+        [&](size_t i) { return visit(expr.paras[i]); });
+}
+
+Value* CodeGenerator::emitCall(Function* fun, size_t numArgs, function_ref<Value*(size_t)> genArg)
 {
-    Function* fun = TheModule->getFunction(dynamic_cast<DeclRefExpr*>(expr.function.get())->getName());
     if (!fun)
     {
         return logErrorV("Unknown function referenced");
     }
-    if (expr.paras.size() != fun->arg_size())
+    if (numArgs != fun->arg_size())
     {
         return logErrorV("The function " + fun->getName().str() + " requried for "
             + std::to_string(fun->arg_size()) +
-            " arguments, but " + std::to_string(expr.paras.size()) + " were given.");
+            " arguments, but " + std::to_string(numArgs) + " were given.");
     }
 
     std::vector<Value*> ArgsV;
-    for (const auto& arg : expr.paras)
+    for (size_t i = 0; i < numArgs; i++)
     {
-        ArgsV.emplace_back(arg->genCode(*this));
+        ArgsV.emplace_back(genArg(i));
         if (!ArgsV.back())
             return nullptr;
     }
 
-    return Builder->CreateCall(fun, ArgsV, "calltmp");
+    // a call of a void function yields nothing to name
+    return Builder->CreateCall(fun, ArgsV, fun->getReturnType()->isVoidTy() ? "" : "calltmp");
 }
 
 static void removeDeadCode(BasicBlock* BB)
 {
     //assert(BB->getTerminator() && "BasicBlock must have terminator!");
-    bool isDead = false;
-    for (auto it = BB->begin(); it != BB->end(); ++it)
+    auto terminator = std::find_if(BB->begin(), BB->end(), [](Instruction& I) { return I.isTerminator(); });
+    if (terminator == BB->end())
     {
-        if (isDead)
-        {
-            it->removeFromParent();
-            break;
-        }
-        if (it->isTerminator())
-        {
-            isDead = true;
-        }
+        return;
+    }
+    // Whatever was emitted after the first terminator only uses itself; it is
+    // erased, not just unlinked, so that no branch of it still points at a block.
+    while (&BB->back() != &*terminator)
+    {
+        Instruction& dead = BB->back();
+        dead.replaceAllUsesWith(UndefValue::get(dead.getType()));
+        dead.eraseFromParent();
     }
 }
 
-Value* CodeGenerator::gen(const AST::IfStmt& node)
+Value* CodeGenerator::visitIfStmt(const AST::IfStmt& node)
 {
-    Value* CondV = node.cond->genCode(*this);
-    if (!CondV)
-        return nullptr;
-
-    // Convert condition to a bool by comparing non-equal to 0.
-    if (CondV->getType() != Type::getInt1Ty(TheContext))
-    {
-        CondV = Builder->CreateICmpNE(CondV,
-            ConstantInt::get(TheContext, APInt(32, 0)), "ifcond");
-    }
+    auto genElse = [&] { visit(node.elseBody); };
+    return emitIf([&](BasicBlock* trueBB, BasicBlock* falseBB) { return genCondBr(node.cond, trueBB, falseBB); },
+        [&] { visit(node.body); },
+        node.elseBody ? function_ref<void()>(genElse) : nullptr);
+}
 
+Value* CodeGenerator::emitIf(CondBrGen genCondBr, function_ref<void()> genThen, function_ref<void()> genElse)
+{
     Function* TheFunction = Builder->GetInsertBlock()->getParent();
 
     BasicBlock* ThenBB = BasicBlock::Create(TheContext, "if.then");
+    BasicBlock* ElseBB = genElse ? BasicBlock::Create(TheContext, "if.else") : nullptr;
     BasicBlock* EndBB = BasicBlock::Create(TheContext, "if.end");
 
+    // Sema has converted the condition to bool.
+    Value* CondV = genCondBr(ThenBB, ElseBB ? ElseBB : EndBB);
+    if (!CondV)
+        return nullptr;
+
     Function::iterator insertPos = ----TheFunction->end();
     insertPos = TheFunction->getBasicBlockList().insertAfter(insertPos, ThenBB);
 
-    if (node.elseBody)
+    if (genElse)
     {
-        BasicBlock* ElseBB = BasicBlock::Create(TheContext, "if.else");
-
-        Builder->CreateCondBr(CondV, ThenBB, ElseBB);
+        sealBlock(ElseBB);
         insertPos = TheFunction->getBasicBlockList().insertAfter(insertPos, ElseBB);
         Builder->SetInsertPoint(ElseBB);
-        node.elseBody->genCode(*this);
+        genElse();
         Builder->CreateBr(EndBB);
     }
-    else
-    {
-        Builder->CreateCondBr(CondV, ThenBB, EndBB);
-    }
+    sealBlock(ThenBB);
 
     // Emit then value.
     Builder->SetInsertPoint(ThenBB);
-    node.body->genCode(*this);
+    genThen();
     Builder->CreateBr(EndBB);
+    sealBlock(EndBB);
 
     TheFunction->getBasicBlockList().insertAfter(insertPos, EndBB);
     Builder->SetInsertPoint(EndBB);
     return CondV;
 }
 
-Value* CodeGenerator::gen(const AST::WhileStmt& node)
+Value* CodeGenerator::visitWhileStmt(const AST::WhileStmt& node)
+{
+    return emitWhile([&](BasicBlock* trueBB, BasicBlock* falseBB) { return genCondBr(node.cond, trueBB, falseBB); },
+        [&] { visit(node.body); });
+}
+
+Value* CodeGenerator::emitWhile(CondBrGen genCondBr, function_ref<void()> genBody)
 {
     Function* TheFunction = Builder->GetInsertBlock()->getParent();
     BasicBlock* condBB = BasicBlock::Create(TheContext, "while.cond");
+    if (ssa)
+    {
+        loopHeaders.insert(condBB);
+    }
     BasicBlock* LoopBB = BasicBlock::Create(TheContext, "while.body");
     BasicBlock* AfterBB =
         BasicBlock::Create(TheContext, "while.end");
@@ -309,88 +772,155 @@ Value* CodeGenerator::gen(const AST::WhileStmt& node)
     auto insertPos = ----TheFunction->getBasicBlockList().end();
     insertPos = TheFunction->getBasicBlockList().insertAfter(insertPos, condBB);
     Builder->SetInsertPoint(condBB);
-    Value* CondV = node.cond->genCode(*this);
-    Value* loopCond = CondV;
-    if (CondV->getType() != Type::getInt1Ty(TheContext))
-    {
-        loopCond = Builder->CreateICmpNE(CondV,
-            ConstantInt::get(TheContext, APInt(32, 0)));
-    }
+    // Sema has converted the condition to bool.
+    Value* CondV = genCondBr(LoopBB, AfterBB);
+    if (!CondV)
+        return nullptr;
 
-    Builder->CreateCondBr(loopCond, LoopBB, AfterBB);
+    sealBlock(LoopBB);
+    sealBlock(AfterBB);
+    // after the blocks of && and || in the condition
+    insertPos = ----TheFunction->getBasicBlockList().end();
     insertPos = TheFunction->getBasicBlockList().insertAfter(insertPos, LoopBB);
     //TheFunction->getBasicBlockList().push_back(LoopBB);
     Builder->SetInsertPoint(LoopBB);
-    node.body->genCode(*this);
+    genBody();
     Builder->CreateBr(condBB);
+    // the back edge was the last way into the condition
+    sealBlock(condBB);
     insertPos = TheFunction->getBasicBlockList().insertAfter(insertPos, AfterBB);
     //TheFunction->getBasicBlockList().push_back(AfterBB);
     Builder->SetInsertPoint(AfterBB);
     return CondV;
 }
 
-Function* CodeGenerator::gen(const AST::FunctionDecl& decl)
+Value* CodeGenerator::visitFunctionDecl(const AST::FunctionDecl& decl)
 {
-    std::vector<Type*> Args(decl.paras.size(),
-        Type::getInt32Ty(TheContext));//Ŀǰֻint
+    SmallVector<StringRef, 4> paraNames;
+    for (const ParmVarDecl* para : decl.paras)
+    {
+        paraNames.push_back(para->getName());
+    }
+    Stmt* body = decl.getBody();
+    auto genBody = [&] { visit(body); };
+    // a function declared inside another one leaves its locals alone
+    std::vector<Value*> outerLocals = std::move(locals);
+    locals.assign(decl.getNumLocals(), nullptr);
+    Function* F = emitFunction(decl.returnType, decl.name, paraNames, getSlot(decl),
+        [&](size_t i) -> Value*& { return getSlot(*decl.paras[i]); },
+        body ? function_ref<void()>(genBody) : nullptr);
+    locals = std::move(outerLocals);
+    return F;
+}
 
-    FunctionType* FT = FunctionType::get(decl.returnType == "void" ? Type::getVoidTy(TheContext) : Type::getInt32Ty(TheContext),
-        Args, false);
+Function* CodeGenerator::emitFunction(StringRef returnType, StringRef name, ArrayRef<StringRef> paraNames, Value*& slot,
+                                      function_ref<Value*&(size_t)> paraSlot, function_ref<void()> genBody)
+{
+    if (genBody && inBody)
+    {
+        // Not C, and retVal and the SSA state belong to the enclosing function.
+        logErrorV("Function " + name.str() + " is defined inside another function");
+        return nullptr;
+    }
+    FunctionType* FT = getFunctionType(returnType, paraNames.size());
 
-    auto F = TheModule->getFunction(decl.name);
+    auto F = TheModule->getFunction(name);
     if (F)
     {
-        if (!F->empty() || !decl.body)
+        slot = F;
+        if (!F->empty() || !genBody)
         {
-            logErrorV("Redefined funciton " + decl.name);
+            logErrorV("Redefined funciton " + name.str());
             return nullptr;
         }
-        if (F->arg_size() != decl.paras.size())
+        if (F->arg_size() != paraNames.size())
         {
-            logErrorV("Wrong arguments number " + std::to_string(decl.paras.size()));
+            logErrorV("Wrong arguments number " + std::to_string(paraNames.size()));
             return nullptr;
         }
     }
     else {
-        F = Function::Create(FT, Function::ExternalLinkage, decl.name, TheModule.get());
+        F = Function::Create(FT, Function::ExternalLinkage, name, TheModule.get());
+        slot = F;
     }
 
     unsigned Idx = 0;
     for (auto& Arg : F->args())
-        Arg.setName(decl.paras[Idx++]->getName());
+        Arg.setName(paraNames[Idx++]);
 
-    if (!decl.body)
+    if (!genBody)
     {
         return F;
     }
 
     BasicBlock* BB = BasicBlock::Create(TheContext, "entry", F);
     BasicBlock* returnBB = BasicBlock::Create(TheContext, "return", F);
-    Builder->SetInsertPoint(returnBB);
-    retVal = !F->getReturnType()->isVoidTy() ? CreateEntryBlockAlloca(F, "retval") : nullptr;
-    if (retVal)
-    {
-        auto ret = Builder->CreateLoad(retVal);
-        Builder->CreateRet(ret);
-    }
-    else
+    sealBlock(BB);
+    retVal = !F->getReturnType()->isVoidTy() ? createVariable(F, "retval") : nullptr;
+    if (!ssa)
     {
-        Builder->CreateRetVoid();
+        Builder->SetInsertPoint(returnBB);
+        if (retVal)
+        {
+            auto ret = Builder->CreateLoad(Type::getInt32Ty(TheContext), retVal);
+            Builder->CreateRet(ret);
+        }
+        else
+        {
+            Builder->CreateRetVoid();
+        }
     }
     Builder->SetInsertPoint(BB);
 
-    auto NamedValuesBackup = std::move(NamedValues);
-
     for (auto& Arg : F->args()) {
-        AllocaInst* Alloca = CreateEntryBlockAlloca(F, Arg.getName().str());
+        AllocaInst* Alloca = createVariable(F, Arg.getName());
 
-        Builder->CreateStore(&Arg, Alloca);
+        storeVar(Alloca, &Arg);
 
-        NamedValues[Arg.getName().str()] = Alloca;
+        paraSlot(Arg.getArgNo()) = Alloca;
     }
 
-    decl.body->genCode(*this);
+    inBody = true;
+    genBody();
+    inBody = false;
     Builder->CreateBr(returnBB);
+    if (ssa)
+    {
+        // every return has branched here by now, so the return value is a
+        // phi of the values they stored
+        sealBlock(returnBB);
+        Builder->SetInsertPoint(returnBB);
+        if (retVal)
+        {
+            Builder->CreateRet(readVariable(retVal, returnBB));
+        }
+        else
+        {
+            Builder->CreateRetVoid();
+        }
+        if (removeUnreachableBlocks(*F))
+        {
+            // The branches out of code after a return are gone with it. Phis
+            // that merged a value with undef from there may now merge one
+            // value only.
+            SmallVector<PHINode*, 16> phis;
+            for (BasicBlock& block : *F)
+            {
+                for (PHINode& phi : block.phis())
+                {
+                    phis.push_back(&phi);
+                }
+            }
+            for (PHINode* phi : phis)
+            {
+                if (!replacedPhis.count(phi))
+                {
+                    tryRemoveTrivialPhi(phi);
+                }
+            }
+        }
+        finishSSAFunction();
+    }
     for (auto& it : F->getBasicBlockList())
     {
         removeDeadCode(&it);
@@ -400,105 +930,141 @@ Function* CodeGenerator::gen(const AST::FunctionDecl& decl)
     raw_ostream* out = new raw_string_ostream(error_output);
     if (verifyFunction(*F, out))
         std::cerr << error_output << std::endl;
-    NamedValues = std::move(NamedValuesBackup);
     return F;
 }
 
-Value* CodeGenerator::gen(const AST::ReturnStmt& stmt)
+Value* CodeGenerator::visitReturnStmt(const AST::ReturnStmt& stmt)
+{
+    auto genValue = [&] { return visit(stmt.returnValue); };
+    return emitReturn(stmt.returnValue ? function_ref<Value*()>(genValue) : nullptr);
+}
+
+Value* CodeGenerator::emitReturn(function_ref<Value*()> genValue)
 {
     Function* TheFunction = Builder->GetInsertBlock()->getParent();
     auto& returnBB = TheFunction->getBasicBlockList().back();
-    if (!stmt.returnValue)
+    if (genValue)
     {
-        return Builder->CreateBr(&returnBB);
+        Value* val = genValue();
+        if (retVal)
+        {
+            storeVar(retVal, val);
+        }
     }
-    else
+    Value* br = Builder->CreateBr(&returnBB);
+    if (ssa)
     {
-        Builder->CreateStore(stmt.returnValue->genCode(*this), retVal);
-        return Builder->CreateBr(&returnBB);
+        // Whatever follows the return goes to a block of its own; nothing
+        // branches there, and emitFunction deletes it.
+        BasicBlock* deadBB = BasicBlock::Create(TheContext, "unreachable", TheFunction, &returnBB);
+        sealBlock(deadBB);
+        Builder->SetInsertPoint(deadBB);
     }
+    return br;
 }
 
-Value* CodeGenerator::gen(const AST::CompoundStmt& stmt)
+Value* CodeGenerator::visitCompoundStmt(const AST::CompoundStmt& stmt)
 {
-    auto NamedValueBackup = NamedValues;
+    return emitCompound(stmt.body.size(), [&](size_t i) { return visit(stmt.body[i]); });
+}
 
+Value* CodeGenerator::emitCompound(size_t numStmts, function_ref<Value*(size_t)> genStmt)
+{
     Value* res = nullptr;
 
-    for (const auto& bodyStmt : stmt.body)
+    for (size_t i = 0; i < numStmts; i++)
     {
-        auto tmp = bodyStmt->genCode(*this);
+        auto tmp = genStmt(i);
         if (!res)
         {
             res = tmp;
         }
     }
-    NamedValues = NamedValueBackup;
     return res;
 }
 
-Value* CodeGenerator::gen(const AST::VarDecl& decl)
+Value* CodeGenerator::visitVarDecl(const AST::VarDecl& decl)
+{
+    auto genInit = [&] { return visit(decl.initValue); };
+    // a redefinition gets no storage
+    Value* unused = nullptr;
+    return emitVarDecl(decl.getName(), decl.isFileScope(), decl.isInvalid(), decl.isInvalid() ? unused : getSlot(decl),
+        decl.hasInit ? function_ref<Value*()>(genInit) : nullptr);
+}
+
+Value* CodeGenerator::emitVarDecl(StringRef name, bool fileScope, bool invalid, Value*& slot, function_ref<Value*()> genInit)
 {
-    if (NamedValues[decl.getName()])
+    if (invalid && !fileScope)
     {
-        return logErrorV("Redefined " + decl.getName());
+        return logErrorV("Redefined " + name.str());
     }
 
-    Value* InitVal = decl.hasInit ? decl.initValue->genCode(*this) : nullptr;
+    Value* InitVal = genInit ? genInit() : nullptr;
 
-    if (Builder->GetInsertBlock())
+    if (!fileScope)
     {
         Function* TheFunction = Builder->GetInsertBlock()->getParent();
 
-        AllocaInst* Alloca = CreateEntryBlockAlloca(TheFunction, decl.getName());
-        NamedValues[decl.getName()] = Alloca;
+        AllocaInst* Alloca = createVariable(TheFunction, name);
+        slot = Alloca;
 
         if (InitVal)
         {
-            return Builder->CreateStore(InitVal, Alloca);
+            return storeVar(Alloca, InitVal);
         }
         return nullptr;
     }
     else
     {
-        if (TheModule->getGlobalVariable(decl.getName()))
+        if (invalid)
+        {
+            return logErrorV("Redefined variable " + name.str());
+        }
+        // the folder has left a constant initializer a literal
+        auto* initializer = InitVal ? dyn_cast<ConstantInt>(InitVal) : ConstantInt::get(Type::getInt32Ty(TheContext), 0);
+        if (!initializer)
         {
-            return logErrorV("Redefined variable " + decl.getName());
+            return logErrorV("Initializer element of " + name.str() + " is not a compile-time constant");
         }
         GlobalVariable* var = new GlobalVariable(*TheModule, Type::getInt32Ty(TheContext), false,
-            GlobalValue::ExternalLinkage,
-            Constant::getIntegerValue(Type::getInt32Ty(TheContext),
-                APInt(32, 0, true)), decl.getName());
+            GlobalValue::ExternalLinkage, initializer, name);
+        slot = var;
         return var;
     }
 }
 
-Value* CodeGenerator::gen(const AST::UnaryOperator& expr)
+Value* CodeGenerator::visitUnaryOperator(const AST::UnaryOperator& expr)
 {
-    Value* val = expr.body->genCode(*this);
-    switch (expr.op)
+    return emitUnaryOperator(expr.op, visit(expr.body));
+}
+
+Value* CodeGenerator::emitUnaryOperator(UnaryOperatorKind op, Value* val)
+{
+    if (!val)
     {
+        return nullptr;
+    }
+    switch (op)
+    {
+        // val is the variable for ++ and --, and a value of the type Sema gave
+        // the operand otherwise.
         case UnaryOperatorKind::UO_PreInc:
-        {
-            Value* add_val = Builder->CreateNSWAdd(val, Constant::getIntegerValue(Type::getInt32Ty(TheContext), APInt(32, 1, true)),"preInc");
-            return Builder->CreateStore(add_val, val);
-        }
         case UnaryOperatorKind::UO_PreDec:
-        {
-            Value* sub_val = Builder->CreateNSWSub(val, Constant::getIntegerValue(Type::getInt32Ty(TheContext), APInt(32, 1, true)),"preDec");
-            return Builder->CreateStore(sub_val, val);
-        }
         case UnaryOperatorKind::UO_PostInc:
-        {
-            Value* add_val = Builder->CreateNSWAdd(val, Constant::getIntegerValue(Type::getInt32Ty(TheContext), APInt(32, 1, true)),"postInc");
-            Builder->CreateStore(add_val, val);
-            return val;
-        }
         case UnaryOperatorKind::UO_PostDec:
         {
-            Value* sub_val = Builder->CreateNSWSub(val, Constant::getIntegerValue(Type::getInt32Ty(TheContext), APInt(32, 1, true)),"postDec");
-            Builder->CreateStore(sub_val, val);
-            return val;
+            if (!val->getType()->isPointerTy())
+            {
+                return logErrorV("Required lvalue as operand of increment or decrement.");
+            }
+            bool isInc = op == UnaryOperatorKind::UO_PreInc || op == UnaryOperatorKind::UO_PostInc;
+            bool isPre = op == UnaryOperatorKind::UO_PreInc || op == UnaryOperatorKind::UO_PreDec;
+            Value* one = Constant::getIntegerValue(Type::getInt32Ty(TheContext), APInt(32, 1, true));
+            Value* old = loadVar(val);
+            Value* res = isInc ? Builder->CreateNSWAdd(old, one, isPre ? "preInc" : "postInc")
+                               : Builder->CreateNSWSub(old, one, isPre ? "preDec" : "postDec");
+            storeVar(val, res);
+            return isPre ? res : old;
         }
         case UnaryOperatorKind::UO_Not:
         {
@@ -514,7 +1080,7 @@ Value* CodeGenerator::gen(const AST::UnaryOperator& expr)
         }
         case UnaryOperatorKind::UO_LNot:
         {
-            return Builder->CreateICmpEQ(val, ConstantInt::get(TheContext, APInt(32, 0, true)));
+            return Builder->CreateNot(val, "lnot");
         }
         
         default:
@@ -523,12 +1089,362 @@ Value* CodeGenerator::gen(const AST::UnaryOperator& expr)
     return val;
 }
 
-Value* CodeGenerator::gen(const AST::ImplicitCastExpr& expr)
+Value* CodeGenerator::visitImplicitCastExpr(const AST::ImplicitCastExpr& expr)
 {
-    Value* val = expr.subExpr->genCode(*this);
-    if (expr.castKind == "LValueToRValue")
+    return emitCast(expr.castKind, visit(expr.subExpr));
+}
+
+Value* CodeGenerator::emitCast(StringRef castKind, Value* val)
+{
+    if (!val)
     {
-        return Builder->CreateLoad(val);
+        return nullptr;
+    }
+    if (castKind == "LValueToRValue")
+    {
+        return loadVar(val);
+    }
+    if (castKind == "IntegralToBoolean")
+    {
+        return Builder->CreateICmpNE(val, ConstantInt::get(TheContext, APInt(32, 0)), "tobool");
+    }
+    if (castKind == "IntegralCast")
+    {
+        return Builder->CreateZExt(val, Type::getInt32Ty(TheContext), "conv");
     }
     return val;
 }
+
+bool CodeGenerator::optimize(OptimizationLevel level, StringRef pipeline)
+{
+    if (!errors.empty() || (level == OptimizationLevel::O0 && pipeline.empty()))
+    {
+        return true;
+    }
+    // the passes assume valid IR; emitFunction has reported what is wrong
+    if (verifyModule(*TheModule))
+    {
+        return true;
+    }
+
+    LoopAnalysisManager LAM;
+    FunctionAnalysisManager FAM;
+    CGSCCAnalysisManager CGAM;
+    ModuleAnalysisManager MAM;
+    // the vectorizers are off unless asked for; opt and clang ask from -O2 on
+    PipelineTuningOptions PTO;
+    PTO.LoopVectorization = level.getSpeedupLevel() > 1 && level.getSizeLevel() < 2;
+    PTO.SLPVectorization = PTO.LoopVectorization;
+    PassBuilder PB(TM.get(), PTO);
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+    ModulePassManager MPM;
+    if (!pipeline.empty())
+    {
+        if (Error err = PB.parsePassPipeline(MPM, pipeline))
+        {
+            std::cerr << "Invalid pass pipeline: " << toString(std::move(err)) << std::endl;
+            return false;
+        }
+    }
+    else
+    {
+        MPM = PB.buildPerModuleDefaultPipeline(level);
+    }
+    MPM.run(*TheModule, MAM);
+    return true;
+}
+
+bool CodeGenerator::setTarget(StringRef cpu, StringRef features, OptimizationLevel level)
+{
+    TM = createTargetMachine(cpu, features, level);
+    if (!TM)
+    {
+        return false;
+    }
+    TheModule->setTargetTriple(TM->getTargetTriple().str());
+    TheModule->setDataLayout(TM->createDataLayout());
+    return true;
+}
+
+unique_ptr<TargetMachine> CodeGenerator::createTargetMachine(StringRef cpu, StringRef features, OptimizationLevel level)
+{
+    static bool initialized = [] {
+        InitializeNativeTarget();
+        InitializeNativeTargetAsmPrinter();
+        return true;
+    }();
+    (void)initialized;
+
+    std::string triple = sys::getDefaultTargetTriple();
+    std::string error;
+    const Target* target = TargetRegistry::lookupTarget(triple, error);
+    if (!target)
+    {
+        std::cerr << "Can't generate code for " << triple << ": " << error << std::endl;
+        return nullptr;
+    }
+    std::string cpuName = cpu.str();
+    std::string featureString = features.str();
+    if (cpu == "native")
+    {
+        cpuName = sys::getHostCPUName().str();
+        StringMap<bool> hostFeatures;
+        if (sys::getHostCPUFeatures(hostFeatures))
+        {
+            SubtargetFeatures enabled;
+            for (const auto& feature : hostFeatures)
+            {
+                enabled.AddFeature(feature.first(), feature.second);
+            }
+            // what -mattr says comes last and wins
+            featureString = features.empty() ? enabled.getString() : enabled.getString() + "," + featureString;
+        }
+    }
+    unique_ptr<MCSubtargetInfo> subtargets(target->createMCSubtargetInfo(triple, "", ""));
+    if (!subtargets->isCPUStringValid(cpuName))
+    {
+        std::cerr << "Unknown CPU " << cpuName << " for " << triple << std::endl;
+        return nullptr;
+    }
+    // position independent, as the system compiler links executables as PIE
+    return unique_ptr<TargetMachine>(target->createTargetMachine(triple, cpuName, featureString, TargetOptions(),
+        Reloc::PIC_, None, getCodeGenOptLevel(level)));
+}
+
+CodeGenOpt::Level CodeGenerator::getCodeGenOptLevel(OptimizationLevel level)
+{
+    if (level == OptimizationLevel::O0)
+    {
+        return CodeGenOpt::None;
+    }
+    if (level == OptimizationLevel::O1)
+    {
+        return CodeGenOpt::Less;
+    }
+    if (level == OptimizationLevel::O3)
+    {
+        return CodeGenOpt::Aggressive;
+    }
+    return CodeGenOpt::Default;
+}
+
+bool CodeGenerator::emitFile(const char* path, CodeGenFileType type)
+{
+    if (!errors.empty())
+    {
+        print(path);
+        return true;
+    }
+    // emitFunction has reported what is wrong
+    if (verifyModule(*TheModule))
+    {
+        std::cerr << "Can't generate code for invalid IR" << std::endl;
+        return false;
+    }
+    std::error_code EC;
+    raw_fd_ostream out(path, EC, type == CGFT_AssemblyFile ? sys::fs::OF_Text : sys::fs::OF_None);
+    if (EC)
+    {
+        std::cerr << "Failed open file " << path << ": " << EC.message() << std::endl;
+        return false;
+    }
+    // the code generator still runs on the legacy pass manager
+    legacy::PassManager PM;
+    if (TM->addPassesToEmitFile(PM, out, nullptr, type))
+    {
+        std::cerr << "The target can't emit this kind of file" << std::endl;
+        return false;
+    }
+    PM.run(*TheModule);
+    return true;
+}
+
+bool CodeGenerator::printBitcode(const char* path)
+{
+    if (!errors.empty())
+    {
+        print(path);
+        return true;
+    }
+    std::error_code EC;
+    raw_fd_ostream out(path, EC, sys::fs::OF_None);
+    if (EC)
+    {
+        std::cerr << "Failed open file " << path << ": " << EC.message() << std::endl;
+        return false;
+    }
+    WriteBitcodeToFile(*TheModule, out);
+    return true;
+}
+
+void CodeGenerator::gen(const CompactAST& ast)
+{
+    compactValues.assign(ast.size(), nullptr);
+    genCompact(ast, ast.getRoot());
+}
+
+Value* CodeGenerator::genCompact(const CompactAST& ast, NodeIndex n)
+{
+    using Kind = CompactAST::Kind;
+    if (n == NoNode)
+    {
+        return nullptr;
+    }
+    switch (ast.getKind(n))
+    {
+        case Kind::TranslationUnitDecl:
+        case Kind::DeclStmt:
+            for (NodeIndex decl : ast.getList(n))
+            {
+                genCompact(ast, decl);
+            }
+            return nullptr;
+        case Kind::VarDecl:
+        {
+            NodeIndex init = ast.getFirst(n);
+            auto genInit = [&] { return genCompact(ast, init); };
+            return emitVarDecl(ast.getName(n), ast.isFileScope(n), ast.isInvalid(n), compactValues[n],
+                init != NoNode ? function_ref<Value*()>(genInit) : nullptr);
+        }
+        case Kind::ParmVarDecl:
+            // emitted along with their function
+            return nullptr;
+        case Kind::FunctionDecl:
+        {
+            ArrayRef<NodeIndex> list = ast.getList(n);
+            NodeIndex body = list.front();
+            SmallVector<StringRef, 4> paraNames;
+            for (NodeIndex para : list.drop_front())
+            {
+                paraNames.push_back(ast.getName(para));
+            }
+            auto genBody = [&] { genCompact(ast, body); };
+            emitFunction(ast.getType(n), ast.getName(n), paraNames, compactValues[n],
+                [&](size_t i) -> Value*& { return compactValues[list[i + 1]]; },
+                body != NoNode ? function_ref<void()>(genBody) : nullptr);
+            return nullptr;
+        }
+        case Kind::NullStmt:
+            return nullptr;
+        case Kind::ValueStmt:
+            return genCompact(ast, ast.getFirst(n));
+        case Kind::ParenExpr:
+        {
+            NodeIndex inner = n;
+            while (inner != NoNode && ast.getKind(inner) == Kind::ParenExpr)
+            {
+                inner = ast.getFirst(inner);
+            }
+            return genCompact(ast, inner);
+        }
+        case Kind::IfStmt:
+        {
+            NodeIndex elseBody = ast.getElse(n);
+            auto genElse = [&] { genCompact(ast, elseBody); };
+            return emitIf([&](BasicBlock* trueBB, BasicBlock* falseBB) { return genCompactCondBr(ast, ast.getFirst(n), trueBB, falseBB); },
+                [&] { genCompact(ast, ast.getSecond(n)); },
+                elseBody != NoNode ? function_ref<void()>(genElse) : nullptr);
+        }
+        case Kind::WhileStmt:
+            return emitWhile([&](BasicBlock* trueBB, BasicBlock* falseBB) { return genCompactCondBr(ast, ast.getFirst(n), trueBB, falseBB); },
+                [&] { genCompact(ast, ast.getSecond(n)); });
+        case Kind::CompoundStmt:
+        {
+            ArrayRef<NodeIndex> body = ast.getList(n);
+            return emitCompound(body.size(), [&](size_t i) { return genCompact(ast, body[i]); });
+        }
+        case Kind::ReturnStmt:
+        {
+            NodeIndex value = ast.getFirst(n);
+            auto genValue = [&] { return genCompact(ast, value); };
+            return emitReturn(value != NoNode ? function_ref<Value*()>(genValue) : nullptr);
+        }
+        case Kind::IntegerLiteral:
+            return emitIntegerLiteral(ast.getValue(n));
+        case Kind::DeclRefExpr:
+            return emitDeclRef(ast.getName(n), getCompactVar(ast, ast.getDecl(n)));
+        case Kind::BinaryOperator:
+        {
+            BinaryOperatorKind op = ast.getBinaryOpcode(n);
+            NodeIndex LHS = ast.getFirst(n);
+            if (AST::BinaryOperator::isAssignmentOp(op))
+            {
+                if (ast.getKind(LHS) != Kind::DeclRefExpr)
+                {
+                    return logErrorV("Required lvalue at left of assignment.");
+                }
+                Value* Val = genCompact(ast, ast.getSecond(n));
+                return emitAssignment(op, ast.getName(LHS), getCompactVar(ast, ast.getDecl(LHS)), Val);
+            }
+            if (AST::BinaryOperator::isLogicalOp(op) && Builder->GetInsertBlock())
+            {
+                return emitLogicalOperator(op,
+                    [&](BasicBlock* trueBB, BasicBlock* falseBB) { return genCompactCondBr(ast, LHS, trueBB, falseBB); },
+                    [&] { return genCompact(ast, ast.getSecond(n)); });
+            }
+            // a left-leaning chain in a loop, as visitBinaryOperator does
+            SmallVector<NodeIndex, 8> chain{ n };
+            while (true)
+            {
+                while (LHS != NoNode && ast.getKind(LHS) == Kind::ParenExpr)
+                {
+                    LHS = ast.getFirst(LHS);
+                }
+                if (LHS == NoNode || ast.getKind(LHS) != Kind::BinaryOperator ||
+                    AST::BinaryOperator::isAssignmentOp(ast.getBinaryOpcode(LHS)) ||
+                    AST::BinaryOperator::isLogicalOp(ast.getBinaryOpcode(LHS)))
+                {
+                    break;
+                }
+                chain.push_back(LHS);
+                LHS = ast.getFirst(LHS);
+            }
+            Value* L = genCompact(ast, LHS);
+            for (NodeIndex link : llvm::reverse(chain))
+            {
+                Value* R = genCompact(ast, ast.getSecond(link));
+                L = L && R ? emitBinaryOperator(ast.getBinaryOpcode(link), L, R) : nullptr;
+            }
+            return L;
+        }
+        case Kind::UnaryOperator:
+            return emitUnaryOperator(ast.getUnaryOpcode(n), genCompact(ast, ast.getFirst(n)));
+        case Kind::CallExpr:
+        {
+            ArrayRef<NodeIndex> list = ast.getList(n);
+            NodeIndex callee = ast.getDecl(list.front());
+            Function* fun = callee != NoNode ? dyn_cast_or_null<Function>(compactValues[callee]) : nullptr;
+            return emitCall(fun, list.size() - 1,
+                [&](size_t i) { return genCompact(ast, list[i + 1]); });
+        }
+        case Kind::ImplicitCastExpr:
+            return emitCast(ast.getName(n), genCompact(ast, ast.getFirst(n)));
+    }
+    return nullptr;
+}
+
+Value* CodeGenerator::genCompactCondBr(const CompactAST& ast, NodeIndex cond, BasicBlock* trueBB, BasicBlock* falseBB)
+{
+    using Kind = CompactAST::Kind;
+    while (cond != NoNode && ast.getKind(cond) == Kind::ParenExpr)
+    {
+        cond = ast.getFirst(cond);
+    }
+    if (cond != NoNode && ast.getKind(cond) == Kind::BinaryOperator && AST::BinaryOperator::isLogicalOp(ast.getBinaryOpcode(cond)))
+    {
+        return emitLogicalBr(ast.getBinaryOpcode(cond),
+            [&](BasicBlock* T, BasicBlock* F) { return genCompactCondBr(ast, ast.getFirst(cond), T, F); },
+            [&](BasicBlock* T, BasicBlock* F) { return genCompactCondBr(ast, ast.getSecond(cond), T, F); }, trueBB, falseBB);
+    }
+    if (cond != NoNode && ast.getKind(cond) == Kind::UnaryOperator && ast.getUnaryOpcode(cond) == UnaryOperatorKind::UO_LNot)
+    {
+        return genCompactCondBr(ast, ast.getFirst(cond), falseBB, trueBB);
+    }
+    Value* CondV = genCompact(ast, cond);
+    return CondV ? Builder->CreateCondBr(CondV, trueBB, falseBB) : nullptr;
+}
@@ -1,7 +1,11 @@
 #pragma once
 #pragma warning(push, 0)
 #include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
@@ -11,27 +15,136 @@
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Passes/OptimizationLevel.h"
+#include "llvm/Support/CodeGen.h"
+#include "llvm/Target/TargetMachine.h"
 #pragma warning(pop)
-#include "Expr.h"
-#include "Stmt.h"
-#include "Decl.h"
+#include "ASTVisitor.h"
+#include "CompactAST.h"
 #include <iostream>
 #include <fstream>
 
 using namespace llvm;
 using std::shared_ptr;
+using std::unique_ptr;
 using namespace AST;
 
-class CodeGenerator : public CodeGeneratorBase
+class CodeGenerator : public ASTVisitor<CodeGenerator, Value*>
 {
-    LLVMContext TheContext;
+    /// Shared with the modules takeModule hands over.
+    orc::ThreadSafeContext TSContext{ std::make_unique<LLVMContext>() };
+    LLVMContext& TheContext = *TSContext.getContext();
     IRBuilder<>* Builder;
     unique_ptr<Module> TheModule;
-    std::map<std::string, AllocaInst*> NamedValues;
-    AllocaInst* CreateEntryBlockAlloca(Function* TheFunction, const std::string& VarName);
+    AllocaInst* CreateEntryBlockAlloca(Function* TheFunction, StringRef VarName);
     std::vector<std::string> errors;
     AllocaInst* retVal;
-    Value *getVar(const std::string& varName);
+    /// Whether a function body is being generated.
+    bool inBody = false;
+    /// The host target, once setTarget has chosen one.
+    unique_ptr<TargetMachine> TM;
+
+    /// Whether locals are SSA values instead of allocas, see setSSA.
+    bool ssa = false;
+    // SSA construction after Braun et al., "Simple and Efficient Construction
+    // of Static Single Assignment Form": a read looks for the value last
+    // assigned in its block and asks the predecessors when there is none,
+    // placing a phi where they may disagree. A block is sealed once all its
+    // predecessors exist; before that its phis are left incomplete.
+    /// The value of each variable at the end of each block, or so far. It
+    /// may be a phi found trivial since, see replacedPhis.
+    DenseMap<std::pair<BasicBlock*, Value*>, Value*> currentDef;
+    /// Trivial phis taken out of their blocks, and the value that replaced
+    /// each. They are deleted when the function is done.
+    DenseMap<PHINode*, Value*> replacedPhis;
+    DenseMap<BasicBlock*, SmallVector<std::pair<Value*, PHINode*>, 4>> incompletePhis;
+    SmallPtrSet<BasicBlock*, 16> sealedBlocks;
+    /// The only blocks a path can return to; elsewhere no phi is needed
+    /// to stop a read from going round a loop.
+    SmallPtrSet<BasicBlock*, 16> loopHeaders;
+    /// The allocas standing for the variables of the function being generated.
+    std::vector<AllocaInst*> ssaVars;
+
+    /// A local variable: an entry block alloca, or in SSA mode an alloca
+    /// outside of any function that only names the variable.
+    AllocaInst* createVariable(Function* TheFunction, StringRef name);
+    /// Reads or assigns a variable, global or local.
+    Value* loadVar(Value* var);
+    Value* storeVar(Value* var, Value* val);
+    Value* readVariable(Value* var, BasicBlock* BB);
+    /// val, or what replaced it if it is a removed phi.
+    Value* getReplacement(Value* val);
+    Value* readVariableRecursive(Value* var, BasicBlock* BB);
+    PHINode* createPhi(Value* var, BasicBlock* BB);
+    Value* addPhiOperands(Value* var, PHINode* phi);
+    /// Replaces a phi that merges only one value by that value.
+    Value* tryRemoveTrivialPhi(PHINode* phi);
+    /// Declares that all predecessors of BB have been emitted.
+    void sealBlock(BasicBlock* BB);
+    void finishSSAFunction();
+
+    // Storage of the variables and functions Sema numbered, indexed by slot.
+    std::vector<Value*> globals;
+    /// Parameters and locals of the function being generated.
+    std::vector<Value*> locals;
+    std::vector<Value*> functions;
+    /// The global and function slots an earlier module defined, see
+    /// takeModule. They are declared in this one when first used.
+    BitVector earlierGlobals;
+    BitVector earlierFunctions;
+    /// The CompactAST walk keeps the same by node index of the declaration.
+    std::vector<Value*> compactValues;
+
+    /// The storage of a variable, or null if it has none (yet).
+    Value*& getSlot(const VarDecl& var);
+    Value*& getSlot(const FunctionDecl& function);
+    /// What a name Sema bound to a variable refers to, or null.
+    Value* getVar(const AST::Decl* decl);
+    /// The function a callee Sema bound refers to, or null.
+    Function* getFunction(const FunctionDecl& function);
+    FunctionType* getFunctionType(StringRef returnType, size_t numParams);
+    Value* getCompactVar(const CompactAST& ast, NodeIndex decl);
+
+    // IR emission shared by the class tree and the CompactAST walk. Children
+    // are generated through the callbacks, so the order of instructions and
+    // errors does not depend on which form of the AST is walked.
+    Value* emitIntegerLiteral(int value);
+    /// var is null for a name that does not refer to a variable.
+    Value* emitDeclRef(StringRef name, Value* var);
+    Value* emitAssignment(BinaryOperatorKind op, StringRef varName, Value* Var, Value* Val);
+    Value* emitBinaryOperator(BinaryOperatorKind op, Value* L, Value* R);
+    /// Emits a branch to trueBB if a condition holds and to falseBB if not,
+    /// and returns it, or null after an error.
+    using CondBrGen = function_ref<Value*(BasicBlock* trueBB, BasicBlock* falseBB)>;
+    /// && or || as a condition: the left operand branches past the right one
+    /// once it decides, and neither is turned into a bool.
+    Value* emitLogicalBr(BinaryOperatorKind op, CondBrGen genLHS, CondBrGen genRHS, BasicBlock* trueBB, BasicBlock* falseBB);
+    /// && or || as a value, the phi of where the branches of the operands meet.
+    Value* emitLogicalOperator(BinaryOperatorKind op, CondBrGen genLHS, function_ref<Value*()> genRHS);
+    /// Puts BB at the end of the function being generated, before its return block.
+    void appendBlock(BasicBlock* BB);
+    Value* emitUnaryOperator(UnaryOperatorKind op, Value* val);
+    Value* emitCast(StringRef castKind, Value* val);
+    /// fun is null for a callee that does not name a function.
+    Value* emitCall(Function* fun, size_t numArgs, function_ref<Value*(size_t)> genArg);
+    /// genElse is null for an if without else.
+    Value* emitIf(CondBrGen genCondBr, function_ref<void()> genThen, function_ref<void()> genElse);
+    Value* emitWhile(CondBrGen genCondBr, function_ref<void()> genBody);
+    /// genValue is null for a return without a value.
+    Value* emitReturn(function_ref<Value*()> genValue);
+    Value* emitCompound(size_t numStmts, function_ref<Value*(size_t)> genStmt);
+    /// genInit is null for a declaration without initializer. slot receives
+    /// the storage of the variable unless it is an invalid redefinition.
+    Value* emitVarDecl(StringRef name, bool fileScope, bool invalid, Value*& slot, function_ref<Value*()> genInit);
+    /// genBody is null for a prototype. slot receives the function, and
+    /// paraSlot(i) the storage of parameter i.
+    Function* emitFunction(StringRef returnType, StringRef name, ArrayRef<StringRef> paraNames, Value*& slot,
+                           function_ref<Value*&(size_t)> paraSlot, function_ref<void()> genBody);
+
+    Value* genCompact(const CompactAST& ast, NodeIndex n);
+    /// A condition Sema converted to bool, as a branch; see CondBrGen.
+    Value* genCondBr(const Expr* cond, BasicBlock* trueBB, BasicBlock* falseBB);
+    Value* genCompactCondBr(const CompactAST& ast, NodeIndex cond, BasicBlock* trueBB, BasicBlock* falseBB);
 
 public:
     CodeGenerator()
@@ -44,6 +157,54 @@ public:
         errors.push_back(prompt);
         return nullptr;
     }
+    const Module& getModule() const
+    {
+        return *TheModule;
+    }
+    /// What went wrong, as print writes it after "#ERR".
+    const std::vector<std::string>& getErrors() const
+    {
+        return errors;
+    }
+    /// Hands the module over together with the context its types live in,
+    /// for the JIT to own, and starts an empty one for the same target with
+    /// no errors. Variables and functions the module defined are declared in
+    /// the next one where they are used, so that a program can be generated
+    /// a declaration at a time and linked by the JIT, as tcc --repl does.
+    orc::ThreadSafeModule takeModule();
+    /// Builds locals and return values as SSA values and phis while walking
+    /// the AST, rather than as allocas that mem2reg has to promote.
+    void setSSA(bool enable)
+    {
+        ssa = enable;
+    }
+    /// Leaves instructions, blocks and arguments unnamed; nobody reads the
+    /// names in an object file, and not making them saves time.
+    void discardValueNames()
+    {
+        TheContext.setDiscardValueNames(true);
+    }
+    /// Runs LLVM's default pipeline for level over the module, or the passes
+    /// of pipeline, in opt -passes= syntax, if it is not empty. Nothing runs
+    /// at O0 or on a module with errors. Returns false if pipeline does not
+    /// parse.
+    bool optimize(OptimizationLevel level, StringRef pipeline = "");
+    /// Targets the machine createTargetMachine makes of the arguments. The
+    /// module takes the data layout of the target, and optimize tunes its
+    /// passes for it. Call it before gen.
+    bool setTarget(StringRef cpu, StringRef features, OptimizationLevel level);
+    /// The host triple with cpu and features as -mcpu and -mattr spell them;
+    /// cpu "native" also means the features of the host. The code generator
+    /// runs at level. Null, after saying why, if LLVM can't generate code for
+    /// the host or does not know cpu.
+    static unique_ptr<TargetMachine> createTargetMachine(StringRef cpu, StringRef features, OptimizationLevel level);
+    /// The code generator level that goes with an -O level.
+    static CodeGenOpt::Level getCodeGenOptLevel(OptimizationLevel level);
+    /// Writes an object file or assembly for the target of setTarget. A
+    /// module with errors is written as print writes it.
+    bool emitFile(const char* path, CodeGenFileType type);
+    /// Writes the module as bitcode, or its errors as print does.
+    bool printBitcode(const char* path);
     void print(const char* path = "output.ll")
     {
         if (errors.empty())
@@ -70,17 +231,32 @@ public:
     }
 
 
-    // ͨ CodeGeneratorBase ̳
-    virtual Value* gen(const IntegerLiteral& expr) override;
-    virtual Value* gen(const DeclRefExpr& expr) override;
-    virtual Value* gen(const AST::BinaryOperator& expr) override;
-    virtual Value* gen(const CallExpr& expr) override;
-    virtual Value* gen(const AST::IfStmt& node) override;
-    virtual Value* gen(const AST::WhileStmt& node) override;
-    virtual Function* gen(const AST::FunctionDecl& decl) override;
-    virtual Value* gen(const AST::ReturnStmt& stmt) override;
-    virtual Value* gen(const AST::CompoundStmt& stmt) override;
-    virtual Value* gen(const AST::VarDecl& decl) override;
-    virtual Value* gen(const AST::UnaryOperator& expr) override;
-    virtual Value* gen(const AST::ImplicitCastExpr& expr) override;
+    // ͨ ASTVisitor ɣûгĽnullptr
+    Value* visitTranslationUnitDecl(const TranslationUnitDecl& decl);
+    Value* visitDeclStmt(const DeclStmt& stmt);
+    Value* visitValueStmt(const ValueStmt& stmt);
+    Value* visitParenExpr(const ParenExpr& expr);
+    Value* visitIntegerLiteral(const IntegerLiteral& expr);
+    Value* visitDeclRefExpr(const DeclRefExpr& expr);
+    Value* visitBinaryOperator(const AST::BinaryOperator& expr);
+    Value* visitCallExpr(const CallExpr& expr);
+    Value* visitIfStmt(const AST::IfStmt& node);
+    Value* visitWhileStmt(const AST::WhileStmt& node);
+    Value* visitFunctionDecl(const AST::FunctionDecl& decl);
+    Value* visitReturnStmt(const AST::ReturnStmt& stmt);
+    Value* visitCompoundStmt(const AST::CompoundStmt& stmt);
+    Value* visitVarDecl(const AST::VarDecl& decl);
+    Value* visitUnaryOperator(const AST::UnaryOperator& expr);
+    Value* visitImplicitCastExpr(const AST::ImplicitCastExpr& expr);
+
+    /// Generates the whole program from the class tree, which Sema must have
+    /// bound.
+    void gen(const Decl& root)
+    {
+        visit(&root);
+    }
+
+    /// Generates the whole program from its compact form, copied from a tree
+    /// Sema had bound.
+    void gen(const CompactAST& ast);
 };
\ No newline at end of file
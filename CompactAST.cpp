@@ -0,0 +1,421 @@
+/** @file CompactAST.cpp
+* @brief Building and dumping the structure-of-arrays AST
+**/
+
+#include <cassert>
+#include "CompactAST.h"
+
+#pragma warning(push, 0)
+#include "llvm/Support/JSON.h"
+#pragma warning(pop)
+
+using namespace AST;
+
+namespace
+{
+    template <typename T>
+    size_t capacityBytes(const std::vector<T>& vec)
+    {
+        return vec.capacity() * sizeof(T);
+    }
+
+    void writeJson(const CompactAST& ast, llvm::json::OStream& J, NodeIndex n)
+    {
+        using Kind = CompactAST::Kind;
+        if (n == NoNode)
+        {
+            J.value(nullptr);
+            return;
+        }
+        auto writeInner = [&](llvm::ArrayRef<NodeIndex> children) {
+            J.attributeArray("inner", [&] {
+                for (NodeIndex child : children)
+                {
+                    writeJson(ast, J, child);
+                }
+            });
+        };
+        J.objectBegin();
+        J.attribute("kind", ASTNode::getKindName(ast.getKind(n)));
+        switch (ast.getKind(n))
+        {
+            case Kind::TranslationUnitDecl:
+            case Kind::DeclStmt:
+            case Kind::CompoundStmt:
+                if (!ast.getList(n).empty())
+                {
+                    writeInner(ast.getList(n));
+                }
+                break;
+            case Kind::VarDecl:
+                J.attribute("name", ast.getName(n));
+                J.attribute("type", ast.getType(n));
+                J.attribute("hasInit", ast.getFirst(n) != NoNode);
+                if (ast.getFirst(n) != NoNode)
+                {
+                    writeInner(ast.getFirst(n));
+                }
+                break;
+            case Kind::ParmVarDecl:
+                J.attribute("name", ast.getName(n));
+                J.attribute("type", ast.getType(n));
+                J.attribute("hasDefault", false);
+                break;
+            case Kind::FunctionDecl:
+            {
+                llvm::ArrayRef<NodeIndex> list = ast.getList(n);
+                NodeIndex body = list.front();
+                llvm::ArrayRef<NodeIndex> params = list.drop_front();
+                std::string type = ast.getType(n).str() + "(";
+                for (size_t i = 0; i < params.size(); i++)
+                {
+                    if (i)
+                    {
+                        type += ", ";
+                    }
+                    type += ast.getType(params[i]);
+                }
+                type += ")";
+                J.attribute("name", ast.getName(n));
+                J.attribute("type", type);
+                if (body != NoNode || !params.empty())
+                {
+                    J.attributeArray("inner", [&] {
+                        for (NodeIndex param : params)
+                        {
+                            writeJson(ast, J, param);
+                        }
+                        if (body != NoNode)
+                        {
+                            writeJson(ast, J, body);
+                        }
+                    });
+                }
+                break;
+            }
+            case Kind::NullStmt:
+                break;
+            case Kind::ValueStmt:
+            case Kind::ParenExpr:
+                writeInner(ast.getFirst(n));
+                break;
+            case Kind::IfStmt:
+                // hasElse has always been written inverted; kept for compatibility
+                J.attribute("hasElse", ast.getElse(n) == NoNode);
+                if (ast.getElse(n) != NoNode)
+                {
+                    writeInner({ ast.getFirst(n), ast.getSecond(n), ast.getElse(n) });
+                }
+                else
+                {
+                    writeInner({ ast.getFirst(n), ast.getSecond(n) });
+                }
+                break;
+            case Kind::WhileStmt:
+                writeInner({ ast.getFirst(n), ast.getSecond(n) });
+                break;
+            case Kind::ReturnStmt:
+                if (ast.getFirst(n) != NoNode)
+                {
+                    writeInner(ast.getFirst(n));
+                }
+                break;
+            case Kind::IntegerLiteral:
+                J.attribute("type", "int");
+                J.attribute("value", std::to_string(ast.getValue(n)));
+                break;
+            case Kind::DeclRefExpr:
+                J.attribute("name", ast.getName(n));
+                break;
+            case Kind::BinaryOperator:
+                J.attribute("opcode", getOpcodeSpelling(ast.getBinaryOpcode(n)));
+                writeInner({ ast.getFirst(n), ast.getSecond(n) });
+                break;
+            case Kind::UnaryOperator:
+                J.attribute("opcode", getOpcodeSpelling(ast.getUnaryOpcode(n)));
+                writeInner(ast.getFirst(n));
+                break;
+            case Kind::CallExpr:
+                writeInner(ast.getList(n));
+                break;
+            case Kind::ImplicitCastExpr:
+                J.attribute("valueCategory", "rvalue");
+                J.attribute("castKind", ast.getName(n));
+                writeInner(ast.getFirst(n));
+                break;
+        }
+        J.objectEnd();
+    }
+}
+
+CompactAST::CompactAST(const Decl& root)
+{
+    CompactASTBuilder builder(*this);
+    builder.add(&root);
+    builder.resolveDecls();
+    kinds.shrink_to_fit();
+    ops.shrink_to_fit();
+    data.shrink_to_fit();
+    firsts.shrink_to_fit();
+    seconds.shrink_to_fit();
+    lists.shrink_to_fit();
+}
+
+size_t CompactAST::getMemorySize() const
+{
+    return capacityBytes(kinds) + capacityBytes(ops) + capacityBytes(data) + capacityBytes(firsts) +
+        capacityBytes(seconds) + capacityBytes(lists) + capacityBytes(types);
+}
+
+void CompactAST::dumpJson(llvm::raw_ostream& out) const
+{
+    llvm::json::OStream J(out, 4);
+    writeJson(*this, J, getRoot());
+}
+
+NodeIndex CompactASTBuilder::addNode(Kind kind, uint8_t op, uint32_t data)
+{
+    NodeIndex n = static_cast<NodeIndex>(ast.kinds.size());
+    ast.kinds.push_back(kind);
+    ast.ops.push_back(op);
+    ast.data.push_back(data);
+    ast.firsts.push_back(NoNode);
+    ast.seconds.push_back(NoNode);
+    return n;
+}
+
+size_t CompactASTBuilder::addList(NodeIndex n, size_t count)
+{
+    size_t begin = ast.lists.size();
+    ast.lists.resize(begin + count, NoNode);
+    ast.firsts[n] = static_cast<NodeIndex>(begin);
+    ast.seconds[n] = static_cast<NodeIndex>(count);
+    return begin;
+}
+
+uint8_t CompactASTBuilder::getTypeIndex(StringRef type)
+{
+    unsigned id = ast.names.get(type);
+    for (size_t i = 0; i < ast.types.size(); i++)
+    {
+        if (ast.types[i] == id)
+        {
+            return static_cast<uint8_t>(i);
+        }
+    }
+    assert(ast.types.size() <= UINT8_MAX && "too many distinct type names");
+    ast.types.push_back(id);
+    return static_cast<uint8_t>(ast.types.size() - 1);
+}
+
+NodeIndex CompactASTBuilder::add(const ASTNode* node)
+{
+    return node ? visit(node) : NoNode;
+}
+
+void CompactASTBuilder::resolveDecls()
+{
+    for (const auto& ref : declRefs)
+    {
+        auto it = declNodes.find(ref.second);
+        ast.firsts[ref.first] = it != declNodes.end() ? it->second : NoNode;
+    }
+    declRefs.clear();
+}
+
+NodeIndex CompactASTBuilder::visitTranslationUnitDecl(const TranslationUnitDecl& decl)
+{
+    NodeIndex n = addNode(Kind::TranslationUnitDecl);
+    size_t list = addList(n, decl.getDecls().size());
+    for (size_t i = 0; i < decl.getDecls().size(); i++)
+    {
+        NodeIndex child = add(decl.getDecls()[i]);
+        ast.lists[list + i] = child;
+    }
+    return n;
+}
+
+NodeIndex CompactASTBuilder::visitVarDecl(const VarDecl& decl)
+{
+    NodeIndex n = addNode(Kind::VarDecl, getTypeIndex(decl.getType()), ast.names.get(decl.getName()));
+    declNodes[&decl] = n;
+    NodeIndex init = add(decl.getInit());
+    ast.firsts[n] = init;
+    ast.seconds[n] = (decl.isFileScope() ? static_cast<NodeIndex>(CompactAST::FileScope) : 0) |
+        (decl.isInvalid() ? static_cast<NodeIndex>(CompactAST::Invalid) : 0);
+    return n;
+}
+
+NodeIndex CompactASTBuilder::visitParmVarDecl(const ParmVarDecl& decl)
+{
+    NodeIndex n = addNode(Kind::ParmVarDecl, getTypeIndex(decl.getType()), ast.names.get(decl.getName()));
+    declNodes[&decl] = n;
+    return n;
+}
+
+NodeIndex CompactASTBuilder::visitFunctionDecl(const FunctionDecl& decl)
+{
+    NodeIndex n = addNode(Kind::FunctionDecl, getTypeIndex(decl.getReturnType()), ast.names.get(decl.getName()));
+    declNodes[&decl] = n;
+    size_t list = addList(n, decl.getParams().size() + 1);
+    NodeIndex body = add(decl.getBody());
+    ast.lists[list] = body;
+    for (size_t i = 0; i < decl.getParams().size(); i++)
+    {
+        NodeIndex param = add(decl.getParams()[i]);
+        ast.lists[list + 1 + i] = param;
+    }
+    return n;
+}
+
+NodeIndex CompactASTBuilder::visitNullStmt(const NullStmt&)
+{
+    return addNode(Kind::NullStmt);
+}
+
+NodeIndex CompactASTBuilder::visitValueStmt(const ValueStmt& stmt)
+{
+    NodeIndex n = addNode(Kind::ValueStmt);
+    NodeIndex expr = add(stmt.getExpr());
+    ast.firsts[n] = expr;
+    return n;
+}
+
+NodeIndex CompactASTBuilder::visitIfStmt(const IfStmt& stmt)
+{
+    NodeIndex n = addNode(Kind::IfStmt);
+    NodeIndex cond = add(stmt.getCond());
+    NodeIndex body = add(stmt.getThen());
+    NodeIndex elseBody = add(stmt.getElse());
+    ast.firsts[n] = cond;
+    ast.seconds[n] = body;
+    ast.data[n] = elseBody;
+    return n;
+}
+
+NodeIndex CompactASTBuilder::visitWhileStmt(const WhileStmt& stmt)
+{
+    NodeIndex n = addNode(Kind::WhileStmt);
+    NodeIndex cond = add(stmt.getCond());
+    NodeIndex body = add(stmt.getBody());
+    ast.firsts[n] = cond;
+    ast.seconds[n] = body;
+    return n;
+}
+
+NodeIndex CompactASTBuilder::visitDeclStmt(const DeclStmt& stmt)
+{
+    NodeIndex n = addNode(Kind::DeclStmt);
+    size_t list = addList(n, stmt.getDecls().size());
+    for (size_t i = 0; i < stmt.getDecls().size(); i++)
+    {
+        NodeIndex child = add(stmt.getDecls()[i]);
+        ast.lists[list + i] = child;
+    }
+    return n;
+}
+
+NodeIndex CompactASTBuilder::visitCompoundStmt(const CompoundStmt& stmt)
+{
+    NodeIndex n = addNode(Kind::CompoundStmt);
+    size_t list = addList(n, stmt.body.size());
+    for (size_t i = 0; i < stmt.body.size(); i++)
+    {
+        NodeIndex child = add(stmt.body[i]);
+        ast.lists[list + i] = child;
+    }
+    return n;
+}
+
+NodeIndex CompactASTBuilder::visitReturnStmt(const ReturnStmt& stmt)
+{
+    NodeIndex n = addNode(Kind::ReturnStmt);
+    NodeIndex value = add(stmt.getRetValue());
+    ast.firsts[n] = value;
+    return n;
+}
+
+NodeIndex CompactASTBuilder::visitIntegerLiteral(const IntegerLiteral& expr)
+{
+    return addNode(Kind::IntegerLiteral, 0, static_cast<uint32_t>(expr.getValue()));
+}
+
+NodeIndex CompactASTBuilder::visitDeclRefExpr(const DeclRefExpr& expr)
+{
+    NodeIndex n = addNode(Kind::DeclRefExpr, 0, ast.names.get(expr.getName()));
+    if (expr.getDecl())
+    {
+        // parameters are added after the body that uses them
+        declRefs.emplace_back(n, expr.getDecl());
+    }
+    return n;
+}
+
+NodeIndex CompactASTBuilder::visitBinaryOperator(const BinaryOperator& expr)
+{
+    // The operators of a left-leaning chain are added in a loop, each before
+    // its operands as recursion would, so that a+a+...+a of any length fits
+    // on the stack.
+    SmallVector<std::pair<NodeIndex, const BinaryOperator*>, 8> chain;
+    const Expr* inner = &expr;
+    while (auto* op = dyn_cast_or_null<BinaryOperator>(inner))
+    {
+        chain.emplace_back(addNode(Kind::BinaryOperator, static_cast<uint8_t>(op->getOpKind())), op);
+        inner = op->getLHS();
+    }
+    NodeIndex LHS = add(inner);
+    for (const auto& link : llvm::reverse(chain))
+    {
+        ast.firsts[link.first] = LHS;
+        ast.seconds[link.first] = add(link.second->getRHS());
+        LHS = link.first;
+    }
+    return LHS;
+}
+
+NodeIndex CompactASTBuilder::visitUnaryOperator(const UnaryOperator& expr)
+{
+    NodeIndex n = addNode(Kind::UnaryOperator, static_cast<uint8_t>(expr.getOpKind()));
+    NodeIndex body = add(expr.getSubExpr());
+    ast.firsts[n] = body;
+    return n;
+}
+
+NodeIndex CompactASTBuilder::visitParenExpr(const ParenExpr& expr)
+{
+    // nested parentheses in a loop, outermost first
+    NodeIndex n = addNode(Kind::ParenExpr);
+    NodeIndex outer = n;
+    const Expr* inner = expr.getSubExpr();
+    while (auto* paren = dyn_cast_or_null<ParenExpr>(inner))
+    {
+        NodeIndex next = addNode(Kind::ParenExpr);
+        ast.firsts[outer] = next;
+        outer = next;
+        inner = paren->getSubExpr();
+    }
+    ast.firsts[outer] = add(inner);
+    return n;
+}
+
+NodeIndex CompactASTBuilder::visitCallExpr(const CallExpr& expr)
+{
+    NodeIndex n = addNode(Kind::CallExpr);
+    size_t list = addList(n, expr.getArgs().size() + 1);
+    NodeIndex callee = add(expr.getCallee());
+    ast.lists[list] = callee;
+    for (size_t i = 0; i < expr.getArgs().size(); i++)
+    {
+        NodeIndex arg = add(expr.getArgs()[i]);
+        ast.lists[list + 1 + i] = arg;
+    }
+    return n;
+}
+
+NodeIndex CompactASTBuilder::visitImplicitCastExpr(const ImplicitCastExpr& expr)
+{
+    NodeIndex n = addNode(Kind::ImplicitCastExpr, 0, ast.names.get(expr.getCastKind()));
+    NodeIndex subExpr = add(expr.getSubExpr());
+    ast.firsts[n] = subExpr;
+    return n;
+}
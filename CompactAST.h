@@ -0,0 +1,204 @@
+/** @file CompactAST.h
+* @brief Structure-of-arrays copy of the AST for whole-program passes
+**/
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "IdentifierTable.h"
+#include "ASTVisitor.h"
+
+#pragma warning(push, 0)
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/raw_ostream.h"
+#pragma warning(pop)
+
+namespace AST
+{
+    class CompactASTBuilder;
+
+    /// Index of a node in a CompactAST.
+    using NodeIndex = uint32_t;
+    /// Stands for a missing child, such as the else of an if without one.
+    constexpr NodeIndex NoNode = UINT32_MAX;
+
+    /**
+     * @brief The AST flattened into parallel arrays with one entry per node,
+     * in pre-order so that a walk moves forward through memory. Children are
+     * 32-bit indices instead of pointers, and nothing is dispatched virtually.
+     *
+     * Each node has a kind, an 8-bit op, a 32-bit data word and two child
+     * words, used as follows (blank means unused):
+     *
+     *     kind                 op       data       first    second
+     *     TranslationUnitDecl                      list     list size
+     *     VarDecl              type     name       init     flags
+     *     ParmVarDecl          type     name
+     *     FunctionDecl         type     name       list     list size   (body, params...)
+     *     NullStmt
+     *     ValueStmt                                expr
+     *     IfStmt                        else       cond     then
+     *     WhileStmt                                cond     body
+     *     DeclStmt                                 list     list size
+     *     CompoundStmt                             list     list size
+     *     ReturnStmt                               value
+     *     IntegerLiteral                value
+     *     DeclRefExpr                   name       decl
+     *     BinaryOperator       opcode              LHS      RHS
+     *     UnaryOperator        opcode              operand
+     *     ParenExpr                                subExpr
+     *     CallExpr                                 list     list size   (callee, args...)
+     *     ImplicitCastExpr              cast kind  subExpr
+     *
+     * A list is a run of child indices in one array shared by all nodes.
+     * Missing children, including those a parse error left out, are NoNode.
+     * The decl of a DeclRefExpr is the node Sema bound it to, or NoNode, and
+     * the flags of a VarDecl hold the rest of what Sema found out.
+    */
+    class CompactAST
+    {
+    public:
+        /// The same kinds as the class tree, in the order of ASTNodes.def.
+        using Kind = ASTNode::Kind;
+        /// Flags of a VarDecl.
+        enum : uint32_t
+        {
+            FileScope = 1,
+            Invalid = 2,
+        };
+
+    private:
+        friend CompactASTBuilder;
+        std::vector<Kind> kinds;
+        std::vector<uint8_t> ops;
+        std::vector<uint32_t> data;
+        std::vector<NodeIndex> firsts;
+        std::vector<NodeIndex> seconds;
+        std::vector<NodeIndex> lists;
+        /// Names, type names and cast kinds.
+        IdentifierTable names;
+        /// Type name ids, indexed by the op of a declaration.
+        std::vector<unsigned> types;
+
+    public:
+        /// Copies the tree under root, which is usually a TranslationUnitDecl.
+        explicit CompactAST(const Decl& root);
+
+        NodeIndex getRoot() const
+        {
+            return 0;
+        }
+        size_t size() const
+        {
+            return kinds.size();
+        }
+        Kind getKind(NodeIndex n) const
+        {
+            return kinds[n];
+        }
+        NodeIndex getFirst(NodeIndex n) const
+        {
+            return firsts[n];
+        }
+        NodeIndex getSecond(NodeIndex n) const
+        {
+            return seconds[n];
+        }
+        /// The children of a node whose first and second describe a list.
+        llvm::ArrayRef<NodeIndex> getList(NodeIndex n) const
+        {
+            return llvm::makeArrayRef(lists).slice(firsts[n], seconds[n]);
+        }
+        int getValue(NodeIndex n) const
+        {
+            return static_cast<int>(data[n]);
+        }
+        /// The name of a declaration or DeclRefExpr, or the kind of a cast.
+        StringRef getName(NodeIndex n) const
+        {
+            return names.getName(data[n]);
+        }
+        StringRef getType(NodeIndex n) const
+        {
+            return names.getName(types[ops[n]]);
+        }
+        BinaryOperatorKind getBinaryOpcode(NodeIndex n) const
+        {
+            return static_cast<BinaryOperatorKind>(ops[n]);
+        }
+        UnaryOperatorKind getUnaryOpcode(NodeIndex n) const
+        {
+            return static_cast<UnaryOperatorKind>(ops[n]);
+        }
+        /// The declaration a DeclRefExpr refers to, or NoNode.
+        NodeIndex getDecl(NodeIndex n) const
+        {
+            return firsts[n];
+        }
+        bool isFileScope(NodeIndex n) const
+        {
+            return seconds[n] & FileScope;
+        }
+        bool isInvalid(NodeIndex n) const
+        {
+            return seconds[n] & Invalid;
+        }
+        /// The else branch of an IfStmt, or NoNode.
+        NodeIndex getElse(NodeIndex n) const
+        {
+            return data[n];
+        }
+
+        /// Bytes held by the node and list arrays, not counting the names.
+        size_t getMemorySize() const;
+
+        /// Writes the same JSON as toJson().dump(4) on the original tree.
+        void dumpJson(llvm::raw_ostream& out) const;
+    };
+
+    /**
+     * @brief Appends class-tree nodes to a CompactAST, visiting each node
+     * before its children.
+    */
+    class CompactASTBuilder : public ASTVisitor<CompactASTBuilder, NodeIndex>
+    {
+        using Kind = CompactAST::Kind;
+        CompactAST& ast;
+        /// Where each declaration went, for the DeclRefExprs bound to it.
+        llvm::DenseMap<const Decl*, NodeIndex> declNodes;
+        std::vector<std::pair<NodeIndex, const Decl*>> declRefs;
+
+        NodeIndex addNode(Kind kind, uint8_t op = 0, uint32_t data = 0);
+        /// Reserves a list of count children for n and returns where it starts.
+        size_t addList(NodeIndex n, size_t count);
+        uint8_t getTypeIndex(StringRef type);
+
+    public:
+        CompactASTBuilder(CompactAST& ast) : ast(ast) {}
+
+        /// Adds node and everything under it; a null node becomes NoNode.
+        NodeIndex add(const ASTNode* node);
+        /// Fills in the decl of every DeclRefExpr once all declarations are added.
+        void resolveDecls();
+
+        NodeIndex visitTranslationUnitDecl(const TranslationUnitDecl& decl);
+        NodeIndex visitVarDecl(const VarDecl& decl);
+        NodeIndex visitParmVarDecl(const ParmVarDecl& decl);
+        NodeIndex visitFunctionDecl(const FunctionDecl& decl);
+        NodeIndex visitNullStmt(const NullStmt& stmt);
+        NodeIndex visitValueStmt(const ValueStmt& stmt);
+        NodeIndex visitIfStmt(const IfStmt& stmt);
+        NodeIndex visitWhileStmt(const WhileStmt& stmt);
+        NodeIndex visitDeclStmt(const DeclStmt& stmt);
+        NodeIndex visitCompoundStmt(const CompoundStmt& stmt);
+        NodeIndex visitReturnStmt(const ReturnStmt& stmt);
+        NodeIndex visitIntegerLiteral(const IntegerLiteral& expr);
+        NodeIndex visitDeclRefExpr(const DeclRefExpr& expr);
+        NodeIndex visitBinaryOperator(const BinaryOperator& expr);
+        NodeIndex visitUnaryOperator(const UnaryOperator& expr);
+        NodeIndex visitParenExpr(const ParenExpr& expr);
+        NodeIndex visitCallExpr(const CallExpr& expr);
+        NodeIndex visitImplicitCastExpr(const ImplicitCastExpr& expr);
+    };
+}; // namespace AST
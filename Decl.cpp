@@ -24,15 +24,6 @@ json TranslationUnitDecl::toJson() const
     return res;
 }
 
-Value* AST::TranslationUnitDecl::genCode(CodeGeneratorBase& generator) const
-{
-    for (const auto& decl : decls)
-    {
-        decl->genCode(generator);
-    }
-    return nullptr;
-}
-
 json VarDecl::toJson() const
 {
     json res={
@@ -48,11 +39,6 @@ json VarDecl::toJson() const
     return res;
 }
 
-Value* AST::VarDecl::genCode(CodeGeneratorBase& generator) const
-{
-    return generator.gen(*this);
-}
-
 json ParmVarDecl::toJson() const
 {
     json res = {
@@ -3,9 +3,6 @@
 **/
 
 #pragma once
-#include <string>
-#include <memory>
-#include <vector>
 #include "Expr.h"
 #include "ASTNode.h"
 
@@ -15,6 +12,14 @@ namespace AST
 
     class Decl : public ASTNode
     {
+    protected:
+        Decl(Kind kind) : ASTNode(kind) {}
+
+    public:
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() >= Kind::firstDecl && node->getKind() <= Kind::lastDecl;
+        }
     };
 
     /**
@@ -22,16 +27,22 @@ namespace AST
 */
     class TranslationUnitDecl : public Decl
     {
-        std::vector<std::unique_ptr<Decl>> decls;
+        ArrayRef<Decl*> decls;
 
     public:
-        TranslationUnitDecl() = default;
-        TranslationUnitDecl(std::vector<std::unique_ptr<Decl>> &rhsDecls) : decls(std::move(rhsDecls)) {}
+        TranslationUnitDecl() : Decl(Kind::TranslationUnitDecl) {}
+        TranslationUnitDecl(ArrayRef<Decl*> decls) : Decl(Kind::TranslationUnitDecl), decls(decls) {}
+        ArrayRef<Decl*> getDecls() const
+        {
+            return decls;
+        }
 
-        virtual json toJson() const override;
+        json toJson() const;
 
-        // ͨ Decl ̳
-        virtual Value* genCode(CodeGeneratorBase& generator) const override;
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() == Kind::TranslationUnitDecl;
+        }
     };
 
     /**
@@ -43,29 +54,79 @@ namespace AST
 
     protected:
         friend class FunctionDecl;
-        std::string name;
-        std::string type;
+        StringRef name;
+        StringRef type;
         bool hasInit;
-        std::unique_ptr<Expr> initValue;
+        Expr* initValue;
+        /// Filled in by Sema, see setStorage.
+        bool fileScope = false;
+        bool invalid = false;
+        unsigned slot = 0;
+
+        VarDecl(Kind kind, StringRef type, StringRef name, bool hasInit, Expr* initValue)
+            : Decl(kind), type(type), name(name), hasInit(hasInit), initValue(initValue) {}
         
     public:
-        VarDecl() = default;
-        VarDecl(const std::string &type, const std::string &name, bool hasInit = false,
-                std::unique_ptr<Expr> initValue = nullptr) : type(type), name(name), hasInit(hasInit), initValue(std::move(initValue)){};
-        const std::string getName() const 
+        VarDecl(StringRef type, StringRef name, bool hasInit = false,
+                Expr* initValue = nullptr) : VarDecl(Kind::VarDecl, type, name, hasInit, initValue) {}
+        StringRef getName() const 
         {
             return name;
         }
-        virtual json toJson() const override;
+        StringRef getType() const
+        {
+            return type;
+        }
+        /// Null unless the declaration has an initializer.
+        Expr* getInit() const
+        {
+            return hasInit ? initValue : nullptr;
+        }
+        void setInit(Expr* E)
+        {
+            initValue = E;
+        }
+        /// Where codegen keeps the variable: slot numbers the globals of the
+        /// program, or the locals of the function the variable belongs to.
+        void setStorage(bool isFileScope, unsigned index)
+        {
+            fileScope = isFileScope;
+            slot = index;
+        }
+        bool isFileScope() const
+        {
+            return fileScope;
+        }
+        unsigned getSlot() const
+        {
+            return slot;
+        }
+        /// Set by Sema on a redefinition, which codegen then reports.
+        void setInvalid()
+        {
+            invalid = true;
+        }
+        bool isInvalid() const
+        {
+            return invalid;
+        }
+        json toJson() const;
 
-        // ͨ Decl ̳
-        virtual Value* genCode(CodeGeneratorBase& generator) const override;
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() >= Kind::firstVarDecl && node->getKind() <= Kind::lastVarDecl;
+        }
     };
 
     class ParmVarDecl : public VarDecl
     {
     public:
-        ParmVarDecl(const std::string &type, const std::string &name) : VarDecl(type, name) {}
-        virtual json toJson() const override;
+        ParmVarDecl(StringRef type, StringRef name) : VarDecl(Kind::ParmVarDecl, type, name, false, nullptr) {}
+        json toJson() const;
+
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() == Kind::ParmVarDecl;
+        }
     };
 }; // namespace AST
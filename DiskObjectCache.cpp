@@ -0,0 +1,125 @@
+/** @file DiskObjectCache.cpp
+* @brief Storing, loading and pruning cached objects
+**/
+
+#include <cassert>
+#include <chrono>
+#include "DiskObjectCache.h"
+
+#pragma warning(push, 0)
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
+#pragma warning(pop)
+
+#ifndef TOYCC_VERSION
+#define TOYCC_VERSION "unknown"
+#endif
+
+DiskObjectCache::DiskObjectCache(StringRef directory, uint64_t maxBytes) : directory(directory.str())
+{
+    // Stores are rare, one per compiled program, so every store prunes.
+    policy.Interval = std::chrono::seconds(0);
+    policy.Expiration = std::chrono::seconds(0);
+    // to pruneCache 0 means no limit
+    assert(maxBytes && "an empty cache is no cache");
+    policy.MaxSizeBytes = maxBytes;
+}
+
+/// Tells builds of the running compiler apart, or is empty if it can't. The
+/// project version is only bumped for releases, but every relink changes the
+/// size or the modification time of the executable.
+static std::string getCompilerBuild()
+{
+    std::string executable = sys::fs::getMainExecutable("", reinterpret_cast<void*>(&getCompilerBuild));
+    sys::fs::file_status status;
+    if (executable.empty() || sys::fs::status(executable, status))
+    {
+        return "";
+    }
+    return executable + ", " + std::to_string(status.getSize()) + " bytes, modified " +
+        std::to_string(status.getLastModificationTime().time_since_epoch().count());
+}
+
+std::string DiskObjectCache::computeKey(ArrayRef<StringRef> parts)
+{
+    static const std::string build = getCompilerBuild();
+    if (build.empty())
+    {
+        return "";
+    }
+    SHA1 hasher;
+    hasher.update("ToyCC " TOYCC_VERSION ", LLVM " LLVM_VERSION_STRING ", ");
+    hasher.update(build);
+    for (StringRef part : parts)
+    {
+        // the length keeps ("ab", "c") apart from ("a", "bc")
+        hasher.update(std::to_string(part.size()) + ":");
+        hasher.update(part);
+    }
+    return toHex(hasher.final(), true);
+}
+
+std::string DiskObjectCache::getPath(StringRef key) const
+{
+    SmallString<128> path(directory);
+    sys::path::append(path, "llvmcache-" + key);
+    return std::string(path);
+}
+
+std::unique_ptr<MemoryBuffer> DiskObjectCache::load(StringRef key)
+{
+    if (key.empty())
+    {
+        return nullptr;
+    }
+    std::string path = getPath(key);
+    auto object = MemoryBuffer::getFile(path, false, false);
+    if (!object)
+    {
+        return nullptr;
+    }
+    // pruneCache evicts by access time, which the file system may not keep up to date
+    int FD;
+    if (!sys::fs::openFileForWrite(path, FD, sys::fs::CD_OpenExisting, sys::fs::OF_Append))
+    {
+        sys::fs::setLastAccessAndModificationTime(FD, std::chrono::system_clock::now());
+        sys::fs::closeFile(FD);
+    }
+    return std::move(*object);
+}
+
+void DiskObjectCache::notifyObjectCompiled(const Module* M, MemoryBufferRef object)
+{
+    StringRef key = M->getModuleIdentifier();
+    if (key.empty() || sys::fs::create_directories(directory))
+    {
+        return;
+    }
+    SmallString<128> model(directory);
+    sys::path::append(model, "tcc-%%%%%%%%.tmp");
+    auto temp = sys::fs::TempFile::create(model);
+    if (!temp)
+    {
+        consumeError(temp.takeError());
+        return;
+    }
+    {
+        raw_fd_ostream out(temp->FD, false);
+        out << object.getBuffer();
+    }
+    if (Error err = temp->keep(getPath(key)))
+    {
+        consumeError(std::move(err));
+        return;
+    }
+    pruneCache(directory, policy);
+}
+
+std::unique_ptr<MemoryBuffer> DiskObjectCache::getObject(const Module* M)
+{
+    return load(M->getModuleIdentifier());
+}
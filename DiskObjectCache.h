@@ -0,0 +1,55 @@
+/** @file DiskObjectCache.h
+* @brief Keeps the objects the JIT compiles in a directory, evicting the least recently used
+**/
+
+#pragma once
+#include <memory>
+#include <string>
+
+#pragma warning(push, 0)
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/Support/CachePruning.h"
+#include "llvm/Support/MemoryBuffer.h"
+#pragma warning(pop)
+
+using namespace llvm;
+
+/**
+ * @brief A content-addressed ObjectCache on disk.
+ *
+ * The key of an object is a hash of everything its code depends on, see
+ * computeKey, and the JIT finds it as the identifier of the module it
+ * compiles. Since the key can be computed from the source text alone, a
+ * driver can look the object up with load before lexing anything.
+ *
+ * Objects are files named llvmcache-<key>, which is what pruneCache expects,
+ * written to a temporary file first so that concurrent runs never see half an
+ * object. A hit updates the access time of the file, so pruning after every
+ * store evicts the least recently used objects.
+*/
+class DiskObjectCache : public ObjectCache
+{
+    std::string directory;
+    CachePruningPolicy policy;
+
+    std::string getPath(StringRef key) const;
+
+public:
+    /// Objects live in directory, which is created on the first store, and
+    /// take up at most maxBytes of it, which must not be 0.
+    DiskObjectCache(StringRef directory, uint64_t maxBytes);
+
+    /// The key of an object compiled from parts, which should hold the source
+    /// and every option that changes the code; the versions of ToyCC and LLVM
+    /// and the build of the running executable are added here. Empty, which
+    /// nothing is cached under, if the executable can't be told apart from
+    /// other builds.
+    static std::string computeKey(ArrayRef<StringRef> parts);
+
+    /// The object stored under key, or null on a miss.
+    std::unique_ptr<MemoryBuffer> load(StringRef key);
+
+    // ObjectCache, keyed by the identifier of M. Modules without one are not cached.
+    void notifyObjectCompiled(const Module* M, MemoryBufferRef object) override;
+    std::unique_ptr<MemoryBuffer> getObject(const Module* M) override;
+};
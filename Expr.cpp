@@ -7,116 +7,48 @@
 #include <string>
 
 using namespace AST;
-/**
- * @brief ȡ˫ĿӦַ
- * @param op ö
- * @return std::string
-*/
-static std::string getBinOpcode(BinaryOperatorKind op)
+
+StringRef AST::getOpcodeSpelling(BinaryOperatorKind op)
 {
     switch (op)
     {
-        case BinaryOperatorKind::BO_Mul:
-            return "*";
-        case BinaryOperatorKind::BO_Div:
-            return "/";
-        case BinaryOperatorKind::BO_Rem:
-            return "%";
-        case BinaryOperatorKind::BO_Add:
-            return "+";
-        case BinaryOperatorKind::BO_Sub:
-            return "-";
-        case BinaryOperatorKind::BO_Shl:
-            return "<<";
-        case BinaryOperatorKind::BO_Shr:
-            return ">>";
-        case BinaryOperatorKind::BO_LT:
-            return "<";
-        case BinaryOperatorKind::BO_GT:
-            return ">";
-        case BinaryOperatorKind::BO_LE:
-            return "<=";
-        case BinaryOperatorKind::BO_GE:
-            return ">=";
-        case BinaryOperatorKind::BO_EQ:
-            return "==";
-        case BinaryOperatorKind::BO_NE:
-            return "!=";
-        case BinaryOperatorKind::BO_And:
-            return "&";
-        case BinaryOperatorKind::BO_Xor:
-            return "^";
-        case BinaryOperatorKind::BO_Or:
-            return "|";
-        case BinaryOperatorKind::BO_LAnd:
-            return "&&";
-        case BinaryOperatorKind::BO_LOr:
-            return "||";
-        case BinaryOperatorKind::BO_Assign:
-            return "=";
-        case BinaryOperatorKind::BO_MulAssign:
-            return "*=";
-        case BinaryOperatorKind::BO_DivAssign:
-            return "/=";
-        case BinaryOperatorKind::BO_RemAssign:
-            return "%=";
-        case BinaryOperatorKind::BO_AddAssign:
-            return "+=";
-        case BinaryOperatorKind::BO_SubAssign:
-            return "-=";
-        case BinaryOperatorKind::BO_ShlAssign:
-            return "<<=";
-        case BinaryOperatorKind::BO_ShrAssign:
-            return ">>=";
-        case BinaryOperatorKind::BO_AndAssign:
-            return "&=";
-        case BinaryOperatorKind::BO_XorAssign:
-            return "^=";
-        case BinaryOperatorKind::BO_OrAssign:
-            return "|=";
-        default:
-            return "";
+#define BINARY_OPERATION(Name, Spelling) \
+        case BinaryOperatorKind::BO_##Name: \
+            return Spelling;
+#include "OperationKinds.def"
     }
+    return "";
 }
 
-static std::string getUnaryOpcode(UnaryOperatorKind op)
+StringRef AST::getOpcodeSpelling(UnaryOperatorKind op)
 {
     switch (op)
     {
-        case AST::UnaryOperatorKind::UO_PostInc:
-        case AST::UnaryOperatorKind::UO_PreInc:
-            return "++";
-        case AST::UnaryOperatorKind::UO_PostDec:
-        case AST::UnaryOperatorKind::UO_PreDec:
-            return "--";
-        case AST::UnaryOperatorKind::UO_Plus:
-            return "+";
-        case AST::UnaryOperatorKind::UO_Minus:
-            return "-";
-        case AST::UnaryOperatorKind::UO_Not:
-            return "~";
-        case AST::UnaryOperatorKind::UO_LNot:
-            return "!";
-        default:
-            return "";
+#define UNARY_OPERATION(Name, Spelling) \
+        case UnaryOperatorKind::UO_##Name: \
+            return Spelling;
+#include "OperationKinds.def"
     }
+    return "";
 }
 
-AST::BinaryOperator::BinaryOperator(BinaryOperatorKind op, unique_ptr<Expr> LHS, unique_ptr<Expr> RHS) : op(op)
+AST::BinaryOperator::BinaryOperator(ASTContext& C, BinaryOperatorKind op, Expr* LHS, Expr* RHS, uint32_t opOffset)
+    : Expr(Kind::BinaryOperator), op(op), opOffset(opOffset)
 {
     if (!isAssignment() && LHS->getIsLvalue())
     {
-        LHS = std::make_unique<ImplicitCastExpr>(std::move(LHS), "LValueToRValue");
+        LHS = new (C) ImplicitCastExpr(LHS, "LValueToRValue");
     }
     if (RHS->getIsLvalue())
     {
-        RHS = std::make_unique<ImplicitCastExpr>(std::move(RHS), "LValueToRValue");
+        RHS = new (C) ImplicitCastExpr(RHS, "LValueToRValue");
     }
-    this->LHS = std::move(LHS);
-    this->RHS = std::move(RHS);
+    this->LHS = LHS;
+    this->RHS = RHS;
+    isConst = !isAssignment() && LHS->getIsConst() && RHS->getIsConst();
 }
 
-bool AST::BinaryOperator::isAssignment() const
+bool AST::BinaryOperator::isAssignmentOp(BinaryOperatorKind op)
 {
     switch (op)
     {
@@ -141,17 +73,12 @@ json AST::BinaryOperator::toJson() const
 {
     json res = {
         {"kind", "BinaryOperator"},
-        {"opcode", getBinOpcode(op)}
+        {"opcode", getOpcodeSpelling(op)}
     };
     res["inner"] = json::array({ LHS->toJson(), RHS->toJson() });
     return res;
 }
 
-Value* AST::BinaryOperator::genCode(CodeGeneratorBase& generator) const
-{
-    return generator.gen(*this);
-}
-
 json IntegerLiteral::toJson() const
 {
     return {
@@ -161,11 +88,6 @@ json IntegerLiteral::toJson() const
     };
 }
 
-Value* AST::IntegerLiteral::genCode(CodeGeneratorBase& generator) const
-{
-    return generator.gen(*this);
-}
-
 json DeclRefExpr::toJson() const
 {
     return {
@@ -174,16 +96,6 @@ json DeclRefExpr::toJson() const
     };
 }
 
-Value* AST::DeclRefExpr::genCode(CodeGeneratorBase& generator) const
-{
-    return generator.gen(*this);
-}
-
-Function* AST::DeclRefExpr::genFunc(CodeGeneratorBase& generator) const
-{
-    return nullptr;
-}
-
 json ParenExpr::toJson() const
 {
     return {
@@ -192,11 +104,6 @@ json ParenExpr::toJson() const
     };
 }
 
-Value* AST::ParenExpr::genCode(CodeGeneratorBase& generator) const
-{
-    return subExpr->genCode(generator);
-}
-
 json CallExpr::toJson() const
 {
     json res = {
@@ -210,26 +117,16 @@ json CallExpr::toJson() const
     return res;
 }
 
-Value* AST::CallExpr::genCode(CodeGeneratorBase& generator) const
-{
-    return generator.gen(*this);
-}
-
 json AST::UnaryOperator::toJson() const
 {
     json res = {
        {"kind", "UnaryOperator"},
-       {"opcode", getUnaryOpcode(op)}
+       {"opcode", getOpcodeSpelling(op)}
     };
     res["inner"] = json::array({ body->toJson()});
     return res;
 }
 
-Value* AST::UnaryOperator::genCode(CodeGeneratorBase& generator) const
-{
-    return generator.gen(*this);
-}
-
 json AST::ImplicitCastExpr::toJson() const
 {
     json res = {
@@ -240,8 +137,3 @@ json AST::ImplicitCastExpr::toJson() const
     res["inner"] = json::array({ subExpr->toJson() });
     return res;
 }
-
-Value* AST::ImplicitCastExpr::genCode(CodeGeneratorBase& generator) const
-{
-    return generator.gen(*this);
-}
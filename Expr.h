@@ -3,22 +3,20 @@
 **/
 
 #pragma once
-#include <string>
-#include <memory>
-#include <vector>
 #include "ASTNode.h"
+#include "ASTContext.h"
 
 class CodeGenerator;
 
-using std::unique_ptr;
-
 namespace AST
 {
+    class Decl;
+
     /**
     * 
     * @brief öͣ˫Ŀ
     */
-    enum class BinaryOperatorKind
+    enum class BinaryOperatorKind : uint8_t
     {
 #define BINARY_OPERATION(Name, Spelling) BO_##Name,
 #include "OperationKinds.def"
@@ -28,18 +26,41 @@ namespace AST
     *
     * @brief öͣĿ
     */
-    enum class UnaryOperatorKind
+    enum class UnaryOperatorKind : uint8_t
     {
 #define UNARY_OPERATION(Name, Spelling) UO_##Name,
 #include "OperationKinds.def"
     };
 
+    /// The operator as written, such as "<<=".
+    StringRef getOpcodeSpelling(BinaryOperatorKind op);
+    /// The operator as written; "++" for both PreInc and PostInc.
+    StringRef getOpcodeSpelling(UnaryOperatorKind op);
+
+    /**
+     * @brief The type Sema gives an expression. Variables, parameters and
+     * arithmetic are int; comparisons and logical operators yield bool.
+    */
+    enum class TypeKind : uint8_t
+    {
+        Int,
+        Bool,
+        Void,
+    };
+
     class Expr : public ASTNode
     {
     protected:
         bool isConst = false;
         bool isLvalue = false;
+        TypeKind type = TypeKind::Int;
+
+        Expr(Kind kind) : ASTNode(kind) {}
     public:
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() >= Kind::firstExpr && node->getKind() <= Kind::lastExpr;
+        }
         bool getIsConst() const
         {
             return isConst;
@@ -48,6 +69,15 @@ namespace AST
         {
             return isLvalue;
         }
+        /// Int until Sema has run.
+        TypeKind getType() const
+        {
+            return type;
+        }
+        void setType(TypeKind T)
+        {
+            type = T;
+        }
     };
 
     /**
@@ -60,22 +90,18 @@ namespace AST
         int value;
 
     public:
-        IntegerLiteral(int val) : value(val) { isConst = true; }
+        IntegerLiteral(int val) : Expr(Kind::IntegerLiteral), value(val) { isConst = true; }
         int getValue() const
         {
             return value;
         }
 
-        // ͨ Expr ̳
-        virtual json toJson() const override;
-
+        json toJson() const;
 
-        // ͨ Expr ̳
-        virtual Value* genCode(CodeGeneratorBase& generator) const override;
-        virtual Function* genFunc(CodeGeneratorBase& generator) const override 
+        static bool classof(const ASTNode* node)
         {
-            return nullptr;
-        };
+            return node->getKind() == Kind::IntegerLiteral;
+        }
     };
 
     // todo:FloatLiteral
@@ -86,22 +112,30 @@ namespace AST
 */
     class DeclRefExpr : public Expr
     {
-        std::string name;
+        StringRef name;
         bool isCall;
+        /// Filled in by Sema; null while unbound or if nothing is named so.
+        const Decl* decl = nullptr;
         // todo: type
     public:
-        DeclRefExpr(const std::string& name, bool isCall = false) : name(name), isCall(isCall) { isLvalue = !isCall; }
-        const std::string& getName() const {
+        DeclRefExpr(StringRef name, bool isCall = false) : Expr(Kind::DeclRefExpr), name(name), isCall(isCall) { isLvalue = !isCall; }
+        StringRef getName() const {
             return name;
         }
-        // ͨ Expr ̳
-        virtual json toJson() const override;
-
-        // ͨ Expr ̳
-        virtual Value* genCode(CodeGeneratorBase& generator) const override;
+        const Decl* getDecl() const
+        {
+            return decl;
+        }
+        void setDecl(const Decl* D)
+        {
+            decl = D;
+        }
+        json toJson() const;
 
-        // ͨ Expr ̳
-        virtual Function* genFunc(CodeGeneratorBase& generator) const override;
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() == Kind::DeclRefExpr;
+        }
     };
 
     /**
@@ -112,21 +146,55 @@ namespace AST
     class BinaryOperator : public Expr
     {
         BinaryOperatorKind op;
-        unique_ptr<Expr> LHS, RHS;
+        /// Byte offset of the operator in the source, for diagnostics.
+        uint32_t opOffset;
+        Expr* LHS, * RHS;
         friend CodeGenerator;
     public:
-        BinaryOperator(BinaryOperatorKind op, unique_ptr<Expr> LHS,
-            unique_ptr<Expr> RHS);
+        /// Operands that are lvalues get an LValueToRValue cast allocated in C.
+        BinaryOperator(ASTContext& C, BinaryOperatorKind op, Expr* LHS, Expr* RHS, uint32_t opOffset);
 
         BinaryOperatorKind getOpKind() const {
             return op;
         }
-        bool isAssignment() const;
+        uint32_t getOperatorOffset() const
+        {
+            return opOffset;
+        }
+        Expr* getLHS() const
+        {
+            return LHS;
+        }
+        Expr* getRHS() const
+        {
+            return RHS;
+        }
+        void setLHS(Expr* E)
+        {
+            LHS = E;
+        }
+        void setRHS(Expr* E)
+        {
+            RHS = E;
+        }
+        bool isAssignment() const
+        {
+            return isAssignmentOp(op);
+        }
+        static bool isAssignmentOp(BinaryOperatorKind op);
+        /// && and ||, whose right operand is only evaluated if the left one
+        /// does not decide the result.
+        static bool isLogicalOp(BinaryOperatorKind op)
+        {
+            return op == BinaryOperatorKind::BO_LAnd || op == BinaryOperatorKind::BO_LOr;
+        }
 
+        json toJson() const;
 
-        // ͨ Expr ̳
-        virtual json toJson() const override;
-        virtual Value* genCode(CodeGeneratorBase& generator) const override;
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() == Kind::BinaryOperator;
+        }
     };
 
     /**
@@ -136,18 +204,38 @@ namespace AST
     class UnaryOperator : public Expr
     {
         UnaryOperatorKind op;
-        unique_ptr<Expr> body;
+        Expr* body;
         friend CodeGenerator;
     public:
-        UnaryOperator(UnaryOperatorKind op, unique_ptr<Expr> body) : op(op), body(std::move(body)) {}
+        UnaryOperator(UnaryOperatorKind op, Expr* body) : Expr(Kind::UnaryOperator), op(op), body(body)
+        {
+            isConst = body && body->getIsConst() && !isIncrementDecrementOp();
+        }
 
         UnaryOperatorKind getOpKind() const {
             return op;
         }
+        Expr* getSubExpr() const
+        {
+            return body;
+        }
+        void setSubExpr(Expr* E)
+        {
+            body = E;
+        }
+        /// ++ and --, whose operand stays an lvalue.
+        bool isIncrementDecrementOp() const
+        {
+            return op == UnaryOperatorKind::UO_PreInc || op == UnaryOperatorKind::UO_PreDec ||
+                op == UnaryOperatorKind::UO_PostInc || op == UnaryOperatorKind::UO_PostDec;
+        }
+
+        json toJson() const;
 
-        // ͨ Expr ̳
-        virtual json toJson() const override;
-        virtual Value* genCode(CodeGeneratorBase& generator) const override;
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() == Kind::UnaryOperator;
+        }
     };
 
  /**
@@ -157,18 +245,29 @@ namespace AST
     class ParenExpr : public Expr
     {
 
-        unique_ptr<Expr> subExpr;
+        Expr* subExpr;
 
     public:
-        ParenExpr(unique_ptr<Expr> expr) : subExpr(std::move(expr)) 
+        ParenExpr(Expr* expr) : Expr(Kind::ParenExpr), subExpr(expr) 
         {
             isConst = subExpr->getIsConst();
             isLvalue = subExpr->getIsLvalue();
         }
+        Expr* getSubExpr() const
+        {
+            return subExpr;
+        }
+        void setSubExpr(Expr* E)
+        {
+            subExpr = E;
+        }
 
-        // ͨ Expr ̳
-        virtual json toJson() const override;
-        virtual Value* genCode(CodeGeneratorBase& generator) const override;
+        json toJson() const;
+
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() == Kind::ParenExpr;
+        }
     };
 
     /**
@@ -177,18 +276,34 @@ namespace AST
     class CallExpr : public Expr
     {
         ///õĺΪDeclRefExpr
-        unique_ptr<Expr> function;
+        Expr* function;
         ///б
-        std::vector<unique_ptr<Expr>> paras;
+        MutableArrayRef<Expr*> paras;
         friend CodeGenerator;
 
     public:
-        
-        CallExpr(unique_ptr<Expr> func, std::vector<unique_ptr<Expr>> &&paras) : function(std::move(func)), paras(std::move(paras)) {}
+        /// paras must have been copied into the ASTContext for this node alone.
+        CallExpr(Expr* func, ArrayRef<Expr*> paras) : Expr(Kind::CallExpr), function(func),
+            paras(const_cast<Expr**>(paras.data()), paras.size()) {}
+        Expr* getCallee() const
+        {
+            return function;
+        }
+        ArrayRef<Expr*> getArgs() const
+        {
+            return paras;
+        }
+        void setArg(size_t i, Expr* E)
+        {
+            paras[i] = E;
+        }
+
+        json toJson() const;
 
-        // ͨ Expr ̳
-        virtual json toJson() const override;
-        virtual Value* genCode(CodeGeneratorBase& generator) const override;
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() == Kind::CallExpr;
+        }
     };
 
     /**
@@ -198,21 +313,45 @@ namespace AST
     {
     protected:
         StringRef castKind;
-        unique_ptr<Expr> subExpr;
+        Expr* subExpr;
+
+        CastExpr(Kind kind, Expr* expr, const char* type):Expr(kind), subExpr(expr), castKind(type)
+        {
+            isConst = expr && expr->getIsConst();
+        }
 
     public:
-        CastExpr(unique_ptr<Expr> expr, const char* type):subExpr(std::move(expr)), castKind(type) {}
+        StringRef getCastKind() const
+        {
+            return castKind;
+        }
+        Expr* getSubExpr() const
+        {
+            return subExpr;
+        }
+        void setSubExpr(Expr* E)
+        {
+            subExpr = E;
+        }
+
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() >= Kind::firstCastExpr && node->getKind() <= Kind::lastCastExpr;
+        }
     };
 
     class ImplicitCastExpr : public CastExpr
     {
         friend CodeGenerator;
     public:
-        ImplicitCastExpr(unique_ptr<Expr> expr, const char* type):CastExpr(std::move(expr), type) {}
+        ImplicitCastExpr(Expr* expr, const char* type):CastExpr(Kind::ImplicitCastExpr, expr, type) {}
+
+        json toJson() const;
 
-        // ͨ Expr ̳
-        virtual json toJson() const override;
-        virtual Value* genCode(CodeGeneratorBase& generator) const override;
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() == Kind::ImplicitCastExpr;
+        }
     };
 
 }; // namespace AST
@@ -0,0 +1,42 @@
+/** @file IdentifierTable.h
+* @brief Interns identifier spellings so that they can be compared as integers
+**/
+
+#pragma once
+#include <vector>
+
+#pragma warning(push, 0)
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#pragma warning(pop)
+
+class IdentifierTable
+{
+    llvm::StringMap<unsigned> ids;
+    /// names[id] points at the key stored in ids, which never moves.
+    std::vector<llvm::StringRef> names;
+
+public:
+    /// Id 0 is reserved for tokens that are not identifiers.
+    IdentifierTable() : names(1) {}
+
+    unsigned get(llvm::StringRef name)
+    {
+        auto res = ids.try_emplace(name, static_cast<unsigned>(names.size()));
+        if (res.second)
+        {
+            names.push_back(res.first->getKey());
+        }
+        return res.first->getValue();
+    }
+
+    llvm::StringRef getName(unsigned id) const
+    {
+        return names[id];
+    }
+
+    size_t size() const
+    {
+        return names.size() - 1;
+    }
+};
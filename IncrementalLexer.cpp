@@ -0,0 +1,90 @@
+/** @file IncrementalLexer.cpp
+* @brief Damage-limited re-lexing after an edit
+**/
+
+#include <algorithm>
+#include <cassert>
+#include "IncrementalLexer.h"
+#include "lexer.h"
+#include "TokenTables.h"
+
+namespace
+{
+    /// How far past the end of a token the lexer may have looked to decide
+    /// where it ends: the punctuator DFA reads one character past its
+    /// longest match, runs of letters or digits read one past their end.
+    constexpr uint32_t MaxLookahead = toktables::maxPunctuatorLength() + 1;
+
+    std::unique_ptr<llvm::MemoryBuffer> bufferFor(const std::string& text)
+    {
+        return llvm::MemoryBuffer::getMemBuffer(text, "", false);
+    }
+}
+
+IncrementalLexer::IncrementalLexer(std::string source, IdentifierTable& idents)
+    : text(std::move(source)), SM(bufferFor(text)), idents(idents)
+{
+    Lexer lexer(SM, idents);
+    tokens = lexer.LexAll();
+    eofIndex = std::find_if(tokens.begin(), tokens.end(), [](const Token& tok) { return tok.kind == TokenKind::eof; }) - tokens.begin();
+}
+
+IncrementalLexer::Change IncrementalLexer::edit(uint32_t offset, uint32_t removed, llvm::StringRef inserted)
+{
+    assert(offset + removed <= text.size() && "edit out of range");
+    uint32_t delta = static_cast<uint32_t>(inserted.size() - removed);
+    uint32_t editEnd = static_cast<uint32_t>(offset + inserted.size());
+
+    // Restart at the last token whose start the edit cannot have moved. Every
+    // real token up to the first eof was lexed outside a comment with no '#'
+    // before it, which is the state a fresh Lexer starts in.
+    auto unmoved = std::partition_point(tokens.begin(), tokens.end(), [offset](const Token& tok) {
+        return tok.offset + MaxLookahead < offset;
+    });
+    size_t first = std::min<size_t>(unmoved - tokens.begin(), eofIndex + 1);
+    // the eof the lexer makes up at the end may sit inside a comment
+    while (first > 0 && tokens[first - 1].length == 0)
+    {
+        first--;
+    }
+    first = first > 0 ? first - 1 : 0;
+    uint32_t restart = first > 0 ? tokens[first].offset : 0;
+
+    text.replace(offset, removed, inserted.data(), inserted.size());
+    SM.replaceRange(bufferFor(text), offset, removed, inserted);
+
+    Lexer lexer(SM, idents, SM.getBufferStart() + restart, SM.getBufferEnd(), false);
+    std::vector<Token> fresh;
+    size_t old = first, resync = tokens.size();
+    bool canResync = true, stopped = false;
+    Token tok;
+    while (lexer.Lex(tok))
+    {
+        if (canResync && !stopped && tok.length && tok.offset >= editEnd)
+        {
+            uint32_t oldOffset = tok.offset - delta;
+            while (canResync && old < tokens.size() && tokens[old].offset < oldOffset)
+            {
+                canResync = tokens[old++].kind != TokenKind::eof;
+            }
+            if (canResync && old < tokens.size() && tokens[old].offset == oldOffset && tokens[old].length)
+            {
+                resync = old;
+                break;
+            }
+        }
+        stopped = stopped || tok.kind == TokenKind::eof;
+        fresh.push_back(tok);
+    }
+
+    for (size_t i = resync; i < tokens.size(); i++)
+    {
+        tokens[i].offset += delta;
+    }
+    Change change{ first, resync - first, fresh.size() };
+    auto freshEof = std::find_if(fresh.begin(), fresh.end(), [](const Token& tok) { return tok.kind == TokenKind::eof; });
+    eofIndex = freshEof != fresh.end() ? first + (freshEof - fresh.begin()) : eofIndex - change.removed + change.inserted;
+    tokens.erase(tokens.begin() + first, tokens.begin() + resync);
+    tokens.insert(tokens.begin() + first, fresh.begin(), fresh.end());
+    return change;
+}
@@ -0,0 +1,59 @@
+/** @file IncrementalLexer.h
+* @brief Keeps the tokens of an edited buffer up to date without re-lexing it all
+**/
+
+#pragma once
+#include <string>
+#include <vector>
+#include "token.h"
+#include "SourceManager.h"
+#include "IdentifierTable.h"
+
+#pragma warning(push, 0)
+#include "llvm/ADT/StringRef.h"
+#pragma warning(pop)
+
+/**
+ * @brief Owns a copy of the source and its tokens, exactly as Lexer::LexAll
+ * would produce them, and patches both after every edit.
+ *
+ * Only the damaged region is re-lexed. Lexing restarts at a token far enough
+ * before the edit that nothing leading up to it could have looked at the edited
+ * text. It stops at the first new token after the edit that starts where an old
+ * token started, with both lexers outside a comment and before any '#'. From
+ * there the two streams are the same, so the old tokens are reused, shifted by
+ * the change in length.
+*/
+class IncrementalLexer
+{
+    std::string text;
+    SourceManager SM;
+    IdentifierTable& idents;
+    std::vector<Token> tokens;
+    /// The first eof token, either a '#' or the one made up at the end.
+    size_t eofIndex;
+
+public:
+    /// Which tokens an edit replaced: [first, first + removed) of the old
+    /// tokens became [first, first + inserted) of the new ones.
+    struct Change
+    {
+        size_t first;
+        size_t removed;
+        size_t inserted;
+    };
+
+    IncrementalLexer(std::string source, IdentifierTable& idents);
+
+    /// Replaces [offset, offset + removed) of the source with inserted.
+    Change edit(uint32_t offset, uint32_t removed, llvm::StringRef inserted);
+
+    const std::vector<Token>& getTokens() const
+    {
+        return tokens;
+    }
+    const SourceManager& getSourceManager() const
+    {
+        return SM;
+    }
+};
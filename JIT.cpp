@@ -0,0 +1,134 @@
+/** @file JIT.cpp
+* @brief LLJIT setup and symbol resolution from the host process
+**/
+
+#include <iostream>
+#include "JIT.h"
+
+#pragma warning(push, 0)
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/TargetProcess/TargetExecutionUtils.h"
+#include "llvm/Support/TargetSelect.h"
+#pragma warning(pop)
+
+std::unique_ptr<JIT> JIT::create(const TargetMachine& TM, ObjectCache* cache)
+{
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+
+    orc::JITTargetMachineBuilder JTMB(TM.getTargetTriple());
+    JTMB.setCPU(TM.getTargetCPU().str());
+    JTMB.getFeatures() = SubtargetFeatures(TM.getTargetFeatureString());
+    JTMB.setOptions(TM.Options);
+    JTMB.setCodeGenOptLevel(TM.getOptLevel());
+    // The JIT defaults to the large code model, which makes instruction
+    // selection about three times slower. Position independent code in the
+    // small model reaches the C library through stubs and the GOT instead.
+    JTMB.setCodeModel(CodeModel::Small);
+    JTMB.setRelocationModel(Reloc::PIC_);
+    auto lljit = orc::LLJITBuilder()
+        .setJITTargetMachineBuilder(std::move(JTMB))
+        .setCompileFunctionCreator([cache](orc::JITTargetMachineBuilder builder)
+            -> Expected<std::unique_ptr<orc::IRCompileLayer::IRCompiler>> {
+            auto machine = builder.createTargetMachine();
+            if (!machine)
+            {
+                return machine.takeError();
+            }
+            return std::make_unique<orc::TMOwningSimpleCompiler>(std::move(*machine), cache);
+        })
+        .create();
+    if (!lljit)
+    {
+        std::cerr << "Can't create the JIT: " << toString(lljit.takeError()) << std::endl;
+        return nullptr;
+    }
+
+    // whatever the program declares but does not define comes from the C library
+    auto process = orc::DynamicLibrarySearchGenerator::GetForCurrentProcess((*lljit)->getDataLayout().getGlobalPrefix());
+    if (!process)
+    {
+        std::cerr << "Can't search the symbols of tcc: " << toString(process.takeError()) << std::endl;
+        return nullptr;
+    }
+    (*lljit)->getMainJITDylib().addGenerator(std::move(*process));
+    auto createStubs = orc::createLocalIndirectStubsManagerBuilder((*lljit)->getTargetTriple());
+    if (!createStubs)
+    {
+        std::cerr << "Can't make stubs for " << (*lljit)->getTargetTriple().str() << std::endl;
+        return nullptr;
+    }
+    return std::unique_ptr<JIT>(new JIT(std::move(*lljit), createStubs()));
+}
+
+/// Says what went wrong, if something did.
+static bool report(Error err)
+{
+    if (err)
+    {
+        std::cerr << toString(std::move(err)) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool JIT::addModule(orc::ThreadSafeModule module)
+{
+    return report(lljit->addIRModule(std::move(module)));
+}
+
+bool JIT::addModule(orc::ThreadSafeModule module, orc::ResourceTrackerSP tracker)
+{
+    return report(lljit->addIRModule(std::move(tracker), std::move(module)));
+}
+
+orc::ResourceTrackerSP JIT::createTracker()
+{
+    return lljit->getMainJITDylib().createResourceTracker();
+}
+
+void JIT::remove(orc::ResourceTrackerSP tracker)
+{
+    report(tracker->remove());
+}
+
+bool JIT::addObject(std::unique_ptr<MemoryBuffer> object)
+{
+    return report(lljit->addObjectFile(std::move(object)));
+}
+
+void* JIT::lookup(StringRef name)
+{
+    auto symbol = lljit->lookup(name);
+    if (!symbol)
+    {
+        std::cerr << toString(symbol.takeError()) << std::endl;
+        return nullptr;
+    }
+    return jitTargetAddressToPointer<void*>(symbol->getAddress());
+}
+
+bool JIT::setStub(StringRef name, void* implementation)
+{
+    JITTargetAddress address = pointerToJITTargetAddress(implementation);
+    if (stubs->findStub(name, false))
+    {
+        return report(stubs->updatePointer(name, address));
+    }
+    if (!report(stubs->createStub(name, address, JITSymbolFlags::Exported | JITSymbolFlags::Callable)))
+    {
+        return false;
+    }
+    JITEvaluatedSymbol stub = stubs->findStub(name, false);
+    return report(lljit->getMainJITDylib().define(orc::absoluteSymbols({ { lljit->mangleAndIntern(name), stub } })));
+}
+
+int JIT::runMain(void* main, StringRef programName, ArrayRef<std::string> args)
+{
+    // Under the C calling convention a main with fewer parameters simply
+    // ignores argc and argv.
+    using MainFunction = int (*)(int, char*[]);
+    return orc::runAsMain(reinterpret_cast<MainFunction>(main), args, programName);
+}
@@ -0,0 +1,63 @@
+/** @file JIT.h
+* @brief Runs generated modules in process on ORC's LLJIT
+**/
+
+#pragma once
+#include <memory>
+#include <string>
+
+#pragma warning(push, 0)
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/Target/TargetMachine.h"
+#pragma warning(pop)
+
+using namespace llvm;
+
+/**
+ * @brief Compiles modules for the host and calls into them.
+ *
+ * Functions a module declares without defining, such as printf or scanf,
+ * resolve to the symbols of the running process, so a program calls the C
+ * library that tcc itself is linked with. Errors are reported on std::cerr,
+ * as the other phases of tcc do.
+*/
+class JIT
+{
+    std::unique_ptr<orc::LLJIT> lljit;
+    /// The stubs of setStub.
+    std::unique_ptr<orc::IndirectStubsManager> stubs;
+
+    JIT(std::unique_ptr<orc::LLJIT> lljit, std::unique_ptr<orc::IndirectStubsManager> stubs)
+        : lljit(std::move(lljit)), stubs(std::move(stubs)) {}
+
+public:
+    /// A JIT that generates code for the triple, CPU, features and level of
+    /// TM, or null if it can't. Compiled objects go to cache, and modules
+    /// the cache holds an object for are not compiled, if cache is not null.
+    static std::unique_ptr<JIT> create(const TargetMachine& TM, ObjectCache* cache = nullptr);
+
+    /// Adds a module. Nothing is compiled until one of its symbols is looked up.
+    bool addModule(orc::ThreadSafeModule module);
+    /// Adds a module whose code goes away again with tracker, see remove.
+    bool addModule(orc::ThreadSafeModule module, orc::ResourceTrackerSP tracker);
+    /// A tracker for the modules that are to be removed together.
+    orc::ResourceTrackerSP createTracker();
+    /// Frees the code of the modules added with tracker and forgets what
+    /// they define.
+    void remove(orc::ResourceTrackerSP tracker);
+    /// Adds an object compiled earlier, as DiskObjectCache::load returns it.
+    bool addObject(std::unique_ptr<MemoryBuffer> object);
+    /// The address of the function name, after compiling the modules that
+    /// define it; null if it is not defined or something it uses isn't.
+    void* lookup(StringRef name);
+    /// Defines the function name as a stub that jumps to implementation, or
+    /// points the stub there if it exists. Code that calls name goes through
+    /// the stub, so a function can be replaced without compiling its callers
+    /// again.
+    bool setStub(StringRef name, void* implementation);
+    /// Calls a main that takes no parameters, or argc and argv, with
+    /// programName and args as argv, and returns its result.
+    int runMain(void* main, StringRef programName, ArrayRef<std::string> args);
+};
@@ -0,0 +1,241 @@
+/** @file ParallelLexer.cpp
+* @brief Chunked lexing with comment-state speculation
+**/
+
+#include <cstdint>
+#include <cstring>
+#include "ParallelLexer.h"
+#include "lexer.h"
+
+#pragma warning(push, 0)
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#pragma warning(pop)
+
+namespace
+{
+    /// Smaller chunks are not worth a task of their own.
+    constexpr size_t MinChunkSize = 256 * 1024;
+    /// More chunks than threads, so that one slow chunk does not hold up the rest.
+    constexpr unsigned ChunksPerThread = 4;
+
+    /// The tokens of one chunk, lexed from one assumed starting state.
+    struct LexedRun
+    {
+        IdentifierTable idents;
+        std::vector<Token> tokens;
+        const char* end = nullptr;
+        bool endsInComment = false;
+        bool stopped = false;
+    };
+
+    struct Chunk
+    {
+        const char* begin;
+        const char* end;
+        /// The chunk lexed as if it started outside a comment.
+        LexedRun outside;
+        /// The chunk lexed as if it started inside a comment. This run stops
+        /// as soon as it catches up with `outside`, whose tokens from index
+        /// convergedAt on it then shares.
+        LexedRun inside;
+        size_t convergedAt = SIZE_MAX;
+    };
+
+    void finishRun(Lexer& lexer, LexedRun& run)
+    {
+        run.end = lexer.getBufferPtr();
+        run.endsInComment = lexer.isInComment();
+        run.stopped = lexer.hasStopped();
+    }
+
+    void lexChunk(const SourceManager& SM, Chunk& chunk, bool speculate)
+    {
+        LexedRun& outside = chunk.outside;
+        Lexer lexer(SM, outside.idents, chunk.begin, chunk.end, false);
+        outside.tokens.reserve((chunk.end - chunk.begin) / 2 + 1);
+        Token tok;
+        while (lexer.LexRaw(tok))
+        {
+            outside.tokens.push_back(tok);
+        }
+        finishRun(lexer, outside);
+        if (!speculate)
+        {
+            return;
+        }
+
+        // The lexer state is just its position, whether it is in a comment and
+        // whether it has seen '#'. Once both runs emit a token at the same
+        // offset with no '#' behind them, everything after it is the same.
+        LexedRun& inside = chunk.inside;
+        Lexer commentLexer(SM, inside.idents, chunk.begin, chunk.end, true);
+        const std::vector<Token>& known = outside.tokens;
+        size_t k = 0;
+        bool canConverge = true;
+        while (commentLexer.LexRaw(tok))
+        {
+            while (canConverge && k < known.size() && known[k].offset < tok.offset)
+            {
+                canConverge = known[k++].kind != TokenKind::eof;
+            }
+            if (canConverge && k < known.size() && known[k].offset == tok.offset)
+            {
+                chunk.convergedAt = k;
+                inside.end = outside.end;
+                inside.endsInComment = outside.endsInComment;
+                inside.stopped = outside.stopped;
+                return;
+            }
+            inside.tokens.push_back(tok);
+        }
+        finishRun(commentLexer, inside);
+    }
+
+    /// A stretch of one run's tokens that goes into the output.
+    struct Segment
+    {
+        const LexedRun* run;
+        size_t from;
+        size_t dest;
+        /// Local identifier id to global id.
+        std::vector<unsigned> idMap;
+    };
+
+    /// Hands out global identifier ids in order of first appearance, which
+    /// is the order the serial lexer uses.
+    void mapIdentifiers(Segment& seg, IdentifierTable& idents)
+    {
+        const LexedRun& run = *seg.run;
+        seg.idMap.assign(run.idents.size() + 1, 0);
+        if (seg.from == 0)
+        {
+            // local ids were handed out in the same order
+            for (unsigned id = 1; id <= run.idents.size(); id++)
+            {
+                seg.idMap[id] = idents.get(run.idents.getName(id));
+            }
+            return;
+        }
+        for (size_t i = seg.from; i < run.tokens.size(); i++)
+        {
+            unsigned id = run.tokens[i].identID;
+            if (id && !seg.idMap[id])
+            {
+                seg.idMap[id] = idents.get(run.idents.getName(id));
+            }
+        }
+    }
+
+    void copySegment(const Segment& seg, Token* out)
+    {
+        const std::vector<Token>& src = seg.run->tokens;
+        for (size_t i = seg.from; i < src.size(); i++)
+        {
+            Token tok = src[i];
+            tok.identID = seg.idMap[tok.identID];
+            *out++ = tok;
+        }
+    }
+
+    /// Cuts the buffer into about n pieces, each ending just after a newline.
+    std::vector<const char*> splitAtLines(const char* start, const char* end, size_t n)
+    {
+        std::vector<const char*> bounds{ start };
+        size_t size = end - start;
+        for (size_t i = 1; i < n; i++)
+        {
+            const char* target = start + size * i / n;
+            if (target <= bounds.back())
+            {
+                continue;
+            }
+            const void* eol = memchr(target, '\n', end - target);
+            if (!eol)
+            {
+                break;
+            }
+            bounds.push_back(static_cast<const char*>(eol) + 1);
+        }
+        if (bounds.back() != end)
+        {
+            bounds.push_back(end);
+        }
+        return bounds;
+    }
+}
+
+std::vector<Token> lexInParallel(const SourceManager& SM, IdentifierTable& idents, unsigned jobs)
+{
+    llvm::ThreadPoolStrategy strategy = llvm::hardware_concurrency(jobs);
+    unsigned threads = strategy.compute_thread_count();
+    size_t size = SM.getBuffer().size();
+    size_t chunkCount = std::min<size_t>(size / MinChunkSize, threads * ChunksPerThread);
+    if (threads <= 1 || chunkCount <= 1)
+    {
+        Lexer lexer(SM, idents);
+        return lexer.LexAll();
+    }
+
+    std::vector<const char*> bounds = splitAtLines(SM.getBufferStart(), SM.getBufferEnd(), chunkCount);
+    chunkCount = bounds.size() - 1;
+    std::vector<Chunk> chunks(chunkCount);
+    llvm::ThreadPool pool(strategy);
+    for (size_t i = 0; i < chunkCount; i++)
+    {
+        Chunk& chunk = chunks[i];
+        chunk.begin = bounds[i];
+        chunk.end = bounds[i + 1];
+        // the first chunk never starts inside a comment
+        pool.async([&SM, &chunk, i] { lexChunk(SM, chunk, i != 0); });
+    }
+    pool.wait();
+
+    // Pick the runs in order, following the state each chunk really ends in.
+    std::vector<Segment> segments;
+    size_t total = 0;
+    const char* end = SM.getBufferStart();
+    bool inComment = false;
+    auto addSegment = [&](const LexedRun& run, size_t from) {
+        segments.push_back({ &run, from, total, {} });
+        mapIdentifiers(segments.back(), idents);
+        total += run.tokens.size() - from;
+    };
+    for (Chunk& chunk : chunks)
+    {
+        const LexedRun* last = &chunk.outside;
+        if (!inComment)
+        {
+            addSegment(chunk.outside, 0);
+        }
+        else if (chunk.convergedAt == SIZE_MAX)
+        {
+            addSegment(chunk.inside, 0);
+            last = &chunk.inside;
+        }
+        else
+        {
+            addSegment(chunk.inside, 0);
+            addSegment(chunk.outside, chunk.convergedAt);
+        }
+        end = last->end;
+        if (last->stopped)
+        {
+            break;
+        }
+        inComment = last->endsInComment;
+    }
+
+    std::vector<Token> tokens(total);
+    for (const Segment& seg : segments)
+    {
+        pool.async([&tokens, &seg] { copySegment(seg, tokens.data() + seg.dest); });
+    }
+    pool.wait();
+    if (tokens.empty() || tokens.back().kind != TokenKind::eof)
+    {
+        // an empty eof token right after the last line read, as Lexer::Lex does
+        tokens.push_back({ TokenKind::eof, 0, static_cast<uint32_t>(end - SM.getBufferStart()), 0 });
+    }
+    return tokens;
+}
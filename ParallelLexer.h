@@ -0,0 +1,22 @@
+/** @file ParallelLexer.h
+* @brief Lexes a large translation unit in line-aligned chunks on a thread pool
+**/
+
+#pragma once
+#include <vector>
+#include "token.h"
+#include "SourceManager.h"
+#include "IdentifierTable.h"
+
+/**
+ * @brief Produces exactly the tokens (and identifier ids) of Lexer::LexAll.
+ *
+ * The only state a line inherits from the lines before it is whether it
+ * starts inside a block comment, and whether a '#' already ended the input.
+ * Every chunk is therefore lexed from both comment states (the run that starts
+ * inside a comment usually catches up with the other one within a few lines),
+ * and the chunks are then stitched in order, following the state the previous
+ * chunk actually ended in.
+ * @param jobs Number of threads, 0 for every hardware thread
+*/
+std::vector<Token> lexInParallel(const SourceManager& SM, IdentifierTable& idents, unsigned jobs);
@@ -3,135 +3,44 @@
 * ﷨岿ʵ
 **/
 
+#include <array>
+#include <atomic>
 #include <cassert>
 #include "Parser.h"
+#include "lexer.h"
 
-precLevel Parser::getBinOpPrecedence(TokenKind opcode)
-{
-    switch (opcode)
-    {
-        default:
-            return precLevel::Unknown;
-
-        case TokenKind::equal:
-        case TokenKind::plusequal:
-        case TokenKind::minusequal:
-        case TokenKind::starequal:
-        case TokenKind::slashequal:
-        case TokenKind::percentequal:
-        case TokenKind::lesslessequal:
-        case TokenKind::greatergreaterequal:
-        case TokenKind::ampequal:
-        case TokenKind::pipeequal:
-        case TokenKind::caretequal:
-            return precLevel::Assignment;
-
-        case TokenKind::pipepipe:
-            return precLevel::LogicalOr;
-
-        case TokenKind::ampamp:
-            return precLevel::LogicalAnd;
-
-        case TokenKind::pipe:
-            return precLevel::InclusiveOr;
-
-        case TokenKind::caret:
-            return precLevel::ExclusiveOr;
-
-        case TokenKind::amp:
-            return precLevel::And;
-
-        case TokenKind::exclaimequal:
-        case TokenKind::equalequal:
-            return precLevel::Equality;
-
-        case TokenKind::less:
-        case TokenKind::lessequal:
-        case TokenKind::greater:
-        case TokenKind::greaterequal:
-            return precLevel::Relational;
-
-        case TokenKind::lessless:
-        case TokenKind::greatergreater:
-            return precLevel::Shift;
+#pragma warning(push, 0)
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#pragma warning(pop)
 
-        case TokenKind::plus:
-        case TokenKind::minus:
-            return precLevel::Additive;
+namespace
+{
+    struct BinaryOperatorInfo
+    {
+        precLevel prec;
+        BinaryOperatorKind kind;
+    };
+
+    /// Indexed by token kind; tokens that are not binary operators have precLevel::Unknown.
+    constexpr std::array<BinaryOperatorInfo, static_cast<size_t>(TokenKind::NUM_TOKENS)> binaryOperators = [] {
+        std::array<BinaryOperatorInfo, static_cast<size_t>(TokenKind::NUM_TOKENS)> table = {};
+#define BINARY_OPERATION_TOKEN(Token, Name, Prec) \
+        table[static_cast<size_t>(TokenKind::Token)] = { precLevel::Prec, BinaryOperatorKind::BO_##Name };
+#include "OperationKinds.def"
+        return table;
+    }();
+}
 
-        case TokenKind::slash:
-        case TokenKind::star:
-        case TokenKind::percent:
-            return precLevel::Multiplicative;
-    }
+precLevel Parser::getBinOpPrecedence(TokenKind opcode)
+{
+    return binaryOperators[static_cast<size_t>(opcode)].prec;
 }
 
 BinaryOperatorKind Parser::getBinOpKind(TokenKind opcode)
 {
-    switch (opcode)
-    {
-        case TokenKind::plus:
-            return BinaryOperatorKind::BO_Add;
-        case TokenKind::plusequal:
-            return BinaryOperatorKind::BO_AddAssign;
-        case TokenKind::minus:
-            return BinaryOperatorKind::BO_Sub;
-        case TokenKind::minusequal:
-            return BinaryOperatorKind::BO_SubAssign;
-        case TokenKind::exclaimequal:
-            return BinaryOperatorKind::BO_NE;
-        case TokenKind::equalequal:
-            return BinaryOperatorKind::BO_EQ;
-        case TokenKind::slash:
-            return BinaryOperatorKind::BO_Div;
-        case TokenKind::slashequal:
-            return BinaryOperatorKind::BO_DivAssign;
-        case TokenKind::percent:
-            return BinaryOperatorKind::BO_Rem;
-        case TokenKind::percentequal:
-            return BinaryOperatorKind::BO_RemAssign;
-        case TokenKind::star:
-            return BinaryOperatorKind::BO_Mul;
-        case TokenKind::starequal:
-            return BinaryOperatorKind::BO_MulAssign;
-        case TokenKind::less:
-            return BinaryOperatorKind::BO_LT;
-        case TokenKind::lessequal:
-            return BinaryOperatorKind::BO_LE;
-        case TokenKind::lessless:
-            return BinaryOperatorKind::BO_Shl;
-        case TokenKind::lesslessequal:
-            return BinaryOperatorKind::BO_ShlAssign;
-        case TokenKind::greater:
-            return BinaryOperatorKind::BO_GT;
-        case TokenKind::greaterequal:
-            return BinaryOperatorKind::BO_GE;
-        case TokenKind::greatergreater:
-            return BinaryOperatorKind::BO_Shr;
-        case TokenKind::greatergreaterequal:
-            return BinaryOperatorKind::BO_ShrAssign;
-        case TokenKind::equal:
-            return BinaryOperatorKind::BO_Assign;
-        case TokenKind::amp:
-            return BinaryOperatorKind::BO_And;
-        case TokenKind::ampamp:
-            return BinaryOperatorKind::BO_LAnd;
-        case TokenKind::ampequal:
-            return BinaryOperatorKind::BO_AndAssign;
-        case TokenKind::pipe:
-            return BinaryOperatorKind::BO_Or;
-        case TokenKind::pipepipe:
-            return BinaryOperatorKind::BO_LOr;
-        case TokenKind::pipeequal:
-            return BinaryOperatorKind::BO_OrAssign;
-        case TokenKind::caret:
-            return BinaryOperatorKind::BO_Xor;
-        case TokenKind::caretequal:
-            return BinaryOperatorKind::BO_XorAssign;
-        default:
-            assert(0 && "Not a binary operator");
-            return BinaryOperatorKind();
-    }
+    assert(getBinOpPrecedence(opcode) != precLevel::Unknown && "Not a binary operator");
+    return binaryOperators[static_cast<size_t>(opcode)].kind;
 }
 
 UnaryOperatorKind Parser::getUnaryOpKind(TokenKind opcode)
@@ -155,194 +64,287 @@ UnaryOperatorKind Parser::getUnaryOpKind(TokenKind opcode)
 
 
 
-unique_ptr<Expr> Parser::parseIntegerLiteral()
+Expr* Parser::parseIntegerLiteral()
 {
-    auto res = make_unique<IntegerLiteral>(std::stoi(curTok->content));
+    int value;
+    if (getSpelling(curTok).getAsInteger(10, value))
+    {
+        logError("integer literal is too large");
+        return nullptr;
+    }
+    auto res = newNode<IntegerLiteral>(value);
     getNextTok();
-    return std::move(res);
+    return res;
 }
 
 
-/// ParenExpr ::= '(' Expr ')'
-unique_ptr<Expr> Parser::parseParenExpr()
+Expr* Parser::parseExpression()
 {
-    auto lparen = curTok;
-    getNextTok(); //eat (
-    auto res = parseExpression(); 
-    if (!res)
-    {
-        return nullptr;
-    }
+    return parseBinaryOperator();
+}
 
-    if (curTok->kind != TokenKind::r_paren)
+Expr* Parser::parseRValue()
+{
+    auto expr = parseExpression();
+    if (expr && expr->getIsLvalue())
     {
-        logError("expected ')'");
-        addNote("to math this '(", lparen->loc);
-        return nullptr;
+        expr = newNode<ImplicitCastExpr>(expr, "LValueToRValue");
     }
-    getNextTok(); //eat )
-    return make_unique<ParenExpr>(std::move(res));
+    return expr;
 }
 
-/// RefOrCall 
+/// Expr ::= Unary (BinaryOp Primary)*
+///
+/// Unary
+///     ::= PrefixOp Unary
+///     ::= Primary
+///     ::= Primary '++'
+///     ::= Primary '--'
+///
+/// Primary
 ///     ::= DeclRefExpr
 ///     ::= DeclRefExpr '(' Paras ')'
-/// 
+///     ::= IntegerLiteral
+///     ::= '(' Expr ')'
+///
 /// Paras
 ///     ::= Expr
 ///     ::= Expr ',' Paras
-unique_ptr<Expr> Parser::parseRefOrCall()
-{
-    const std::string& name=curTok->content;
-    getNextTok();
-    if (curTok->kind == TokenKind::l_paren)
-    {
-        auto lparen = curTok;
-        getNextTok();
-        std::vector<unique_ptr<Expr>> paras;
-        while (true)
-        {
-            paras.emplace_back(parseRValue());
-            if (curTok->kind == TokenKind::r_paren)
-            {
-                getNextTok();
-                break;
-            }
-            else if (curTok->kind == TokenKind::comma)
-            {
-                getNextTok();
-            }
-            else
-            {
-                logError("expected ')'");
-                addNote("to math this '(", lparen->loc);
-                return nullptr;
-            }
-        }
-        return make_unique<CallExpr>(make_unique<DeclRefExpr>(name), std::move(paras));
-    }
-    else
-    {
-        return make_unique<DeclRefExpr>(name);
-    }
-}
-
-/// Primary
-///     ::= RefOrCall
-///     ::= IntegerLiteral
-///     ::= ParenExpr
-unique_ptr<Expr> Parser::parsePrimary()
+///
+/// Binary operators are grouped by precedence climbing: an operator takes a
+/// tighter-binding chain on its right as its RHS, and an assignment also
+/// takes the next assignment. Operands, parentheses and arguments nest on
+/// an explicit stack of ExprFrames instead of recursive calls.
+Expr* Parser::parseBinaryOperator()
 {
-    switch (curTok->kind)
-    {
-        case TokenKind::identifier:
-            return parseRefOrCall();
-        case TokenKind::numeric_constant:
-            return parseIntegerLiteral(); //Ŀǰֻ֧
-        case TokenKind::l_paren:
-            return parseParenExpr();
-        default:
-            logError("expected expression");
-            return nullptr;
-    }
-}
-
-unique_ptr<Expr> Parser::parseRHSOfBinaryExpression(unique_ptr<Expr> LHS, precLevel minPrec)
-{
-    while (1)
-    {
-        precLevel nextTokPrec = getBinOpPrecedence(curTok->kind);
-        if (nextTokPrec < minPrec)
+    SmallVector<ExprFrame, 16> stack;
+    /// Arguments of the calls on the stack, innermost last.
+    SmallVector<Expr*, 16> args;
+    enum class Step
+    {
+        Expression,
+        Primary,
+        Value,
+    } step = Step::Expression;
+    /// The operand just finished, once step is Value.
+    Expr* value = nullptr;
+    // The Operand frame of the primary being parsed stays out of the stack
+    // unless the primary nests, which keeps long operator chains off it.
+    ExprFrame operand(ExprFrame::Operand);
+    bool hasOperand = false;
+
+    // Ends the operator chain at LHS if the next operator binds looser than
+    // minPrec, otherwise goes on to the operand after it.
+    auto continueRHS = [&](Expr* LHS, precLevel minPrec) {
+        precLevel prec = getBinOpPrecedence(curTok.kind);
+        if (prec < minPrec)
         {
-            return LHS;
+            value = LHS;
+            step = Step::Value;
+            return;
         }
-        auto binOP = getBinOpKind(curTok->kind);
+        operand.LHS = LHS;
+        operand.binOp = getBinOpKind(curTok.kind);
+        operand.opOffset = curTok.offset;
+        operand.prec = prec;
+        operand.minPrec = minPrec;
+        hasOperand = true;
         getNextTok();
-        auto RHS = parsePrimary();
-        if (!RHS)
+        step = Step::Primary;
+    };
+    auto spillOperand = [&] {
+        if (hasOperand)
         {
-            return nullptr;
+            stack.push_back(operand);
+            hasOperand = false;
         }
-        precLevel thisPrec = nextTokPrec;
-        nextTokPrec = getBinOpPrecedence(curTok->kind);
-        bool isRightAssoc = thisPrec == precLevel::Assignment; 
+    };
 
-        if (thisPrec < nextTokPrec ||
-            (thisPrec == nextTokPrec && isRightAssoc))
+    while (true)
+    {
+        switch (step)
         {
-            RHS = parseRHSOfBinaryExpression(std::move(RHS),
-                static_cast<precLevel>(static_cast<int>(thisPrec) + !isRightAssoc));
-        }
-        LHS = make_unique<AST::BinaryOperator>(binOP, std::move(LHS), std::move(RHS));
-    }
-    return nullptr;
-}
-
-unique_ptr<Expr> Parser::parseExpression()
-{
-    return parseBinaryOperator();
-}
+            case Step::Expression:
+                stack.push_back(ExprFrame(ExprFrame::Expression));
+                while (curTok.kind == TokenKind::exclaim || curTok.kind == TokenKind::tilde ||
+                       curTok.kind == TokenKind::plus || curTok.kind == TokenKind::minus ||
+                       curTok.kind == TokenKind::plusplus || curTok.kind == TokenKind::minusminus)
+                {
+                    ExprFrame frame(ExprFrame::Prefix);
+                    frame.unaryOp = curTok.kind == TokenKind::plusplus ? UnaryOperatorKind::UO_PreInc :
+                                    curTok.kind == TokenKind::minusminus ? UnaryOperatorKind::UO_PreDec :
+                                        getUnaryOpKind(curTok.kind);
+                    stack.push_back(frame);
+                    getNextTok();
+                }
+                stack.push_back(ExprFrame(ExprFrame::Postfix));
+                step = Step::Primary;
+                break;
 
-unique_ptr<Expr> Parser::parseRValue()
-{
-    auto expr = parseExpression();
-    if (expr->getIsLvalue())
-    {
-        expr = make_unique<ImplicitCastExpr>(std::move(expr), "LValueToRValue");
-    }
-    return expr;
-}
+            case Step::Primary:
+                step = Step::Value;
+                switch (curTok.kind)
+                {
+                    case TokenKind::identifier:
+                    {
+                        StringRef name = getIdentifier(curTok);
+                        getNextTok();
+                        if (curTok.kind == TokenKind::l_paren)
+                        {
+                            spillOperand();
+                            ExprFrame frame(ExprFrame::Call);
+                            frame.lparen = curTok;
+                            frame.LHS = newNode<DeclRefExpr>(name);
+                            frame.argsBegin = static_cast<uint32_t>(args.size());
+                            stack.push_back(frame);
+                            getNextTok();
+                            step = Step::Expression;
+                            break;
+                        }
+                        value = newNode<DeclRefExpr>(name);
+                        break;
+                    }
+                    case TokenKind::numeric_constant:
+                        value = parseIntegerLiteral(); //Ŀǰֻ֧
+                        break;
+                    case TokenKind::l_paren:
+                    {
+                        spillOperand();
+                        ExprFrame frame(ExprFrame::Paren);
+                        frame.lparen = curTok;
+                        stack.push_back(frame);
+                        getNextTok(); //eat (
+                        step = Step::Expression;
+                        break;
+                    }
+                    default:
+                        logError("expected expression");
+                        value = nullptr;
+                        break;
+                }
+                break;
 
-unique_ptr<Expr> Parser::parseUnaryOperator()
-{
-    switch (curTok->kind)
-    {
-        case TokenKind::exclaim:
-        case TokenKind::tilde:
-        case TokenKind::plus:
-        case TokenKind::minus:
-        case TokenKind::plusplus:
-        case TokenKind::minusminus:
-        {
-            auto op = curTok->kind == TokenKind::plusplus ? UnaryOperatorKind::UO_PreInc :
-                      curTok->kind == TokenKind::minusminus ? UnaryOperatorKind::UO_PreDec :
-                            getUnaryOpKind(curTok->kind);
-            getNextTok();
-            unique_ptr<Expr> body = parseUnaryOperator();
-            return make_unique<AST::UnaryOperator>(op, std::move(body));
-        }
-        default:
-            auto body=parsePrimary();
-            if (curTok->kind == TokenKind::plusplus)
+            case Step::Value:
             {
-                getNextTok();
-                return make_unique<AST::UnaryOperator>(UnaryOperatorKind::UO_PostInc, std::move(body));
-            }
-            else if (curTok->kind == TokenKind::minusminus)
-            {
-                getNextTok();
-                return make_unique<AST::UnaryOperator>(UnaryOperatorKind::UO_PostDec, std::move(body));
-            }
-            else
-            {
-                return std::move(body);
+                ExprFrame frame = operand;
+                if (hasOperand)
+                {
+                    hasOperand = false;
+                }
+                else if (stack.empty())
+                {
+                    return value;
+                }
+                else
+                {
+                    frame = stack.pop_back_val();
+                }
+                switch (frame.kind)
+                {
+                    case ExprFrame::Postfix:
+                        if (curTok.kind == TokenKind::plusplus)
+                        {
+                            getNextTok();
+                            value = newNode<AST::UnaryOperator>(UnaryOperatorKind::UO_PostInc, value);
+                        }
+                        else if (curTok.kind == TokenKind::minusminus)
+                        {
+                            getNextTok();
+                            value = newNode<AST::UnaryOperator>(UnaryOperatorKind::UO_PostDec, value);
+                        }
+                        break;
+                    case ExprFrame::Prefix:
+                        value = newNode<AST::UnaryOperator>(frame.unaryOp, value);
+                        break;
+                    case ExprFrame::Expression:
+                        if (value)
+                        {
+                            continueRHS(value, precLevel::Comma);
+                        }
+                        break;
+                    case ExprFrame::Operand:
+                    {
+                        if (!value)
+                        {
+                            break;
+                        }
+                        precLevel nextPrec = getBinOpPrecedence(curTok.kind);
+                        bool isRightAssoc = frame.prec == precLevel::Assignment;
+                        if (frame.prec < nextPrec || (frame.prec == nextPrec && isRightAssoc))
+                        {
+                            frame.kind = ExprFrame::RHS;
+                            stack.push_back(frame);
+                            continueRHS(value, static_cast<precLevel>(static_cast<int>(frame.prec) + !isRightAssoc));
+                        }
+                        else
+                        {
+                            continueRHS(newNode<AST::BinaryOperator>(Ctx, frame.binOp, frame.LHS, value, frame.opOffset), frame.minPrec);
+                        }
+                        break;
+                    }
+                    case ExprFrame::RHS:
+                        if (value)
+                        {
+                            continueRHS(newNode<AST::BinaryOperator>(Ctx, frame.binOp, frame.LHS, value, frame.opOffset), frame.minPrec);
+                        }
+                        break;
+                    case ExprFrame::Paren:
+                        if (!value)
+                        {
+                            break;
+                        }
+                        if (curTok.kind != TokenKind::r_paren)
+                        {
+                            logError("expected ')'");
+                            addNote("to math this '(", frame.lparen);
+                            value = nullptr;
+                            break;
+                        }
+                        getNextTok(); //eat )
+                        value = newNode<ParenExpr>(value);
+                        break;
+                    case ExprFrame::Call:
+                        if (!value)
+                        {
+                            args.resize(frame.argsBegin);
+                            break;
+                        }
+                        if (value->getIsLvalue())
+                        {
+                            value = newNode<ImplicitCastExpr>(value, "LValueToRValue");
+                        }
+                        args.push_back(value);
+                        if (curTok.kind == TokenKind::r_paren)
+                        {
+                            getNextTok();
+                            auto paras = Ctx.copyArray(makeArrayRef(args).drop_front(frame.argsBegin));
+                            args.resize(frame.argsBegin);
+                            value = newNode<CallExpr>(frame.LHS, paras);
+                        }
+                        else if (curTok.kind == TokenKind::comma)
+                        {
+                            getNextTok();
+                            stack.push_back(frame);
+                            step = Step::Expression;
+                        }
+                        else
+                        {
+                            logError("expected ')'");
+                            addNote("to math this '(", frame.lparen);
+                            args.resize(frame.argsBegin);
+                            value = nullptr;
+                        }
+                        break;
+                }
+                break;
             }
+        }
     }
 }
 
-unique_ptr<Expr> Parser::parseBinaryOperator()
-{
-    auto LHS = parseUnaryOperator();
-    if (!LHS)
-    {
-        return nullptr;
-    }
-    return parseRHSOfBinaryExpression(std::move(LHS), precLevel::Comma);
-}
-
-unique_ptr<Stmt> Parser::parseStmt()
+Stmt* Parser::parseStmt()
 {
-    switch (curTok->kind)
+    switch (curTok.kind)
     {
         case TokenKind::semi:
             return parseNullStmt();
@@ -368,32 +370,32 @@ unique_ptr<Stmt> Parser::parseStmt()
 }
 
 // NullStmt ::= ';'
-unique_ptr<Stmt> Parser::parseNullStmt()
+Stmt* Parser::parseNullStmt()
 {
     getNextTok(); // eat ';'
-    return make_unique<NullStmt>();
+    return newNode<NullStmt>();
 }
 
 
 // ValueStmt ::= Expr ';'
-unique_ptr<Stmt> Parser::parseValueStmt()
+Stmt* Parser::parseValueStmt()
 {
     auto expr = parseExpression();
-    if (curTok->kind != TokenKind::semi)
+    if (curTok.kind != TokenKind::semi)
     {
         logError("except ; after expression");
         return nullptr;
     }
     getNextTok(); // eat ';'
-    return make_unique<ValueStmt>(std::move(expr));
+    return newNode<ValueStmt>(expr);
 }
 
 /// IfStmt ::= 'if' '(' Expr ')' Stmt
 ///        ::= 'if' '(' Expr ')' Stmt 'else' Stmt
-unique_ptr<Stmt> Parser::parseIfStmt()
+Stmt* Parser::parseIfStmt()
 {
     getNextTok();//eat if
-    if (curTok->kind != TokenKind::l_paren)
+    if (curTok.kind != TokenKind::l_paren)
     {
         logError("except ; after if");
         return nullptr;
@@ -405,10 +407,10 @@ unique_ptr<Stmt> Parser::parseIfStmt()
     {
         return nullptr;
     }
-    if (curTok->kind != TokenKind::r_paren)
+    if (curTok.kind != TokenKind::r_paren)
     {
         logError("except ')'");
-        addNote("to match this '('", lparen->loc);
+        addNote("to match this '('", lparen);
         return nullptr;
     }
     getNextTok(); // eat ')'
@@ -418,20 +420,20 @@ unique_ptr<Stmt> Parser::parseIfStmt()
         return nullptr;
     }
 
-    if (curTok->kind == TokenKind::kw_else)
+    if (curTok.kind == TokenKind::kw_else)
     {
         getNextTok();
         auto elseBody = parseStmt();
-        return make_unique<IfStmt>(std::move(cond), std::move(body), std::move(elseBody));
+        return newNode<IfStmt>(cond, body, elseBody);
     }
-    return make_unique<IfStmt>(std::move(cond), std::move(body));
+    return newNode<IfStmt>(cond, body);
 }
 
 /// WhileStmt ::= 'while' '(' Expr ')' Stmt
-unique_ptr<Stmt> Parser::parseWhileStmt()
+Stmt* Parser::parseWhileStmt()
 {
     getNextTok();//eat while
-    if (curTok->kind != TokenKind::l_paren)
+    if (curTok.kind != TokenKind::l_paren)
     {
         logError("except ; after while");
         return nullptr;
@@ -443,10 +445,10 @@ unique_ptr<Stmt> Parser::parseWhileStmt()
     {
         return nullptr;
     }
-    if (curTok->kind != TokenKind::r_paren)
+    if (curTok.kind != TokenKind::r_paren)
     {
         logError("except ')'");
-        addNote("to match this '('", lparen->loc);
+        addNote("to match this '('", lparen);
         return nullptr;
     }
     getNextTok();//eat )
@@ -455,116 +457,178 @@ unique_ptr<Stmt> Parser::parseWhileStmt()
     {
         return nullptr;
     }
-    return make_unique<WhileStmt>(std::move(cond), std::move(body));
+    return newNode<WhileStmt>(cond, body);
 }
 
-unique_ptr<Stmt> Parser::parseCompoundStmt()
+Stmt* Parser::parseCompoundStmt()
 {
-    assert(curTok->kind == TokenKind::l_brace && "Compound Statement should start with '{'");
+    assert(curTok.kind == TokenKind::l_brace && "Compound Statement should start with '{'");
     auto lbrace = curTok;
     getNextTok();
-    std::vector<unique_ptr<Stmt>> body;
-    while (curTok->kind != TokenKind::r_brace)
+    SmallVector<Stmt*, 8> body;
+    while (curTok.kind != TokenKind::r_brace)
     {
         auto res = parseStmt();
         if (!res)
         {
             break;
         }
-        body.push_back(std::move(res));
+        body.push_back(res);
     }
-    if (curTok->kind != TokenKind::r_brace)
+    if (curTok.kind != TokenKind::r_brace)
     {
         logError("except '}'");
-        addNote("to match this '{'", lbrace->loc);
+        addNote("to match this '{'", lbrace);
         return nullptr;
     }
     getNextTok();
-    return make_unique<CompoundStmt>(body);
+    return newNode<CompoundStmt>(Ctx.copyArray(body));
+}
+
+bool Parser::skipCompoundStmt(uint32_t& end)
+{
+    assert(curTok.kind == TokenKind::l_brace && "Compound Statement should start with '{'");
+    auto lbrace = curTok;
+    unsigned depth = 0;
+    do
+    {
+        switch (curTok.kind)
+        {
+            case TokenKind::l_brace:
+                depth++;
+                break;
+            case TokenKind::r_brace:
+                depth--;
+                break;
+            case TokenKind::eof:
+                logError("except '}'");
+                addNote("to match this '{'", lbrace);
+                return false;
+            default:
+                break;
+        }
+        end = curTok.offset + curTok.length;
+        if (scan)
+        {
+            scan->tokens.push_back(curTok);
+        }
+        // an unknown token is reported when the body is parsed
+        curTok = tokens.next();
+    } while (depth);
+    if (scan)
+    {
+        scan->tokens.push_back({ TokenKind::eof, 0, end, 0 });
+    }
+    return true;
+}
+
+Stmt* Parser::parseBodyFrom(TokenSource& source, const SourceManager& SM, ASTContext& Ctx, const std::string& sourceFile,
+                            std::vector<StringRef>& names, std::vector<Diagnostic>* diagnostics, size_t& numNodes)
+{
+    Parser parser(source, SM, Ctx, sourceFile);
+    parser.identifiers = std::move(names);
+    parser.diagnostics = diagnostics;
+    parser.getNextTok();
+    Stmt* body = parser.parseCompoundStmt();
+    names = std::move(parser.identifiers);
+    numNodes += parser.numNodes;
+    return body;
+}
+
+Stmt* LazyBodyParser::parseBody(uint32_t begin, uint32_t end)
+{
+    // Identifier ids only key the parser's name cache, so a scratch table will do.
+    IdentifierTable idents;
+    Lexer lexer(SM, idents, SM.getBufferStart() + begin, SM.getBufferStart() + end, false);
+    std::vector<StringRef> names;
+    size_t numNodes = 0;
+    Stmt* body = Parser::parseBodyFrom(lexer, SM, Ctx, sourceFileName.str(), names, nullptr, numNodes);
+    failed |= !body;
+    return body;
 }
 
-unique_ptr<Stmt> Parser::parseDeclStmt()
+Stmt* Parser::parseDeclStmt()
 {
-    std::string type = curTok->content;
+    StringRef type = getIdentifier(curTok);
     getNextTok();
 
-    std::vector<unique_ptr<Decl>> decls;
+    SmallVector<Decl*, 4> decls;
 
     do {
-        std::string name = curTok->content;
+        StringRef name = getIdentifier(curTok);
         getNextTok();
-        if (curTok->kind == TokenKind::l_paren)
+        if (curTok.kind == TokenKind::l_paren)
         {
             auto lparen = curTok;
             //function Decl;
             getNextTok();
-            std::vector<unique_ptr<ParmVarDecl>> paras;
-            while (curTok->kind != TokenKind::r_paren)
+            SmallVector<ParmVarDecl*, 4> paras;
+            while (curTok.kind != TokenKind::r_paren)
             {
                 //Ŀǰֻint
-                if (curTok->kind != TokenKind::kw_int && curTok->kind != TokenKind::kw_void)
+                if (curTok.kind != TokenKind::kw_int && curTok.kind != TokenKind::kw_void)
                 {
-                    logError(("unknown type name '" + curTok->content + "'").c_str());
+                    logError(("unknown type name '" + getSpelling(curTok).str() + "'").c_str());
                     return nullptr;
                 }
-                std::string paraType = curTok->content, paraName;
+                StringRef paraType = getIdentifier(curTok), paraName;
                 getNextTok();
-                if (curTok->kind == TokenKind::identifier)
+                if (curTok.kind == TokenKind::identifier)
                 {
-                    paraName = curTok->content;
+                    paraName = getIdentifier(curTok);
                     getNextTok();
                 }
-                if (curTok->kind != TokenKind::comma && curTok->kind != TokenKind::r_paren)
+                if (curTok.kind != TokenKind::comma && curTok.kind != TokenKind::r_paren)
                 {
                     logError("except ')'");
-                    addNote("to match this '('", lparen->loc);
+                    addNote("to match this '('", lparen);
                     return nullptr;
                 }
-                if (curTok->kind == TokenKind::comma)
+                if (curTok.kind == TokenKind::comma)
                 {
                     getNextTok();
                 }
-                paras.push_back(make_unique<ParmVarDecl>(paraType, paraName));
+                paras.push_back(newNode<ParmVarDecl>(paraType, paraName));
             }
             getNextTok();
-            unique_ptr<Stmt> body = nullptr;
-            if (curTok->kind == TokenKind::l_brace)
+            Stmt* body = nullptr;
+            if (curTok.kind == TokenKind::l_brace)
             {
                 body = parseCompoundStmt();
             }
-            else if (curTok->kind == TokenKind::comma)
+            else if (curTok.kind == TokenKind::comma)
             {
                 getNextTok();
             }
-            else if (curTok->kind != TokenKind::semi)
+            else if (curTok.kind != TokenKind::semi)
             {
                 logError("expected ';' at end of declaration");
                 return nullptr;
             }
-            decls.push_back(make_unique<FunctionDecl>(type, name, paras, std::move(body)));
+            decls.push_back(newNode<FunctionDecl>(type, name, Ctx.copyArray(paras), body));
         }
-        else if (curTok->kind == TokenKind::equal)
+        else if (curTok.kind == TokenKind::equal)
         {
             getNextTok();
-            decls.push_back(make_unique<VarDecl>(type, name, true, parseRValue()));
-            if (curTok->kind == TokenKind::comma)
+            decls.push_back(newNode<VarDecl>(type, name, true, parseRValue()));
+            if (curTok.kind == TokenKind::comma)
             {
                 getNextTok();
             }
-            else if (curTok->kind != TokenKind::semi)
+            else if (curTok.kind != TokenKind::semi)
             {
                 logError("expected ';' at end of declaration");
                 return nullptr;
             }
         }
-        else if (curTok->kind == TokenKind::comma)
+        else if (curTok.kind == TokenKind::comma)
         {
-            decls.push_back(make_unique<VarDecl>(type, name, false));
+            decls.push_back(newNode<VarDecl>(type, name, false));
             getNextTok();
         }
-        else if (curTok->kind == TokenKind::semi)
+        else if (curTok.kind == TokenKind::semi)
         {
-            decls.push_back(make_unique<VarDecl>(type, name, false));
+            decls.push_back(newNode<VarDecl>(type, name, false));
             break;
         }
         else
@@ -572,91 +636,106 @@ unique_ptr<Stmt> Parser::parseDeclStmt()
             logError("expected ';' at end of declaration");
             return nullptr;
         }
-    } while (curTok->kind != TokenKind::semi);
+    } while (curTok.kind != TokenKind::semi);
     getNextTok();
-    return make_unique<DeclStmt>(decls);
+    return newNode<DeclStmt>(Ctx.copyArray(decls));
 }
 
-unique_ptr<Stmt> Parser::parseReturnStmt()
+Stmt* Parser::parseReturnStmt()
 {
-    assert(curTok->kind == TokenKind::kw_return && "Return Statement should be start with 'return'");
+    assert(curTok.kind == TokenKind::kw_return && "Return Statement should be start with 'return'");
     getNextTok(); //eat return
-    if (curTok->kind != TokenKind::semi)
+    if (curTok.kind != TokenKind::semi)
     {
         auto expr = parseRValue();
         if (!expr)
         {
             return nullptr;
         }
-        if (curTok->kind != TokenKind::semi)
+        if (curTok.kind != TokenKind::semi)
         {
             logError("expected ';' after return statement");
             return nullptr;
         }
         getNextTok();
-        return make_unique<ReturnStmt>(std::move(expr));
+        return newNode<ReturnStmt>(expr);
     }
     getNextTok(); //eat semi
-    return make_unique<ReturnStmt>();
+    return newNode<ReturnStmt>();
 }
 
 /// @brief ȫֱĶ
 /// @return 
 /// ʱ֧һȫֱ
-unique_ptr<Decl> Parser::parseTopLevelDecl()
+Decl* Parser::parseTopLevelDecl()
 {
     //curTok is kw_int or kw_void
-    assert(curTok->kind == TokenKind::kw_int || curTok->kind == TokenKind::kw_void || "Expected type name");
-    std::string type = curTok->content;
+    assert(curTok.kind == TokenKind::kw_int || curTok.kind == TokenKind::kw_void || "Expected type name");
+    StringRef type = getIdentifier(curTok);
     getNextTok();
-    if (curTok->kind != TokenKind::identifier)
+    if (curTok.kind != TokenKind::identifier)
     {
         logError("expected identifier");
         return nullptr;
     }
-    std::string name = curTok->content;
+    StringRef name = getIdentifier(curTok);
     getNextTok();
 
-    if (curTok->kind == TokenKind::l_paren)
+    if (curTok.kind == TokenKind::l_paren)
     {
         auto lparen = curTok;
         //function Decl;
         getNextTok();
-        std::vector<unique_ptr<ParmVarDecl>> paras;
-        while (curTok->kind != TokenKind::r_paren)
+        SmallVector<ParmVarDecl*, 4> paras;
+        while (curTok.kind != TokenKind::r_paren)
         {
             //Ŀǰֻintvoid
-            if (curTok->kind != TokenKind::kw_int && curTok->kind != TokenKind::kw_void)
+            if (curTok.kind != TokenKind::kw_int && curTok.kind != TokenKind::kw_void)
             {
-                logError(("unknown type name '" + curTok->content + "'").c_str());
+                logError(("unknown type name '" + getSpelling(curTok).str() + "'").c_str());
                 return nullptr;
             }
-            std::string paraType = curTok->content, paraName;
+            StringRef paraType = getIdentifier(curTok), paraName;
             getNextTok();
-            if (curTok->kind == TokenKind::identifier)
+            if (curTok.kind == TokenKind::identifier)
             {
-                paraName = curTok->content;
+                paraName = getIdentifier(curTok);
                 getNextTok();
             }
-            if (curTok->kind != TokenKind::comma && curTok->kind != TokenKind::r_paren)
+            if (curTok.kind != TokenKind::comma && curTok.kind != TokenKind::r_paren)
             {
                 logError("except ')'");
-                addNote("to match this '('", lparen->loc);
+                addNote("to match this '('", lparen);
                 return nullptr;
             }
-            if (curTok->kind == TokenKind::comma)
+            if (curTok.kind == TokenKind::comma)
             {
                 getNextTok();
             }
-            paras.push_back(make_unique<ParmVarDecl>(paraType, paraName));
+            paras.push_back(newNode<ParmVarDecl>(paraType, paraName));
         }
         getNextTok();
-        unique_ptr<Stmt> body = nullptr;
-        if (curTok->kind == TokenKind::l_brace)
+        Stmt* body = nullptr;
+        if (curTok.kind == TokenKind::l_brace)
         {
+            if (lazyBodies)
+            {
+                uint32_t begin = curTok.offset, end;
+                size_t firstToken = scan ? scan->tokens.size() : 0;
+                if (!skipCompoundStmt(end))
+                {
+                    return nullptr;
+                }
+                auto decl = newNode<FunctionDecl>(type, name, Ctx.copyArray(paras), lazyBodies, begin, end);
+                if (scan)
+                {
+                    scan->bodies.push_back({ decl, firstToken, scan->tokens.size(), scan->diagnostics.size(), {} });
+                }
+                return decl;
+            }
             body = parseCompoundStmt();
         }
-        else if (curTok->kind == TokenKind::semi)
+        else if (curTok.kind == TokenKind::semi)
         {
             getNextTok();
         }
@@ -665,9 +744,9 @@ unique_ptr<Decl> Parser::parseTopLevelDecl()
             logError("expected ';' after top level declarator");
             return nullptr;
         }
-        return make_unique<FunctionDecl>(type, name, paras, std::move(body));
+        return newNode<FunctionDecl>(type, name, Ctx.copyArray(paras), body);
     }
-    else if (curTok->kind == TokenKind::equal)
+    else if (curTok.kind == TokenKind::equal)
     {
         getNextTok();
         auto value = parseBinaryOperator();
@@ -675,21 +754,21 @@ unique_ptr<Decl> Parser::parseTopLevelDecl()
         {
             return nullptr;
         }
-        if (curTok->kind != TokenKind::semi)
+        if (curTok.kind != TokenKind::semi)
         {
             return nullptr;
         }
         getNextTok();
         if (value->getIsLvalue())
         {
-            value = make_unique<ImplicitCastExpr>(std::move(value), "LValueToRValue");
+            value = newNode<ImplicitCastExpr>(value, "LValueToRValue");
         }
-        return make_unique<VarDecl>(type, name, true, std::move(value));
+        return newNode<VarDecl>(type, name, true, value);
     }
-    else if (curTok->kind == TokenKind::semi)
+    else if (curTok.kind == TokenKind::semi)
     {
         getNextTok();
-        return make_unique<VarDecl>(type, name);
+        return newNode<VarDecl>(type, name);
     }
     else
     {
@@ -698,16 +777,98 @@ unique_ptr<Decl> Parser::parseTopLevelDecl()
     }
 }
 
-unique_ptr<Decl> Parser::parse()
+Decl* Parser::parse()
+{
+    if (jobs != 1 && !lazyBodies)
+    {
+        return parseInParallel();
+    }
+    return parseTranslationUnit();
+}
+
+Decl* Parser::parseInParallel()
 {
-    curTok = tokens.begin();
-    std::vector<unique_ptr<Decl>> decls;
-    while (curTok!=tokens.end())
+    // The pre-scan parses everything but the function bodies, whose tokens
+    // it only copies aside.
+    ParallelScan scanned;
+    scan = &scanned;
+    diagnostics = &scanned.diagnostics;
+    setLazyBodies(true);
+    Decl* res = parseTranslationUnit();
+    setLazyBodies(false);
+    diagnostics = nullptr;
+    scan = nullptr;
+
+    // Contiguous batches of about the same number of tokens, one per thread,
+    // so that each thread fills one arena.
+    std::vector<SkippedBody>& bodies = scanned.bodies;
+    llvm::ThreadPoolStrategy strategy = llvm::hardware_concurrency(jobs);
+    size_t batchCount = std::min<size_t>(strategy.compute_thread_count(), bodies.size());
+    std::vector<size_t> batchEnds;
+    for (size_t i = 0; i < bodies.size(); i++)
+    {
+        if (bodies[i].lastToken * batchCount >= scanned.tokens.size() * (batchEnds.size() + 1) || i + 1 == bodies.size())
+        {
+            batchEnds.push_back(i + 1);
+        }
+    }
+    std::vector<size_t> batchNodes(batchEnds.size());
+    std::atomic<bool> failed{ false };
+    auto parseBatch = [&](size_t batch, ASTContext& arena) {
+        std::vector<StringRef> names;
+        for (size_t i = batch ? batchEnds[batch - 1] : 0; i < batchEnds[batch]; i++)
+        {
+            SkippedBody& body = bodies[i];
+            TokenArraySource source(makeArrayRef(scanned.tokens).slice(body.firstToken, body.lastToken - body.firstToken));
+            Stmt* parsed = parseBodyFrom(source, SM, arena, sourceFileName, names, &body.diagnostics, batchNodes[batch]);
+            if (!parsed)
+            {
+                failed = true;
+            }
+            body.decl->setBody(parsed);
+        }
+    };
+    if (batchEnds.size() == 1)
+    {
+        parseBatch(0, Ctx);
+    }
+    else if (!batchEnds.empty())
+    {
+        llvm::ThreadPool pool(strategy);
+        for (size_t batch = 0; batch < batchEnds.size(); batch++)
+        {
+            ASTContext& arena = Ctx.createChild();
+            pool.async([&parseBatch, &arena, batch] { parseBatch(batch, arena); });
+        }
+        pool.wait();
+    }
+
+    size_t printed = 0;
+    for (const SkippedBody& body : bodies)
+    {
+        printDiagnostics(makeArrayRef(scanned.diagnostics).slice(printed, body.scanDiagnostics - printed));
+        printed = body.scanDiagnostics;
+        printDiagnostics(body.diagnostics);
+    }
+    printDiagnostics(makeArrayRef(scanned.diagnostics).drop_front(printed));
+    for (size_t nodes : batchNodes)
+    {
+        numNodes += nodes;
+    }
+    // as parseTranslationUnit would have failed at the first bad body
+    return failed ? nullptr : res;
+}
+
+Decl* Parser::parseTranslationUnit()
+{
+    getNextTok();
+    SmallVector<Decl*, 32> decls;
+    while (true)
     {
-        switch (curTok->kind)
+        switch (curTok.kind)
         {
             case TokenKind::eof:
-                return make_unique<TranslationUnitDecl>(decls);
+                return newNode<TranslationUnitDecl>(Ctx.copyArray(decls));
             case TokenKind::kw_int:
             case TokenKind::kw_void:
                 decls.push_back(parseTopLevelDecl());
@@ -717,7 +878,6 @@ unique_ptr<Decl> Parser::parse()
                 return nullptr;
         }
     }
-    return make_unique<TranslationUnitDecl>(decls);
 }
 
 
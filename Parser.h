@@ -4,22 +4,21 @@
 #include <vector>
 #include <string>
 #include <iostream>
-#include <map>
+#include "ASTContext.h"
 #include "Expr.h"
 #include "token.h"
+#include "SourceManager.h"
+#include "TokenStream.h"
 #include "Decl.h"
 #include "Stmt.h"
 
 using namespace AST;
 
-using std::make_unique;
-using std::unique_ptr;
-
 
 /**
  * @brief ȼѭC/C++
 */
-enum class precLevel {
+enum class precLevel : uint8_t {
     Unknown = 0,    // Not binary operator.
     Comma = 1,    // ,
     Assignment = 2,    // =, *=, /=, %=, +=, -=, <<=, >>=, &=, ^=, |=
@@ -38,71 +37,274 @@ enum class precLevel {
     //PointerToMember = 15    // .*, ->*
 };
 
+/**
+ * @brief Parses a skipped function body by lexing just its '{' ... '}' again.
+ *
+ * Lives in the ASTContext of the AST it fills in, next to the nodes that
+ * point at it. The SourceManager must outlive the AST.
+*/
+class LazyBodyParser : public LazyBodySource
+{
+    const SourceManager& SM;
+    ASTContext& Ctx;
+    StringRef sourceFileName;
+
+public:
+    LazyBodyParser(const SourceManager& SM, ASTContext& Ctx, StringRef sourceFile) : SM(SM), Ctx(Ctx), sourceFileName(sourceFile) {}
+    Stmt* parseBody(uint32_t begin, uint32_t end) override;
+};
+
 class Parser
 {
     std::string sourceFileName;
-    std::map<BinaryOperatorKind, int> binopPrecedence;
-    std::vector<Token> tokens;
-    std::vector<Token>::iterator curTok;
-    std::vector<Token>::iterator getNextTok()
+    const SourceManager& SM;
+    ASTContext& Ctx;
+    TokenStream tokens;
+    Token curTok;
+    /// Number of AST nodes built so far.
+    size_t numNodes = 0;
+    /// Set when top-level function bodies are skipped rather than parsed.
+    LazyBodySource* lazyBodies = nullptr;
+    /// Threads for parse(); 1 parses on the calling thread only.
+    unsigned jobs = 1;
+
+    /// A diagnostic held back so that diagnostics from several threads can be
+    /// printed in source order.
+    struct Diagnostic
+    {
+        std::string prompt;
+        Token tok;
+    };
+    /// Collects diagnostics instead of printing them when set.
+    std::vector<Diagnostic>* diagnostics = nullptr;
+
+    /// A top-level function body skipped in the pre-scan of a parallel parse.
+    struct SkippedBody
+    {
+        FunctionDecl* decl;
+        /// Its tokens in ParallelScan::tokens, ending with a made-up eof
+        size_t firstToken, lastToken;
+        /// How many pre-scan diagnostics come before the body in source order.
+        size_t scanDiagnostics;
+        std::vector<Diagnostic> diagnostics;
+    };
+    /// What the pre-scan of a parallel parse leaves for the threads.
+    struct ParallelScan
+    {
+        std::vector<Diagnostic> diagnostics;
+        std::vector<SkippedBody> bodies;
+        std::vector<Token> tokens;
+    };
+    /// Set during the pre-scan; skipped bodies and their tokens are kept in it.
+    ParallelScan* scan = nullptr;
+
+    friend LazyBodyParser;
+
+    template <typename T, typename... Args>
+    T* newNode(Args&&... args)
+    {
+        numNodes++;
+        return new (Ctx) T(std::forward<Args>(args)...);
+    }
+
+    /// Interned names indexed by the identifier id of their tokens.
+    std::vector<StringRef> identifiers;
+
+    /// Names and type names are kept in Ctx, so the AST outlives the source buffer.
+    StringRef getIdentifier(const Token& tok)
+    {
+        if (tok.identID == 0)
+        {
+            return Ctx.intern(getSpelling(tok));
+        }
+        // each distinct identifier is hashed into Ctx only once
+        if (tok.identID >= identifiers.size())
+        {
+            identifiers.resize(tok.identID + 1);
+        }
+        StringRef& name = identifiers[tok.identID];
+        if (!name.data())
+        {
+            name = Ctx.intern(getSpelling(tok));
+        }
+        return name;
+    }
+
+    const Token& getNextTok()
     {
-        //std::clog << "curToken:" << curTok->getKindName() << " " << curTok->content << std::endl;
-        return ++curTok;
+        curTok = tokens.next();
+        if (curTok.kind == TokenKind::unknown)
+        {
+            // the only unknown token the lexer makes
+            logError("token is longer than 65535 characters");
+        }
+        //std::clog << "curToken:" << curTok.getKindName() << " " << getSpelling(curTok).str() << std::endl;
+        return curTok;
+    }
+
+    StringRef getSpelling(const Token& tok) const
+    {
+        return SM.getSpelling(tok);
     }
 
     void logError(const char* prompt)
     {
-        std::cerr << sourceFileName << ":" << curTok->loc.row << ":" << curTok->loc.col << ": error: " << prompt << std::endl;
+        addNote(prompt, curTok);
+    }
+
+    void addNote(const char* prompt, const Token& tok)
+    {
+        if (diagnostics)
+        {
+            diagnostics->push_back({ prompt, tok });
+            return;
+        }
+        printDiagnostic(prompt, tok);
     }
 
-    void addNote(const char* prompt, Location loc)
+    void printDiagnostic(const std::string& prompt, const Token& tok) const
     {
+        Location loc = SM.getLocation(tok);
         std::cerr << sourceFileName << ":" << loc.row << ":" << loc.col << ": error: " << prompt << std::endl;
     }
 
-    precLevel getBinOpPrecedence(TokenKind opcode);
+    void printDiagnostics(ArrayRef<Diagnostic> diags) const
+    {
+        for (const Diagnostic& diag : diags)
+        {
+            printDiagnostic(diag.prompt, diag.tok);
+        }
+    }
 
-    BinaryOperatorKind getBinOpKind(TokenKind opcode);
+    /**
+     * @brief An expression parse waiting for an operand.
+     *
+     * parseBinaryOperator keeps these on an explicit stack where a recursive
+     * descent parser would keep call frames, so nesting depth costs heap
+     * rather than native stack.
+    */
+    struct ExprFrame
+    {
+        enum Kind : uint8_t
+        {
+            /// Unary (op Primary)*, waiting for its first operand
+            Expression,
+            /// A prefix operator, waiting for its operand
+            Prefix,
+            /// The first operand, which may be followed by '++' or '--'
+            Postfix,
+            /// LHS op, waiting for the primary after op
+            Operand,
+            /// LHS op, waiting for a right-hand side of tighter operators
+            RHS,
+            /// '(' Expr, waiting for ')'
+            Paren,
+            /// name '(' Paras, waiting for the next argument
+            Call,
+        };
+        Kind kind;
+        /// Operand: the precedence of op
+        precLevel prec = precLevel::Unknown;
+        /// Operand and RHS: the precedence below which the operator chain ends
+        precLevel minPrec = precLevel::Unknown;
+        BinaryOperatorKind binOp = BinaryOperatorKind();
+        /// Operand and RHS: where op is, for diagnostics
+        uint32_t opOffset = 0;
+        UnaryOperatorKind unaryOp = UnaryOperatorKind();
+        /// Paren and Call: the '(' for diagnostics
+        Token lparen = {};
+        /// Call: where its arguments start on the argument stack
+        uint32_t argsBegin = 0;
+        /// Operand and RHS: the left operand; Call: the callee
+        Expr* LHS = nullptr;
 
-    UnaryOperatorKind getUnaryOpKind(TokenKind opcode);
+        ExprFrame(Kind kind) : kind(kind) {}
+    };
 
-    unique_ptr<Expr> parseIntegerLiteral();
+    static precLevel getBinOpPrecedence(TokenKind opcode);
 
-    unique_ptr<Expr> parseParenExpr();
+    static BinaryOperatorKind getBinOpKind(TokenKind opcode);
 
-    unique_ptr<Expr> parseRefOrCall();
+    UnaryOperatorKind getUnaryOpKind(TokenKind opcode);
 
-    unique_ptr<Expr> parsePrimary();
+    Expr* parseIntegerLiteral();
 
-    unique_ptr<Expr> parseRHSOfBinaryExpression(unique_ptr<Expr> LHS, precLevel minPrec);
+    Expr* parseExpression();
 
-    unique_ptr<Expr> parseExpression();
+    Expr* parseRValue();
 
-    unique_ptr<Expr> parseRValue();
+    Expr* parseBinaryOperator();
 
-    unique_ptr<Expr> parseUnaryOperator();
+    Stmt* parseStmt();
 
-    unique_ptr<Expr> parseBinaryOperator();
+    Stmt* parseNullStmt();
 
-    unique_ptr<Stmt> parseStmt();
+    Stmt* parseValueStmt();
 
-    unique_ptr<Stmt> parseNullStmt();
+    Stmt* parseIfStmt();
 
-    unique_ptr<Stmt> parseValueStmt();
+    Stmt* parseWhileStmt();
 
-    unique_ptr<Stmt> parseIfStmt();
+    Stmt* parseCompoundStmt();
 
-    unique_ptr<Stmt> parseWhileStmt();
+    /// Skips a compound statement by counting braces, without building nodes.
+    /// @param end Receives the offset just past its '}'
+    bool skipCompoundStmt(uint32_t& end);
 
-    unique_ptr<Stmt> parseCompoundStmt();
+    Stmt* parseDeclStmt();
 
-    unique_ptr<Stmt> parseDeclStmt();
+    Stmt* parseReturnStmt();
 
-    unique_ptr<Stmt> parseReturnStmt();
+    Decl* parseTopLevelDecl();
 
-    unique_ptr<Decl> parseTopLevelDecl();
+    Decl* parseTranslationUnit();
+
+    Decl* parseInParallel();
+
+    /// Parses the compound statement that is all of source with a parser of
+    /// its own, which builds its nodes in Ctx.
+    /// @param names The name cache of the parser, kept across calls
+    /// @return The body, or nullptr after a syntax error
+    static Stmt* parseBodyFrom(TokenSource& source, const SourceManager& SM, ASTContext& Ctx, const std::string& sourceFile,
+                               std::vector<StringRef>& names, std::vector<Diagnostic>* diagnostics, size_t& numNodes);
 
 public:
-    Parser(const std::vector<Token>& tokens, const std::string& sourceFile) :tokens(tokens), sourceFileName(sourceFile) {}
-    unique_ptr<Decl> parse();
+    /// @param Ctx Owns every node of the parsed AST
+    Parser(TokenSource& source, const SourceManager& SM, ASTContext& Ctx, const std::string& sourceFile) :sourceFileName(sourceFile), SM(SM), Ctx(Ctx), tokens(source) {}
+    Decl* parse();
+    /**
+     * @brief Whether parse() skips the bodies of top-level functions.
+     *
+     * A skipped body is only matched brace by brace; it is parsed when
+     * FunctionDecl::getBody is first called, and its syntax errors are
+     * reported then.
+    */
+    void setLazyBodies(bool lazy)
+    {
+        lazyBodies = lazy ? new (Ctx) LazyBodyParser(SM, Ctx, Ctx.intern(sourceFileName)) : nullptr;
+    }
+    /// Whether a skipped body has failed to parse so far. Such a function
+    /// looks like a prototype, so the caller has to check this after the
+    /// bodies it needs have been parsed.
+    bool hasFailedBodies() const
+    {
+        return lazyBodies && lazyBodies->hasFailed();
+    }
+    /**
+     * @brief Number of threads parse() uses, 0 for every hardware thread.
+     *
+     * With more than one, a pre-scan parses the top-level declarations and
+     * skips the function bodies by brace matching; the bodies are then parsed
+     * on a thread pool, each thread into an arena of its own owned by Ctx.
+     * Diagnostics are printed afterwards in source order. Lazy bodies take
+     * precedence: nothing is parsed in parallel then.
+    */
+    void setJobs(unsigned n)
+    {
+        jobs = n;
+    }
+    size_t getNumNodes() const
+    {
+        return numNodes;
+    }
 };
\ No newline at end of file
@@ -0,0 +1,244 @@
+/** @file Repl.cpp
+* @brief Reading the session, and compiling each input into a module of its own
+**/
+
+#include <algorithm>
+#include <iostream>
+#include "Repl.h"
+#include "lexer.h"
+#include "Parser.h"
+
+#pragma warning(push, 0)
+#include "llvm/Support/Process.h"
+#pragma warning(pop)
+
+std::unique_ptr<Repl> Repl::create(StringRef cpu, StringRef features, OptimizationLevel level)
+{
+    auto TM = CodeGenerator::createTargetMachine(cpu, features, level);
+    std::unique_ptr<JIT> jit = TM ? JIT::create(*TM) : nullptr;
+    if (!jit)
+    {
+        return nullptr;
+    }
+    std::unique_ptr<Repl> repl(new Repl(std::move(jit), level));
+    if (!repl->generator.setTarget(cpu, features, level))
+    {
+        return nullptr;
+    }
+    repl->generator.discardValueNames();
+    return repl;
+}
+
+int Repl::run()
+{
+    bool interactive = sys::Process::StandardInIsUserInput();
+    std::string input;
+    std::string line;
+    int depth = 0;
+    while (true)
+    {
+        if (interactive)
+        {
+            std::cout << (input.empty() ? "tcc> " : "...> ") << std::flush;
+        }
+        if (!std::getline(std::cin, line))
+        {
+            break;
+        }
+        for (char c : line)
+        {
+            depth += c == '{' ? 1 : c == '}' ? -1 : 0;
+        }
+        input += line;
+        input += '\n';
+        // An input is complete once its braces are closed and it ends a
+        // statement or a function, so a definition may span several lines.
+        StringRef text = StringRef(input).rtrim();
+        if (text.empty())
+        {
+            input.clear();
+        }
+        else if (depth <= 0 && (text.endswith(";") || text.endswith("}")))
+        {
+            process(text);
+            input.clear();
+            depth = 0;
+        }
+    }
+    if (!StringRef(input).trim().empty())
+    {
+        process(input);
+    }
+    if (interactive)
+    {
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+void Repl::process(StringRef input)
+{
+    std::vector<Token> tokens;
+    const SourceManager& SM = addSource(input.str(), tokens);
+    if (tokens.front().kind != TokenKind::kw_int && tokens.front().kind != TokenKind::kw_void)
+    {
+        execute(input);
+        return;
+    }
+    Decl* tu = parse(tokens, SM);
+    if (!tu)
+    {
+        return;
+    }
+    for (Decl* decl : cast<TranslationUnitDecl>(tu)->getDecls())
+    {
+        if (decl)
+        {
+            define(*decl, SM);
+        }
+    }
+}
+
+const SourceManager& Repl::addSource(std::string text, std::vector<Token>& tokens)
+{
+    sources.push_back(std::make_unique<SourceManager>(MemoryBuffer::getMemBufferCopy(text, "<stdin>")));
+    Lexer lexer(*sources.back(), idents);
+    Token tok;
+    while (lexer.Lex(tok))
+    {
+        tokens.push_back(tok);
+    }
+    return *sources.back();
+}
+
+Decl* Repl::parse(ArrayRef<Token> tokens, const SourceManager& SM)
+{
+    TokenArraySource source(tokens);
+    return Parser(source, SM, context, "<stdin>").parse();
+}
+
+orc::ThreadSafeModule Repl::takeModule()
+{
+    bool valid = generator.getErrors().empty();
+    for (const auto& err : generator.getErrors())
+    {
+        std::cerr << err << std::endl;
+    }
+    // emitFunction has reported what is wrong
+    if (valid && verifyModule(generator.getModule()))
+    {
+        std::cerr << "Can't run invalid IR" << std::endl;
+        valid = false;
+    }
+    if (valid)
+    {
+        generator.optimize(level);
+    }
+    orc::ThreadSafeModule module = generator.takeModule();
+    return valid ? std::move(module) : orc::ThreadSafeModule();
+}
+
+void Repl::define(const Decl& decl, const SourceManager& SM)
+{
+    sema.bindTopLevel(decl);
+    if (!ASTFolder(context, SM, "<stdin>").fold(decl))
+    {
+        return;
+    }
+    generator.gen(decl);
+    orc::ThreadSafeModule module = takeModule();
+    auto* function = dyn_cast<FunctionDecl>(&decl);
+    if (!module || (function && !function->getBody()))
+    {
+        // a prototype only declares the function to what follows
+        return;
+    }
+    if (!function)
+    {
+        jit->addModule(std::move(module));
+        return;
+    }
+
+    std::string implName = (function->getName() + "$" + Twine(++numCompiled)).str();
+    module.withModuleDo([&](Module& M) { M.getFunction(function->getName())->setName(implName); });
+    orc::ResourceTrackerSP tracker = jit->createTracker();
+    void* implementation = jit->addModule(std::move(module), tracker) ? jit->lookup(implName) : nullptr;
+    if (!implementation || !jit->setStub(function->getName(), implementation))
+    {
+        jit->remove(tracker);
+        return;
+    }
+    // callers go through the stub, so nothing refers to the old code any more
+    orc::ResourceTrackerSP& code = functionCode[function->getName()];
+    if (code)
+    {
+        jit->remove(code);
+    }
+    code = tracker;
+}
+
+void Repl::execute(StringRef input)
+{
+    // An expression statement is tried as a return value first, and as a
+    // plain statement if it turns out to be void.
+    for (bool isVoid = false;; isVoid = true)
+    {
+        std::string wrapper = isVoid ? "void statement() { }" : "int statement() { return }";
+        std::vector<Token> tokens;
+        const SourceManager& SM = addSource(input.str() + "\n" + wrapper, tokens);
+        // The function is spliced around the tokens of the input, so that
+        // diagnostics still point into the input.
+        auto wrapperBegin = std::partition_point(tokens.begin(), tokens.end(),
+            [&](const Token& tok) { return tok.offset < input.size(); });
+        if (tokens.end() - wrapperBegin != (isVoid ? 7 : 8))
+        {
+            std::cerr << "<stdin>: error: unterminated comment" << std::endl;
+            return;
+        }
+        // only a single expression statement has a value
+        TokenKind first = tokens.front().kind;
+        auto semi = std::find_if(tokens.begin(), wrapperBegin, [](const Token& tok) { return tok.kind == TokenKind::semi; });
+        if (!isVoid && (first == TokenKind::kw_if || first == TokenKind::kw_while || first == TokenKind::kw_return ||
+                        first == TokenKind::l_brace || semi + 1 != wrapperBegin))
+        {
+            continue;
+        }
+        std::vector<Token> spliced(wrapperBegin, tokens.end() - 2);
+        spliced.insert(spliced.end(), tokens.begin(), wrapperBegin);
+        spliced.insert(spliced.end(), tokens.end() - 2, tokens.end());
+        Decl* tu = parse(spliced, SM);
+        if (!tu)
+        {
+            return;
+        }
+        // renamed to something no input can refer to
+        auto* parsed = cast<FunctionDecl>(cast<TranslationUnitDecl>(tu)->getDecls().front());
+        std::string name = "__stmt" + std::to_string(++numCompiled);
+        auto* function = new (context) FunctionDecl(parsed->getReturnType(), context.intern(name), parsed->getParams(), parsed->getBody());
+        sema.bindTopLevel(*function);
+        if (!isVoid)
+        {
+            auto* value = cast<ReturnStmt>(cast<CompoundStmt>(function->getBody())->body.front())->getRetValue();
+            if (!value || value->getType() == TypeKind::Void)
+            {
+                continue;
+            }
+        }
+        ASTFolder(context, SM, "<stdin>").fold(*function);
+
+        generator.gen(*function);
+        orc::ThreadSafeModule module = takeModule();
+        orc::ResourceTrackerSP tracker = jit->createTracker();
+        void* statement = module && jit->addModule(std::move(module), tracker) ? jit->lookup(name) : nullptr;
+        if (statement && isVoid)
+        {
+            reinterpret_cast<void (*)()>(statement)();
+        }
+        else if (statement)
+        {
+            std::cout << reinterpret_cast<int (*)()>(statement)() << std::endl;
+        }
+        jit->remove(tracker);
+        return;
+    }
+}
@@ -0,0 +1,85 @@
+/** @file Repl.h
+* @brief tcc --repl: declarations and statements run one at a time on a JIT
+**/
+
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "ASTContext.h"
+#include "ASTFolder.h"
+#include "CodeGenerator.h"
+#include "IdentifierTable.h"
+#include "JIT.h"
+#include "Sema.h"
+#include "SourceManager.h"
+#include "token.h"
+
+#pragma warning(push, 0)
+#include "llvm/ADT/StringMap.h"
+#pragma warning(pop)
+
+/**
+ * @brief Reads top-level declarations and expression statements from stdin
+ * and runs each as soon as it is complete.
+ *
+ * Every declaration is lexed, parsed, bound and generated on its own, into a
+ * module of its own, so entering one costs what compiling that declaration
+ * alone does however long the session is. Sema keeps the file scope open,
+ * and the generator declares what earlier modules defined where it is used,
+ * for the JIT to link.
+ *
+ * Functions are called through stubs of the JIT. A definition of f is
+ * compiled at once as f$N and the stub of f pointed at it, so redefining f
+ * frees the old code without compiling its callers again. A function has to
+ * be defined before one that calls it is entered. Variables can't be
+ * redefined, as in C.
+ *
+ * Anything that does not start with int or void is a statement. It becomes
+ * the body of a function that is called at once and then freed, and the value
+ * of an expression statement is printed unless it is void.
+*/
+class Repl
+{
+    std::unique_ptr<JIT> jit;
+    OptimizationLevel level;
+    IdentifierTable idents;
+    ASTContext context;
+    Sema sema{ context };
+    CodeGenerator generator;
+    /// The source of every input; the AST refers to it.
+    std::vector<std::unique_ptr<SourceManager>> sources;
+    /// The code of each function defined so far.
+    StringMap<orc::ResourceTrackerSP> functionCode;
+    /// Numbers the names of implementations and statement functions.
+    unsigned numCompiled = 0;
+
+    Repl(std::unique_ptr<JIT> jit, OptimizationLevel level) : jit(std::move(jit)), level(level) {}
+
+    /// Lexes text, which is kept for the rest of the session, into tokens,
+    /// eof included.
+    const SourceManager& addSource(std::string text, std::vector<Token>& tokens);
+    /// Parses tokens into a TranslationUnitDecl, or null after saying why.
+    Decl* parse(ArrayRef<Token> tokens, const SourceManager& SM);
+    /// The module generated for a declaration or statement, optimized, or
+    /// null after saying why generating it failed.
+    orc::ThreadSafeModule takeModule();
+    /// Compiles a declaration parsed from SM, the source of the latest input.
+    void define(const Decl& decl, const SourceManager& SM);
+    void execute(StringRef input);
+
+public:
+    /// A session that generates code for cpu and features at level, or null
+    /// if the JIT can't be created.
+    static std::unique_ptr<Repl> create(StringRef cpu, StringRef features, OptimizationLevel level);
+
+    /// See CodeGenerator::setSSA.
+    void setSSA(bool enable)
+    {
+        generator.setSSA(enable);
+    }
+    /// Reads and runs stdin until it ends, prompting if a user types it.
+    int run();
+    /// Runs one complete input: declarations, or a statement.
+    void process(StringRef input);
+};
@@ -0,0 +1,253 @@
+/** @file Sema.cpp
+* @brief Name binding with a scoped symbol table, and expression types
+**/
+
+#include "Sema.h"
+
+bool Sema::traverseTranslationUnitDecl(const TranslationUnitDecl& decl)
+{
+    Scope fileScope(symbols);
+    for (const Decl* child : decl.getDecls())
+    {
+        traverse(child);
+    }
+    return true;
+}
+
+bool Sema::traverseFunctionDecl(const FunctionDecl& decl)
+{
+    auto slot = functionSlots.try_emplace(decl.getName(), static_cast<unsigned>(functionSlots.size()));
+    modify(decl).setSlot(slot.first->second);
+    symbols.insert(decl.getName(), { &decl, depth });
+
+    Stmt* body = decl.getBody();
+    if (!body)
+    {
+        return true;
+    }
+    unsigned outerLocals = numLocals;
+    numLocals = 0;
+    returnType = decl.getReturnType() == "void" ? TypeKind::Void : TypeKind::Int;
+    {
+        Scope functionScope(symbols);
+        depth++;
+        for (const ParmVarDecl* para : decl.getParams())
+        {
+            // a repeated parameter name simply shadows the earlier one
+            modify(*para).setStorage(false, numLocals++);
+            symbols.insert(para->getName(), { para, depth });
+        }
+        if (auto* compound = dyn_cast<CompoundStmt>(body))
+        {
+            for (const Stmt* stmt : compound->body)
+            {
+                traverse(stmt);
+            }
+        }
+        else
+        {
+            traverse(body);
+        }
+        depth--;
+    }
+    modify(decl).setNumLocals(numLocals);
+    numLocals = outerLocals;
+    return true;
+}
+
+bool Sema::traverseVarDecl(const VarDecl& decl)
+{
+    // The initializer still sees what the name meant before.
+    traverse(decl.getInit());
+    modify(decl).setInit(convert(decl.getInit(), TypeKind::Int));
+    declareVar(decl);
+    return true;
+}
+
+void Sema::declareVar(const VarDecl& decl)
+{
+    Binding previous = symbols.lookup(decl.getName());
+    if (previous.decl && previous.depth == depth && isa<VarDecl>(previous.decl))
+    {
+        modify(decl).setInvalid();
+        return;
+    }
+    modify(decl).setStorage(depth == 0, depth == 0 ? numGlobals++ : numLocals++);
+    symbols.insert(decl.getName(), { &decl, depth });
+}
+
+bool Sema::traverseCompoundStmt(const CompoundStmt& stmt)
+{
+    Scope blockScope(symbols);
+    depth++;
+    for (const Stmt* child : stmt.body)
+    {
+        traverse(child);
+    }
+    depth--;
+    return true;
+}
+
+bool Sema::traverseIfStmt(const IfStmt& stmt)
+{
+    traverse(stmt.getCond());
+    modify(stmt).setCond(convert(stmt.getCond(), TypeKind::Bool));
+    traverse(stmt.getThen());
+    traverse(stmt.getElse());
+    return true;
+}
+
+bool Sema::traverseWhileStmt(const WhileStmt& stmt)
+{
+    traverse(stmt.getCond());
+    modify(stmt).setCond(convert(stmt.getCond(), TypeKind::Bool));
+    traverse(stmt.getBody());
+    return true;
+}
+
+bool Sema::traverseReturnStmt(const ReturnStmt& stmt)
+{
+    traverse(stmt.getRetValue());
+    modify(stmt).setRetValue(convert(stmt.getRetValue(), returnType));
+    return true;
+}
+
+bool Sema::traverseBinaryOperator(const AST::BinaryOperator& expr)
+{
+    traverse(expr.getLHS());
+    traverse(expr.getRHS());
+    AST::BinaryOperator& op = modify(expr);
+    if (!op.getLHS() || !op.getRHS())
+    {
+        return true;
+    }
+    if (op.isAssignment())
+    {
+        // the left side stays the variable stored to
+        op.setRHS(convert(op.getRHS(), TypeKind::Int));
+        op.setType(TypeKind::Int);
+        return true;
+    }
+    TypeKind operands = TypeKind::Int;
+    TypeKind result = TypeKind::Int;
+    switch (op.getOpKind())
+    {
+        case BinaryOperatorKind::BO_LAnd:
+        case BinaryOperatorKind::BO_LOr:
+            operands = TypeKind::Bool;
+            result = TypeKind::Bool;
+            break;
+        case BinaryOperatorKind::BO_EQ:
+        case BinaryOperatorKind::BO_NE:
+            // two bools compare as they are; i1 equality means the same as on 0 and 1
+            if (op.getLHS()->getType() == TypeKind::Bool && op.getRHS()->getType() == TypeKind::Bool)
+            {
+                operands = TypeKind::Bool;
+            }
+            result = TypeKind::Bool;
+            break;
+        case BinaryOperatorKind::BO_LT:
+        case BinaryOperatorKind::BO_GT:
+        case BinaryOperatorKind::BO_LE:
+        case BinaryOperatorKind::BO_GE:
+            result = TypeKind::Bool;
+            break;
+        default:
+            break;
+    }
+    op.setLHS(convert(op.getLHS(), operands));
+    op.setRHS(convert(op.getRHS(), operands));
+    op.setType(result);
+    return true;
+}
+
+bool Sema::traverseUnaryOperator(const AST::UnaryOperator& expr)
+{
+    traverse(expr.getSubExpr());
+    AST::UnaryOperator& op = modify(expr);
+    if (op.isIncrementDecrementOp())
+    {
+        // the operand stays the variable stored to
+        op.setType(TypeKind::Int);
+        return true;
+    }
+    TypeKind type = op.getOpKind() == UnaryOperatorKind::UO_LNot ? TypeKind::Bool : TypeKind::Int;
+    op.setSubExpr(convert(op.getSubExpr(), type));
+    op.setType(type);
+    return true;
+}
+
+bool Sema::traverseParenExpr(const ParenExpr& expr)
+{
+    // Nested parentheses are walked in a loop; they may go deeper than the stack.
+    const Expr* inner = &expr;
+    while (auto* paren = dyn_cast_or_null<ParenExpr>(inner))
+    {
+        inner = paren->getSubExpr();
+    }
+    traverse(inner);
+    TypeKind type = inner ? inner->getType() : TypeKind::Int;
+    for (const Expr* E = &expr; E != inner; E = cast<ParenExpr>(E)->getSubExpr())
+    {
+        modify(*E).setType(type);
+    }
+    return true;
+}
+
+bool Sema::traverseCallExpr(const CallExpr& expr)
+{
+    traverse(expr.getCallee());
+    CallExpr& call = modify(expr);
+    for (size_t i = 0; i < call.getArgs().size(); i++)
+    {
+        traverse(call.getArgs()[i]);
+        call.setArg(i, convert(call.getArgs()[i], TypeKind::Int));
+    }
+    auto* callee = dyn_cast_or_null<FunctionDecl>(cast<DeclRefExpr>(call.getCallee())->getDecl());
+    call.setType(callee && callee->getReturnType() == "void" ? TypeKind::Void : TypeKind::Int);
+    return true;
+}
+
+bool Sema::traverseImplicitCastExpr(const ImplicitCastExpr& expr)
+{
+    // only the parser's LValueToRValue casts exist yet
+    traverse(expr.getSubExpr());
+    modify(expr).setType(expr.getSubExpr()->getType());
+    return true;
+}
+
+bool Sema::visitDeclRefExpr(const DeclRefExpr& expr)
+{
+    modify(expr).setDecl(symbols.lookup(expr.getName()).decl);
+    return true;
+}
+
+Expr* Sema::convert(Expr* E, TypeKind to)
+{
+    if (!E)
+    {
+        return nullptr;
+    }
+    if (E->getIsLvalue())
+    {
+        TypeKind type = E->getType();
+        E = new (Ctx) ImplicitCastExpr(E, "LValueToRValue");
+        E->setType(type);
+    }
+    const char* castKind = nullptr;
+    if (to == TypeKind::Bool && E->getType() == TypeKind::Int)
+    {
+        castKind = "IntegralToBoolean";
+    }
+    else if (to == TypeKind::Int && E->getType() == TypeKind::Bool)
+    {
+        castKind = "IntegralCast";
+    }
+    if (!castKind)
+    {
+        return E;
+    }
+    E = new (Ctx) ImplicitCastExpr(E, castKind);
+    E->setType(to);
+    return E;
+}
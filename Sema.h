@@ -0,0 +1,113 @@
+/** @file Sema.h
+* @brief Binds the names of an AST to their declarations and types its expressions
+**/
+
+#pragma once
+#include <memory>
+#include "ASTContext.h"
+#include "ASTVisitor.h"
+
+#pragma warning(push, 0)
+#include "llvm/ADT/ScopedHashTable.h"
+#include "llvm/ADT/StringMap.h"
+#pragma warning(pop)
+
+using namespace AST;
+
+/**
+ * @brief Resolves every DeclRefExpr, callees included, to the declaration it
+ * names, and numbers variables and functions so that codegen can keep their
+ * values in arrays instead of looking names up.
+ *
+ * Names live in a ScopedHashTable: entering a block costs nothing, and leaving
+ * it removes just the names the block declared. A variable defined twice in
+ * one scope is marked invalid and left out, so its uses bind to the first
+ * definition. The parameters and the outermost block of a function share a
+ * scope, as in C; inner blocks may shadow anything.
+ *
+ * Every expression also gets a type. Comparisons and logical operators are
+ * bool, so that codegen keeps them as i1; wherever a value of one type is
+ * used as the other, an ImplicitCastExpr allocated in the context says so,
+ * and an lvalue read as a value gets its LValueToRValue cast here as well.
+*/
+class Sema : public RecursiveASTVisitor<Sema>
+{
+    struct Binding
+    {
+        const Decl* decl = nullptr;
+        /// 0 for file scope
+        unsigned depth = 0;
+    };
+    using SymbolTable = llvm::ScopedHashTable<StringRef, Binding>;
+    using Scope = llvm::ScopedHashTableScope<StringRef, Binding>;
+
+    ASTContext& Ctx;
+    SymbolTable symbols;
+    /// The file scope of bindTopLevel, open for as long as Sema lives.
+    std::unique_ptr<Scope> sessionScope;
+    unsigned depth = 0;
+    unsigned numGlobals = 0;
+    /// Locals of the function being bound.
+    unsigned numLocals = 0;
+    /// The slot of every function name, shared by its redeclarations.
+    llvm::StringMap<unsigned> functionSlots;
+    /// What the return values of the function being bound convert to.
+    TypeKind returnType = TypeKind::Int;
+
+    void declareVar(const VarDecl& decl);
+    /// E read as a value of type to, or E itself if it already is one. Void
+    /// only asks for an rvalue.
+    Expr* convert(Expr* E, TypeKind to);
+
+    /// RecursiveASTVisitor hands out const nodes; Sema is the pass that fills
+    /// them in.
+    template <typename T>
+    static T& modify(const T& node)
+    {
+        return const_cast<T&>(node);
+    }
+
+public:
+    /// Casts Sema adds are allocated in Ctx, the context of the AST.
+    explicit Sema(ASTContext& Ctx) : Ctx(Ctx) {}
+
+    /// Binds the whole program; root is usually a TranslationUnitDecl.
+    void bind(const Decl& root)
+    {
+        traverse(&root);
+    }
+    /// Binds one declaration of a file scope that stays open, so that the
+    /// declarations bound after it see it; tcc --repl binds its session this
+    /// way, a declaration at a time.
+    void bindTopLevel(const Decl& decl)
+    {
+        if (!sessionScope)
+        {
+            sessionScope = std::make_unique<Scope>(symbols);
+        }
+        traverse(&decl);
+    }
+
+    bool traverseTranslationUnitDecl(const TranslationUnitDecl& decl);
+    bool traverseFunctionDecl(const FunctionDecl& decl);
+    bool traverseVarDecl(const VarDecl& decl);
+    bool traverseCompoundStmt(const CompoundStmt& stmt);
+    bool traverseIfStmt(const IfStmt& stmt);
+    bool traverseWhileStmt(const WhileStmt& stmt);
+    bool traverseReturnStmt(const ReturnStmt& stmt);
+    bool traverseBinaryOperator(const AST::BinaryOperator& expr);
+    bool traverseUnaryOperator(const AST::UnaryOperator& expr);
+    bool traverseParenExpr(const ParenExpr& expr);
+    bool traverseCallExpr(const CallExpr& expr);
+    bool traverseImplicitCastExpr(const ImplicitCastExpr& expr);
+    bool visitDeclRefExpr(const DeclRefExpr& expr);
+
+    unsigned getNumGlobals() const
+    {
+        return numGlobals;
+    }
+    unsigned getNumFunctions() const
+    {
+        return static_cast<unsigned>(functionSlots.size());
+    }
+};
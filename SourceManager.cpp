@@ -0,0 +1,105 @@
+/**
+* @file SourceManager.cpp
+* Lazy line table for SourceManager
+**/
+
+#include <algorithm>
+#include <cstring>
+#include "SourceManager.h"
+
+void SourceManager::computeLineOffsets() const
+{
+    const char* start = getBufferStart();
+    const char* end = getBufferEnd();
+    lineOffsets.push_back(0);
+    for (const char* p = start; p != end; p++)
+    {
+        p = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!p)
+        {
+            break;
+        }
+        lineOffsets.push_back(static_cast<uint32_t>(p + 1 - start));
+    }
+}
+
+void SourceManager::replaceRange(std::unique_ptr<llvm::MemoryBuffer> edited, uint32_t offset, uint32_t removed, llvm::StringRef inserted)
+{
+    buffer = std::move(edited);
+    if (lineOffsets.empty())
+    {
+        return;
+    }
+    // A line starts right after each newline, so the lines starting in
+    // (offset, offset + removed] went away with the removed text.
+    auto first = std::upper_bound(lineOffsets.begin(), lineOffsets.end(), offset);
+    auto last = std::upper_bound(first, lineOffsets.end(), offset + removed);
+    uint32_t delta = static_cast<uint32_t>(inserted.size() - removed);
+    for (auto it = last; it != lineOffsets.end(); ++it)
+    {
+        *it += delta;
+    }
+    std::vector<uint32_t> added;
+    for (size_t i = 0; i < inserted.size(); i++)
+    {
+        if (inserted[i] == '\n')
+        {
+            added.push_back(static_cast<uint32_t>(offset + i + 1));
+        }
+    }
+    auto pos = lineOffsets.erase(first, last);
+    lineOffsets.insert(pos, added.begin(), added.end());
+}
+
+Location SourceManager::getLocation(uint32_t offset) const
+{
+    if (lineOffsets.empty())
+    {
+        computeLineOffsets();
+    }
+    auto line = std::upper_bound(lineOffsets.begin(), lineOffsets.end(), offset) - 1;
+    return Location{ static_cast<int>(line - lineOffsets.begin()) + 1, static_cast<int>(offset - *line) + 1 };
+}
+
+Location SourceManager::getLocation(const Token& tok) const
+{
+    if (tok.kind == TokenKind::eof && tok.length == 0)
+    {
+        if (tok.offset == 0)
+        {
+            return Location{ 1, 0 };
+        }
+        return Location{ getLocation(tok.offset - 1).row + 1, 0 };
+    }
+    return getLocation(tok.offset);
+}
+
+Location LineCursor::getLocation(uint32_t offset)
+{
+    const char* start = SM.getBufferStart();
+    for (const char* p = start + pos; p < start + offset; p++)
+    {
+        p = static_cast<const char*>(memchr(p, '\n', start + offset - p));
+        if (!p)
+        {
+            break;
+        }
+        row++;
+        lineStart = static_cast<uint32_t>(p + 1 - start);
+    }
+    pos = offset;
+    return Location{ row, static_cast<int>(offset - lineStart) + 1 };
+}
+
+Location LineCursor::getLocation(const Token& tok)
+{
+    if (tok.kind == TokenKind::eof && tok.length == 0)
+    {
+        if (tok.offset == 0)
+        {
+            return Location{ 1, 0 };
+        }
+        return Location{ getLocation(tok.offset - 1).row + 1, 0 };
+    }
+    return getLocation(tok.offset);
+}
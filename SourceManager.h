@@ -0,0 +1,79 @@
+/** @file SourceManager.h
+* @brief Owns the source buffer and maps token offsets back to rows and columns
+**/
+
+#pragma once
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include "token.h"
+
+#pragma warning(push, 0)
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#pragma warning(pop)
+
+class SourceManager
+{
+    std::unique_ptr<llvm::MemoryBuffer> buffer;
+    /// Offset of the first character of every line, built on first use.
+    mutable std::vector<uint32_t> lineOffsets;
+
+    void computeLineOffsets() const;
+
+public:
+    SourceManager(std::unique_ptr<llvm::MemoryBuffer> buffer) : buffer(std::move(buffer)) {}
+
+    const char* getBufferStart() const
+    {
+        return buffer->getBufferStart();
+    }
+    const char* getBufferEnd() const
+    {
+        return buffer->getBufferEnd();
+    }
+    llvm::StringRef getBuffer() const
+    {
+        return buffer->getBuffer();
+    }
+
+    llvm::StringRef getSpelling(const Token& tok) const
+    {
+        return llvm::StringRef(getBufferStart() + tok.offset, tok.length);
+    }
+
+    /**
+     * @brief Swaps in an edited copy of the buffer in which [offset, offset +
+     * removed) was replaced by inserted. The line table, if built, is patched
+     * rather than rebuilt.
+    */
+    void replaceRange(std::unique_ptr<llvm::MemoryBuffer> edited, uint32_t offset, uint32_t removed, llvm::StringRef inserted);
+
+    /// Row and column (both 1-based) of a byte offset.
+    Location getLocation(uint32_t offset) const;
+
+    /// Like getLocation(offset), but the eof token appended by the lexer is
+    /// reported at column 0 of the line after the last one read.
+    Location getLocation(const Token& tok) const;
+};
+
+/**
+ * @brief Locates tokens that arrive in source order by counting newlines as it
+ * goes, so a single pass needs no line table.
+*/
+class LineCursor
+{
+    const SourceManager& SM;
+    uint32_t pos = 0;
+    uint32_t lineStart = 0;
+    int row = 1;
+
+public:
+    LineCursor(const SourceManager& SM) : SM(SM) {}
+
+    /// Same as SourceManager::getLocation(offset); offsets must not decrease.
+    Location getLocation(uint32_t offset);
+
+    /// Same as SourceManager::getLocation(tok).
+    Location getLocation(const Token& tok);
+};
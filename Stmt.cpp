@@ -21,11 +21,6 @@ json IfStmt::toJson() const
     return res;
 }
 
-Value* AST::IfStmt::genCode(CodeGeneratorBase& generator) const
-{
-    return generator.gen(*this);
-}
-
 json DeclStmt::toJson() const
 {
     json res = {
@@ -43,15 +38,6 @@ json DeclStmt::toJson() const
     return res;
 }
 
-Value* AST::DeclStmt::genCode(CodeGeneratorBase& generator) const
-{
-    for (const auto& decl : decls)
-    {
-        decl->genCode(generator);
-    }
-    return nullptr;
-}
-
 json CompoundStmt::toJson() const
 {
     json res = {
@@ -69,15 +55,19 @@ json CompoundStmt::toJson() const
     return res;
 }
 
-Value* AST::CompoundStmt::genCode(CodeGeneratorBase& generator) const
+Stmt* FunctionDecl::getBody() const
 {
-    return generator.gen(*this);
+    if (lazyBody)
+    {
+        body = lazyBody->parseBody(bodyBegin, bodyEnd);
+        lazyBody = nullptr;
+    }
+    return body;
 }
 
-
 json FunctionDecl::toJson() const
 {
-    std::string type = returnType + "(";
+    std::string type = returnType.str() + "(";
     for (auto it = paras.begin(); it != paras.end(); ++it)
     {
         if (it != paras.begin())
@@ -92,6 +82,7 @@ json FunctionDecl::toJson() const
         {"name", name},
         {"type", type}
     };
+    Stmt* body = getBody();
     if (body || !paras.empty())
     {
         auto inner = json::array();
@@ -111,18 +102,6 @@ json FunctionDecl::toJson() const
     return res;
 }
 
-Function* AST::FunctionDecl::genFunc(CodeGeneratorBase& generator) const
-{
-    return generator.gen(*this);
-}
-
-Value* AST::FunctionDecl::genCode(CodeGeneratorBase& generator) const
-{
-    generator.gen(*this);
-    return nullptr;
-}
-
-
 json ReturnStmt::toJson() const
 {
     json res = {
@@ -135,12 +114,6 @@ json ReturnStmt::toJson() const
     return res;
 }
 
-Value* AST::ReturnStmt::genCode(CodeGeneratorBase& generator) const
-{
-    return generator.gen(*this);
-}
-
-
 json ValueStmt::toJson() const
 {
     return {
@@ -149,12 +122,6 @@ json ValueStmt::toJson() const
     };
 }
 
-Value* AST::ValueStmt::genCode(CodeGeneratorBase& generator) const
-{
-    return expr->genCode(generator);
-}
-
-
 json WhileStmt::toJson() const
 {
     return {
@@ -163,19 +130,9 @@ json WhileStmt::toJson() const
     };
 }
 
-Value* AST::WhileStmt::genCode(CodeGeneratorBase& generator) const
-{
-    return generator.gen(*this);
-}
-
 json NullStmt::toJson() const
 {
     return { 
         { "kind", "NullStmt" }
     };
 }
-
-Value* AST::NullStmt::genCode(CodeGeneratorBase& generator) const
-{
-    return nullptr;
-}
@@ -3,8 +3,6 @@
 **/
 
 #pragma once
-#include <vector>
-#include <memory>
 #include "Expr.h"
 #include "Decl.h"
 
@@ -16,145 +14,305 @@ namespace AST
     */
     class Stmt : public ASTNode
     {
-        
+    protected:
+        Stmt(Kind kind) : ASTNode(kind) {}
+
+    public:
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() >= Kind::firstStmt && node->getKind() <= Kind::lastStmt;
+        }
     };
 
     class NullStmt : public Stmt
     {
     public:
-        // ͨ Stmt ̳
-        virtual json toJson() const override;        
-        virtual Value* genCode(CodeGeneratorBase& generator) const override;
+        NullStmt() : Stmt(Kind::NullStmt) {}
+
+        json toJson() const;        
+
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() == Kind::NullStmt;
+        }
     };
 
     class ValueStmt : public Stmt
     {
-        std::unique_ptr<Expr> expr;
+        Expr* expr;
 
     public:
-        ValueStmt(std::unique_ptr<Expr> expr) : expr(std::move(expr)) {}
-
-        // ͨ Stmt ̳
-        virtual json toJson() const override;
-
-        // ͨ Stmt ̳
-        virtual Value* genCode(CodeGeneratorBase& generator) const override;
+        ValueStmt(Expr* expr) : Stmt(Kind::ValueStmt), expr(expr) {}
+        Expr* getExpr() const
+        {
+            return expr;
+        }
+        void setExpr(Expr* E)
+        {
+            expr = E;
+        }
+
+        json toJson() const;
+
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() == Kind::ValueStmt;
+        }
     };
 
     class IfStmt : public Stmt
     {
-        std::unique_ptr<Expr> cond;
-        std::unique_ptr<Stmt> body;
-        std::unique_ptr<Stmt> elseBody;
+        Expr* cond;
+        Stmt* body;
+        Stmt* elseBody;
         friend CodeGenerator;
 
     public:
-        IfStmt(std::unique_ptr<Expr> cond, std::unique_ptr<Stmt> body, std::unique_ptr<Stmt> elseBody = nullptr) : cond(std::move(cond)), body(std::move(body)), elseBody(std::move(elseBody)) {}
+        IfStmt(Expr* cond, Stmt* body, Stmt* elseBody = nullptr) : Stmt(Kind::IfStmt), cond(cond), body(body), elseBody(elseBody) {}
+        Expr* getCond() const
+        {
+            return cond;
+        }
+        void setCond(Expr* E)
+        {
+            cond = E;
+        }
+        Stmt* getThen() const
+        {
+            return body;
+        }
+        void setThen(Stmt* S)
+        {
+            body = S;
+        }
+        /// Null for an if without else.
+        Stmt* getElse() const
+        {
+            return elseBody;
+        }
+        void setElse(Stmt* S)
+        {
+            elseBody = S;
+        }
 
-        // ͨ Stmt ̳
         // virtual void printToJson(int depth) const override;
 
-        // ͨ Stmt ̳
-        virtual json toJson() const override;
+        json toJson() const;
 
-        // ͨ Stmt ̳
-        virtual Value* genCode(CodeGeneratorBase& generator) const override;
-
-        virtual Value* genFunc(CodeGenerator& generator) const = delete;
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() == Kind::IfStmt;
+        }
     };
 
     class WhileStmt : public Stmt
     {
-        std::unique_ptr<Expr> cond;
-        std::unique_ptr<Stmt> body;
+        Expr* cond;
+        Stmt* body;
 
         friend CodeGenerator;
     public:
-        WhileStmt(std::unique_ptr<Expr> cond, std::unique_ptr<Stmt> body) : cond(std::move(cond)), body(std::move(body)) {}
-
-        // ͨ Stmt ̳
-        virtual json toJson() const override;
-
+        WhileStmt(Expr* cond, Stmt* body) : Stmt(Kind::WhileStmt), cond(cond), body(body) {}
+        Expr* getCond() const
+        {
+            return cond;
+        }
+        void setCond(Expr* E)
+        {
+            cond = E;
+        }
+        Stmt* getBody() const
+        {
+            return body;
+        }
+        void setBody(Stmt* S)
+        {
+            body = S;
+        }
+
+        json toJson() const;
 
-        // ͨ Stmt ̳
-        virtual Value* genCode(CodeGeneratorBase& generator) const override;
-
-        // ͨ Stmt ̳
         //virtual void printToJson(int depth) const override;
+
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() == Kind::WhileStmt;
+        }
     };
 
     class DeclStmt : public Stmt
     {
-        std::vector<std::unique_ptr<Decl>> decls;
+        ArrayRef<Decl*> decls;
 
     public:
-        DeclStmt() = default;
-        DeclStmt(std::vector<std::unique_ptr<Decl>> &decls) : decls(std::move(decls)) {}
+        DeclStmt() : Stmt(Kind::DeclStmt) {}
+        DeclStmt(ArrayRef<Decl*> decls) : Stmt(Kind::DeclStmt), decls(decls) {}
+        ArrayRef<Decl*> getDecls() const
+        {
+            return decls;
+        }
 
-        // ͨ Stmt ̳
         //virtual void printToJson(int depth) const override;
 
-        // ͨ Stmt ̳
-        virtual json toJson() const override;
+        json toJson() const;
 
-        // ͨ Stmt ̳
-        virtual Value* genCode(CodeGeneratorBase& generator) const override;
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() == Kind::DeclStmt;
+        }
     };
 
     class CompoundStmt : public Stmt
     {
     public:
-        std::vector<std::unique_ptr<Stmt>> body;
-        CompoundStmt(std::vector<std::unique_ptr<Stmt>> &body) : body(std::move(body)) {}
-        // ͨ Stmt ̳
+        ArrayRef<Stmt*> body;
+        CompoundStmt(ArrayRef<Stmt*> body) : Stmt(Kind::CompoundStmt), body(body) {}
+        /// body must have been copied into the ASTContext for this node alone.
+        void setStmt(size_t i, Stmt* S)
+        {
+            const_cast<Stmt*&>(body[i]) = S;
+        }
         // virtual void printToJson(int depth) const override;
 
-        // ͨ Stmt ̳
-        virtual json toJson() const override;
+        json toJson() const;
 
-        // ͨ Stmt ̳
-        virtual Value* genCode(CodeGeneratorBase& generator) const override;
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() == Kind::CompoundStmt;
+        }
     };
 
     class ReturnStmt : public Stmt
     {
-        std::unique_ptr<Expr> returnValue;
+        Expr* returnValue;
 
         friend CodeGenerator;
 
     public:
-        ReturnStmt(std::unique_ptr<Expr> value = nullptr) : returnValue(std::move(value)) {}
+        ReturnStmt(Expr* value = nullptr) : Stmt(Kind::ReturnStmt), returnValue(value) {}
+        /// Null for a return without a value.
+        Expr* getRetValue() const
+        {
+            return returnValue;
+        }
+        void setRetValue(Expr* E)
+        {
+            returnValue = E;
+        }
 
-        // ͨ Stmt ̳
         // virtual void printToJson(int depth) const override;
 
-        // ͨ Stmt ̳
-        virtual json toJson() const override;
+        json toJson() const;
 
-        // ͨ Stmt ̳
-        virtual Value* genCode(CodeGeneratorBase& generator) const override;
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() == Kind::ReturnStmt;
+        }
     };
 
-    class FunctionDecl : public Decl
+    /**
+     * @brief Parses the function bodies the parser skipped over.
+    */
+    class LazyBodySource
     {
-        std::string returnType;
-        std::string name;
-        std::vector<std::unique_ptr<ParmVarDecl>> paras;
-        std::unique_ptr<Stmt> body;
-
-        friend CodeGenerator;
+    protected:
+        bool failed = false;
 
     public:
-        FunctionDecl(const std::string &returnType, const std::string &name,
-                     std::vector<std::unique_ptr<ParmVarDecl>> &paras, std::unique_ptr<Stmt> body) : returnType(returnType), name(name), paras(std::move(paras)), body(std::move(body)) {}
+        /// Parses the compound statement spanning the source bytes [begin, end).
+        virtual Stmt* parseBody(uint32_t begin, uint32_t end) = 0;
+        /// Whether a body failed to parse; its function was left without one.
+        bool hasFailed() const
+        {
+            return failed;
+        }
+    };
 
-        // ͨ Decl ̳
-        virtual json toJson() const override;
+    class FunctionDecl : public Decl
+    {
+        StringRef returnType;
+        StringRef name;
+        ArrayRef<ParmVarDecl*> paras;
+        mutable Stmt* body;
+        /// Set while the body is only known by its source range.
+        mutable LazyBodySource* lazyBody = nullptr;
+        uint32_t bodyBegin = 0, bodyEnd = 0;
+        /// Filled in by Sema, see setSlot and setNumLocals.
+        unsigned slot = 0;
+        unsigned numLocals = 0;
 
-        // ͨ Decl ̳
-        virtual Function* genFunc(CodeGeneratorBase& generator) const override;
+        friend CodeGenerator;
 
-        // ͨ Decl ̳
-        virtual Value* genCode(CodeGeneratorBase& generator) const override;
+    public:
+        FunctionDecl(StringRef returnType, StringRef name,
+                     ArrayRef<ParmVarDecl*> paras, Stmt* body) : Decl(Kind::FunctionDecl), returnType(returnType), name(name), paras(paras), body(body) {}
+        /// A function whose body spans [bodyBegin, bodyEnd) and is parsed by source on first use.
+        FunctionDecl(StringRef returnType, StringRef name, ArrayRef<ParmVarDecl*> paras,
+                     LazyBodySource* source, uint32_t bodyBegin, uint32_t bodyEnd) :
+            Decl(Kind::FunctionDecl), returnType(returnType), name(name), paras(paras), body(nullptr),
+            lazyBody(source), bodyBegin(bodyBegin), bodyEnd(bodyEnd) {}
+        StringRef getReturnType() const
+        {
+            return returnType;
+        }
+        StringRef getName() const
+        {
+            return name;
+        }
+        ArrayRef<ParmVarDecl*> getParams() const
+        {
+            return paras;
+        }
+        /// Null for a prototype. A skipped body is parsed here on first use,
+        /// and is null if that fails; see LazyBodySource::hasFailed.
+        Stmt* getBody() const;
+        /// Whether the function has a body, parsed or not.
+        bool hasBody() const
+        {
+            return body || lazyBody;
+        }
+        /// Whether the body is still waiting to be parsed.
+        bool hasLazyBody() const
+        {
+            return lazyBody;
+        }
+        /// Numbers the functions of the program; redeclarations share the slot
+        /// of the first declaration.
+        void setSlot(unsigned index)
+        {
+            slot = index;
+        }
+        unsigned getSlot() const
+        {
+            return slot;
+        }
+        /// The number of parameters and local variables of the body.
+        void setNumLocals(unsigned count)
+        {
+            numLocals = count;
+        }
+        unsigned getNumLocals() const
+        {
+            return numLocals;
+        }
+        /// Replaces a skipped body once it has been parsed elsewhere.
+        void setBody(Stmt* stmt)
+        {
+            body = stmt;
+            lazyBody = nullptr;
+        }
+        /// Turns the function into a prototype, leaving a skipped body unparsed.
+        void dropBody()
+        {
+            body = nullptr;
+            lazyBody = nullptr;
+        }
+
+        json toJson() const;
+
+        static bool classof(const ASTNode* node)
+        {
+            return node->getKind() == Kind::FunctionDecl;
+        }
     };
 }; // namespace AST
\ No newline at end of file
@@ -0,0 +1,166 @@
+/** @file TokenDumper.cpp
+* @brief Streaming JSON / NDJSON token dump
+**/
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include "TokenDumper.h"
+
+#pragma warning(push, 0)
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#pragma warning(pop)
+
+namespace
+{
+    /// Escapes the way nlohmann::json does with ensure_ascii off.
+    void writeString(llvm::raw_ostream& out, llvm::StringRef str)
+    {
+        out << '"';
+        for (char ch : str)
+        {
+            switch (ch)
+            {
+                case '"':
+                    out << "\\\"";
+                    break;
+                case '\\':
+                    out << "\\\\";
+                    break;
+                case '\b':
+                    out << "\\b";
+                    break;
+                case '\f':
+                    out << "\\f";
+                    break;
+                case '\n':
+                    out << "\\n";
+                    break;
+                case '\r':
+                    out << "\\r";
+                    break;
+                case '\t':
+                    out << "\\t";
+                    break;
+                default:
+                    if (static_cast<unsigned char>(ch) < 0x20)
+                    {
+                        out << llvm::format("\\u%04x", static_cast<unsigned char>(ch));
+                    }
+                    else
+                    {
+                        out << ch;
+                    }
+            }
+        }
+        out << '"';
+    }
+
+    /// Separators of a token object.
+    struct Layout
+    {
+        const char* open;
+        const char* next;
+        const char* colon;
+        const char* close;
+    };
+    /// matches nlohmann::json::dump(4)
+    constexpr Layout Indented{ "\n    {\n        ", ",\n        ", ": ", "\n    }" };
+    constexpr Layout Compact{ "{", ",", ":", "}" };
+
+    void writeToken(llvm::raw_ostream& out, const SourceManager& SM, const Token& tok, Location loc, size_t id,
+                    const Layout& layout)
+    {
+        out << layout.open << "\"id\"" << layout.colon << id;
+        out << layout.next << "\"content\"" << layout.colon;
+        writeString(out, SM.getSpelling(tok));
+        out << layout.next << "\"prop\"" << layout.colon << '"' << getTokenName(tok.kind) << '"';
+        out << layout.next << "\"loc\"" << layout.colon << '"' << loc.row << ',' << loc.col << '"';
+        out << layout.close;
+    }
+}
+
+void dumpTokenStream(TokenSource& source, const SourceManager& SM, llvm::raw_ostream& out, bool ndjson)
+{
+    LineCursor lines(SM);
+    Token tok;
+    size_t id = 0;
+    if (!ndjson)
+    {
+        out << '[';
+    }
+    while (source.Lex(tok))
+    {
+        if (!ndjson && id)
+        {
+            out << ',';
+        }
+        writeToken(out, SM, tok, lines.getLocation(tok), ++id, ndjson ? Compact : Indented);
+        if (ndjson)
+        {
+            out << '\n';
+        }
+    }
+    if (!ndjson)
+    {
+        out << (id ? "\n]\n" : "]\n");
+    }
+}
+
+bool dumpTokenEdits(IncrementalLexer& lexer, std::istream& in, llvm::raw_ostream& out)
+{
+    const SourceManager& SM = lexer.getSourceManager();
+    std::string line;
+    for (unsigned lineNo = 1; std::getline(in, line); lineNo++)
+    {
+        if (line.empty())
+        {
+            continue;
+        }
+        llvm::Expected<llvm::json::Value> edit = llvm::json::parse(line);
+        if (!edit)
+        {
+            std::cerr << "edit " << lineNo << ": " << llvm::toString(edit.takeError()) << std::endl;
+            return false;
+        }
+        const llvm::json::Object* fields = edit->getAsObject();
+        llvm::Optional<int64_t> offset = fields ? fields->getInteger("offset") : llvm::None;
+        int64_t removed = fields ? fields->getInteger("removed").getValueOr(0) : 0;
+        llvm::StringRef inserted = fields ? fields->getString("inserted").getValueOr("") : "";
+        size_t size = SM.getBuffer().size();
+        if (!offset || *offset < 0 || removed < 0 || static_cast<uint64_t>(*offset) > size ||
+            static_cast<uint64_t>(removed) > size - static_cast<size_t>(*offset))
+        {
+            std::cerr << "edit " << lineNo << ": expected an offset and a length removed within the source" << std::endl;
+            return false;
+        }
+
+        int lines = static_cast<int>(inserted.count('\n') - SM.getBuffer().substr(*offset, removed).count('\n'));
+        IncrementalLexer::Change change = lexer.edit(static_cast<uint32_t>(*offset), static_cast<uint32_t>(removed), inserted);
+        // Reused tokens on the line the edit ends on changed column; they are
+        // sent again, so that those after only move down.
+        const std::vector<Token>& tokens = lexer.getTokens();
+        int lastRow = SM.getLocation(static_cast<uint32_t>(*offset + inserted.size())).row;
+        size_t end = change.first + change.inserted;
+        while (end < tokens.size() && SM.getLocation(tokens[end]).row == lastRow)
+        {
+            end++;
+        }
+        size_t resent = end - (change.first + change.inserted);
+
+        out << "{\"first\":" << change.first + 1 << ",\"removed\":" << change.removed + resent
+            << ",\"lines\":" << lines << ",\"tokens\":[";
+        for (size_t i = change.first; i < end; i++)
+        {
+            if (i != change.first)
+            {
+                out << ',';
+            }
+            writeToken(out, SM, tokens[i], SM.getLocation(tokens[i]), i + 1, Compact);
+        }
+        out << "]}\n";
+        out.flush();
+    }
+    return true;
+}
@@ -0,0 +1,37 @@
+/** @file TokenDumper.h
+* @brief Writes --dump-tokens output as the tokens are lexed
+**/
+
+#pragma once
+#include <istream>
+#include "TokenStream.h"
+#include "SourceManager.h"
+#include "IncrementalLexer.h"
+
+#pragma warning(push, 0)
+#include "llvm/Support/raw_ostream.h"
+#pragma warning(pop)
+
+/**
+ * @brief Pulls every token from source and writes it straight to out, without
+ * building a JSON document first.
+ * @param ndjson One compact object per line instead of the indented array
+ * nlohmann::json::dump(4) would print
+*/
+void dumpTokenStream(TokenSource& source, const SourceManager& SM, llvm::raw_ostream& out, bool ndjson);
+
+/**
+ * @brief Applies the edits read from in to lexer's source, and writes after
+ * each the tokens it changed, for a front end that keeps the tokens of a
+ * --dump-tokens of the source and edits it.
+ *
+ * An edit is a line such as {"offset": 10, "removed": 2, "inserted": "x"}:
+ * the bytes [offset, offset + removed) are replaced by inserted. Its answer is
+ * a line {"first": 3, "removed": 2, "lines": 0, "tokens": [...]}: the tokens
+ * with ids [first, first + removed) are replaced by tokens, written as in
+ * --dump-tokens with their new ids. The tokens after them keep their column
+ * and move down by lines rows, since tokens runs to the end of the line the
+ * edit ends on; their ids shift by the change in count.
+ * @return false after reporting a malformed edit on std::cerr
+*/
+bool dumpTokenEdits(IncrementalLexer& lexer, std::istream& in, llvm::raw_ostream& out);
@@ -0,0 +1,97 @@
+/** @file TokenStream.h
+* @brief Pull-based token delivery from the lexer to the parser
+**/
+
+#pragma once
+#include <cassert>
+#include "token.h"
+
+#pragma warning(push, 0)
+#include "llvm/ADT/ArrayRef.h"
+#pragma warning(pop)
+
+/**
+ * @brief Anything the Parser can pull tokens from.
+*/
+class TokenSource
+{
+public:
+    virtual ~TokenSource() = default;
+
+    /// Produces the next token. Returns false once the input is exhausted;
+    /// the last token produced before that is always an eof token.
+    virtual bool Lex(Token& tok) = 0;
+};
+
+/**
+ * @brief Replays tokens that were lexed ahead of time.
+*/
+class TokenArraySource : public TokenSource
+{
+    llvm::ArrayRef<Token> tokens;
+    size_t next = 0;
+
+public:
+    TokenArraySource(llvm::ArrayRef<Token> tokens) : tokens(tokens) {}
+
+    virtual bool Lex(Token& tok) override
+    {
+        if (next == tokens.size())
+        {
+            return false;
+        }
+        tok = tokens[next++];
+        return true;
+    }
+};
+
+/**
+ * @brief A small ring buffer of lookahead over a TokenSource.
+ *
+ * Tokens are lexed only when the parser asks for them, so at most Capacity
+ * tokens are alive at any time no matter how large the input is.
+*/
+class TokenStream
+{
+    static constexpr unsigned Capacity = 16;
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    TokenSource& source;
+    Token ring[Capacity];
+    unsigned head = 0, count = 0;
+    bool exhausted = false;
+    Token lastTok{ TokenKind::eof, 0, 0, 0 };
+
+    void fill(unsigned n)
+    {
+        while (count <= n)
+        {
+            if (!exhausted && !source.Lex(lastTok))
+            {
+                exhausted = true;
+            }
+            // once the source is exhausted, its final eof repeats forever
+            ring[(head + count++) & (Capacity - 1)] = lastTok;
+        }
+    }
+
+public:
+    TokenStream(TokenSource& source) : source(source) {}
+
+    /// The token n places ahead, without consuming anything.
+    const Token& peek(unsigned n = 0)
+    {
+        assert(n < Capacity && "lookahead is bounded by the ring buffer");
+        fill(n);
+        return ring[(head + n) & (Capacity - 1)];
+    }
+
+    Token next()
+    {
+        fill(0);
+        Token tok = ring[head];
+        head = (head + 1) & (Capacity - 1);
+        count--;
+        return tok;
+    }
+};
@@ -0,0 +1,253 @@
+/** @file TokenTables.h
+* @brief Recognizer tables generated at compile time from TokenKinds.def
+*
+* Punctuators and comment markers are recognized by a DFA and keywords by a
+* perfect hash. Both are built by constexpr code from the PUNCTUATOR, COMMENT
+* and KEYWORD entries, so adding a token to the .def file is all it takes.
+**/
+
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "token.h"
+
+namespace toktables
+{
+    struct Spelling
+    {
+        const char* text;
+        TokenKind kind;
+    };
+
+    inline constexpr Spelling punctuators[] = {
+#define PUNCTUATOR(X,Y) { Y, TokenKind::X },
+#define COMMENT(X,Y) { Y, TokenKind::X },
+#include "TokenKinds.def"
+    };
+
+    inline constexpr Spelling keywords[] = {
+#define KEYWORD(X,Y) { #X, TokenKind::kw_ ## X },
+#include "TokenKinds.def"
+    };
+
+    constexpr size_t length(const char* s)
+    {
+        size_t n = 0;
+        while (s[n])
+        {
+            n++;
+        }
+        return n;
+    }
+
+    //===- Punctuator DFA ---------------------------------------------------===//
+
+    constexpr size_t maxPunctuatorLength()
+    {
+        size_t n = 0;
+        for (const auto& p : punctuators)
+        {
+            n = length(p.text) > n ? length(p.text) : n;
+        }
+        return n;
+    }
+
+    /// Characters that appear in some punctuator, plus one for "none".
+    constexpr size_t countPunctuatorColumns()
+    {
+        bool seen[256] = {};
+        size_t n = 1;
+        for (const auto& p : punctuators)
+        {
+            for (const char* c = p.text; *c; c++)
+            {
+                if (!seen[static_cast<unsigned char>(*c)])
+                {
+                    seen[static_cast<unsigned char>(*c)] = true;
+                    n++;
+                }
+            }
+        }
+        return n;
+    }
+
+    /// Upper bound: one state per spelled character, plus the start state.
+    constexpr size_t countPunctuatorStates()
+    {
+        size_t n = 1;
+        for (const auto& p : punctuators)
+        {
+            n += length(p.text);
+        }
+        return n;
+    }
+
+    constexpr size_t numPunctuatorColumns = countPunctuatorColumns();
+    constexpr size_t numPunctuatorStates = countPunctuatorStates();
+    static_assert(numPunctuatorStates < 256, "punctuator states must fit in a byte");
+
+    /**
+     * @brief Trie-shaped DFA over the punctuator spellings. State 0 is the
+     * start state and doubles as "no transition".
+    */
+    struct PunctuatorDFA
+    {
+        std::array<unsigned char, 256> column{};
+        std::array<std::array<unsigned char, numPunctuatorColumns>, numPunctuatorStates> next{};
+        std::array<TokenKind, numPunctuatorStates> accept{};
+
+        constexpr unsigned char step(unsigned char state, char ch) const
+        {
+            return next[state][column[static_cast<unsigned char>(ch)]];
+        }
+    };
+
+    constexpr PunctuatorDFA buildPunctuatorDFA()
+    {
+        PunctuatorDFA dfa;
+        unsigned char columns = 1;
+        unsigned char states = 1;
+        for (auto& kind : dfa.accept)
+        {
+            kind = TokenKind::unknown;
+        }
+        for (const auto& p : punctuators)
+        {
+            unsigned char state = 0;
+            for (const char* c = p.text; *c; c++)
+            {
+                auto& col = dfa.column[static_cast<unsigned char>(*c)];
+                if (!col)
+                {
+                    col = columns++;
+                }
+                if (!dfa.next[state][col])
+                {
+                    dfa.next[state][col] = states++;
+                }
+                state = dfa.next[state][col];
+            }
+            dfa.accept[state] = p.kind;
+        }
+        return dfa;
+    }
+
+    inline constexpr PunctuatorDFA punctuatorDFA = buildPunctuatorDFA();
+
+    /**
+     * @brief Longest punctuator at the start of [s, end).
+     * @return Its length, or 0 if no punctuator starts there
+    */
+    inline size_t matchPunctuator(const char* s, const char* end, TokenKind& kind)
+    {
+        unsigned char state = 0;
+        size_t len = 0, accepted = 0;
+        for (const char* p = s; p != end; p++)
+        {
+            state = punctuatorDFA.step(state, *p);
+            if (!state)
+            {
+                break;
+            }
+            len++;
+            if (punctuatorDFA.accept[state] != TokenKind::unknown)
+            {
+                accepted = len;
+                kind = punctuatorDFA.accept[state];
+            }
+        }
+        return accepted;
+    }
+
+    //===- Keyword perfect hash ---------------------------------------------===//
+
+    constexpr uint32_t hashKeyword(const char* s, size_t len, uint32_t seed)
+    {
+        uint32_t h = seed;
+        for (size_t i = 0; i < len; i++)
+        {
+            h = (h ^ static_cast<unsigned char>(s[i])) * 16777619u;
+        }
+        return h ^ (h >> 16);
+    }
+
+    constexpr size_t numKeywords = sizeof(keywords) / sizeof(keywords[0]);
+
+    /// A power of two with at least four slots per keyword, so a collision
+    /// free seed turns up after a few tries.
+    constexpr size_t keywordTableSize()
+    {
+        size_t n = 1;
+        while (n < 4 * numKeywords)
+        {
+            n *= 2;
+        }
+        return n;
+    }
+
+    constexpr size_t maxKeywordLength()
+    {
+        size_t n = 0;
+        for (const auto& k : keywords)
+        {
+            n = length(k.text) > n ? length(k.text) : n;
+        }
+        return n;
+    }
+
+    struct KeywordHash
+    {
+        struct Slot
+        {
+            const char* text = nullptr;
+            size_t length = 0;
+            TokenKind kind = TokenKind::identifier;
+        };
+        uint32_t seed = 0;
+        std::array<Slot, keywordTableSize()> slots{};
+    };
+
+    constexpr KeywordHash buildKeywordHash()
+    {
+        for (uint32_t seed = 2166136261u;; seed++)
+        {
+            KeywordHash table;
+            table.seed = seed;
+            bool collided = false;
+            for (const auto& k : keywords)
+            {
+                size_t len = length(k.text);
+                auto& slot = table.slots[hashKeyword(k.text, len, seed) & (table.slots.size() - 1)];
+                if (slot.text)
+                {
+                    collided = true;
+                    break;
+                }
+                slot = { k.text, len, k.kind };
+            }
+            if (!collided)
+            {
+                return table;
+            }
+        }
+    }
+
+    inline constexpr KeywordHash keywordHash = buildKeywordHash();
+
+    /// The keyword spelled by [s, s + len), or identifier.
+    inline TokenKind lookupKeyword(const char* s, size_t len)
+    {
+        if (len > maxKeywordLength())
+        {
+            return TokenKind::identifier;
+        }
+        const auto& slot = keywordHash.slots[hashKeyword(s, len, keywordHash.seed) & (keywordHash.slots.size() - 1)];
+        if (slot.length == len && memcmp(slot.text, s, len) == 0)
+        {
+            return slot.kind;
+        }
+        return TokenKind::identifier;
+    }
+}; // namespace toktables
@@ -0,0 +1,225 @@
+/** @file ProgramGenerator.cpp
+* @brief Synthetic ToyCC programs for tcc_bench
+**/
+
+#include "ProgramGenerator.h"
+
+namespace
+{
+    const char* const binaryOps[] = { "+", "-", "*", "&", "|", "^", "+", "-" };
+    const char* const compareOps[] = { "<", ">", "<=", ">=", "==", "!=" };
+    const char* const assignOps[] = { "=", "+=", "-=", "^=", "|=" };
+}
+
+uint64_t ProgramGenerator::next()
+{
+    // xorshift64*
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1Dull;
+}
+
+void ProgramGenerator::indent(unsigned depth)
+{
+    out.append(4 * depth, ' ');
+}
+
+void ProgramGenerator::genLeaf(unsigned loops)
+{
+    switch (pick(5))
+    {
+        case 0:
+            out += std::to_string(pick(1000));
+            break;
+        case 1:
+            out += "p" + std::to_string(pick(NumParams));
+            break;
+        case 2:
+            out += "v" + std::to_string(pick(NumLocals));
+            break;
+        case 3:
+            out += "g" + std::to_string(pick(numGlobals));
+            break;
+        default:
+            // loop counters of the enclosing loops are in scope too
+            out += loops ? "c" + std::to_string(pick(loops)) : "v" + std::to_string(pick(NumLocals));
+            break;
+    }
+}
+
+void ProgramGenerator::genExpr(unsigned depth, unsigned loops)
+{
+    if (depth == 0 || pick(4) == 0)
+    {
+        genLeaf(loops);
+        return;
+    }
+    if (!callUsed && loops == 0 && curFunction > 0 && pick(8) == 0)
+    {
+        callUsed = true;
+        out += "f" + std::to_string(pick(curFunction)) + "(";
+        for (unsigned i = 0; i < NumParams; i++)
+        {
+            out += i ? ", " : "";
+            genExpr(depth - 1, loops);
+        }
+        out += ")";
+        return;
+    }
+    size_t open = out.size();
+    bool paren = pick(3) == 0;
+    genExpr(depth - 1, loops);
+    switch (pick(6))
+    {
+        case 0:
+            // Nonzero divisors and small shift amounts keep running the program
+            // well defined. The parentheses stop a following operator from
+            // taking the literal as its left operand.
+            out += pick(2) ? " / " : " % ";
+            out += std::to_string(1 + pick(97));
+            paren = true;
+            break;
+        case 1:
+            out += pick(2) ? " << " : " >> ";
+            out += std::to_string(pick(8));
+            paren = true;
+            break;
+        default:
+            out += " ";
+            out += binaryOps[pick(sizeof(binaryOps) / sizeof(*binaryOps))];
+            out += " ";
+            genExpr(depth - 1, loops);
+            break;
+    }
+    if (paren)
+    {
+        out.insert(open, 1, '(');
+        out += ")";
+    }
+}
+
+void ProgramGenerator::genCond(unsigned loops)
+{
+    unsigned terms = 1 + pick(2);
+    for (unsigned i = 0; i < terms; i++)
+    {
+        if (i)
+        {
+            out += pick(2) ? " && " : " || ";
+        }
+        genExpr(2, loops);
+        out += " ";
+        out += compareOps[pick(sizeof(compareOps) / sizeof(*compareOps))];
+        out += " ";
+        genExpr(2, loops);
+    }
+}
+
+void ProgramGenerator::genBlock(unsigned depth, unsigned nest, unsigned loops)
+{
+    out += "{\n";
+    unsigned stmts = 1 + pick(3);
+    for (unsigned i = 0; i < stmts; i++)
+    {
+        genStmt(depth + 1, nest + 1, loops);
+    }
+    indent(depth);
+    out += "}";
+}
+
+void ProgramGenerator::genStmt(unsigned depth, unsigned nest, unsigned loops)
+{
+    unsigned kind = pick(nest < MaxNest ? 6 : 3);
+    indent(depth);
+    if (kind < 3)
+    {
+        out += "v" + std::to_string(pick(NumLocals)) + " ";
+        out += assignOps[pick(sizeof(assignOps) / sizeof(*assignOps))];
+        out += " ";
+        genExpr(MaxExprDepth, loops);
+        out += ";\n";
+    }
+    else if (kind < 5)
+    {
+        out += "if (";
+        genCond(loops);
+        out += ")\n";
+        indent(depth);
+        genBlock(depth, nest, loops);
+        out += "\n";
+        if (pick(2))
+        {
+            indent(depth);
+            out += "else\n";
+            indent(depth);
+            genBlock(depth, nest, loops);
+            out += "\n";
+        }
+    }
+    else
+    {
+        // counted loop; the body never assigns the counter
+        std::string counter = "c" + std::to_string(loops);
+        out += counter + " = 0;\n";
+        indent(depth);
+        out += "while (" + counter + " < " + std::to_string(2 + pick(3)) + ")\n";
+        indent(depth);
+        out += "{\n";
+        unsigned stmts = 1 + pick(2);
+        for (unsigned i = 0; i < stmts; i++)
+        {
+            genStmt(depth + 1, nest + 1, loops + 1);
+        }
+        indent(depth + 1);
+        out += counter + " = " + counter + " + 1;\n";
+        indent(depth);
+        out += "}\n";
+    }
+}
+
+void ProgramGenerator::genFunction()
+{
+    callUsed = false;
+    out += "int f" + std::to_string(curFunction) + "(";
+    for (unsigned i = 0; i < NumParams; i++)
+    {
+        out += i ? ", int p" : "int p";
+        out += std::to_string(i);
+    }
+    out += ")\n{\n";
+    for (unsigned i = 0; i < NumLocals; i++)
+    {
+        out += "    int v" + std::to_string(i) + " = " + std::to_string(pick(100)) + ";\n";
+    }
+    for (unsigned i = 0; i < MaxNest; i++)
+    {
+        out += "    int c" + std::to_string(i) + ";\n";
+    }
+    unsigned stmts = 3 + pick(4);
+    for (unsigned i = 0; i < stmts; i++)
+    {
+        genStmt(1, 0, 0);
+    }
+    out += "    return ";
+    genExpr(MaxExprDepth, 0);
+    out += ";\n}\n\n";
+}
+
+std::string ProgramGenerator::generate(unsigned scale)
+{
+    out.clear();
+    numGlobals = 32 * scale;
+    unsigned numFunctions = 64 * scale;
+    for (unsigned i = 0; i < numGlobals; i++)
+    {
+        out += "int g" + std::to_string(i) + " = " + std::to_string(pick(1000)) + ";\n";
+    }
+    out += "\n";
+    for (curFunction = 0; curFunction < numFunctions; curFunction++)
+    {
+        genFunction();
+    }
+    out += "int main()\n{\n    return f" + std::to_string(numFunctions - 1) + "(1, 2, 3) & 127;\n}\n";
+    return std::move(out);
+}
@@ -0,0 +1,54 @@
+/** @file ProgramGenerator.h
+* @brief Deterministic generator of programs in ToyCC's C subset
+**/
+
+#pragma once
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Writes random but reproducible translation units: globals, functions
+ * with deep expressions and nested while/if statements, and a main.
+ *
+ * The output only uses what the front end and code generator handle today:
+ * int everywhere, no '_' in names, no unary operators, no ++/--, no name used
+ * twice, and a single return at the end of every function. Generated programs
+ * also terminate when run: loops count up to small bounds, divisors and shift
+ * amounts are nonzero literals, and a function only calls earlier functions,
+ * at most once and never from inside a loop.
+*/
+class ProgramGenerator
+{
+    uint64_t state;
+    std::string out;
+    unsigned numGlobals = 0;
+    /// Index of the function being generated; it may call any before it.
+    unsigned curFunction = 0;
+    bool callUsed = false;
+
+    static constexpr unsigned NumParams = 3;
+    static constexpr unsigned NumLocals = 4;
+    static constexpr unsigned MaxNest = 3;
+    static constexpr unsigned MaxExprDepth = 4;
+
+    uint64_t next();
+    unsigned pick(unsigned n)
+    {
+        return static_cast<unsigned>(next() % n);
+    }
+    void indent(unsigned depth);
+    /// nest counts the enclosing if and while statements, loops only the
+    /// while loops, whose counters c0, c1, ... are the ones in use.
+    void genLeaf(unsigned loops);
+    void genExpr(unsigned depth, unsigned loops);
+    void genCond(unsigned loops);
+    void genBlock(unsigned depth, unsigned nest, unsigned loops);
+    void genStmt(unsigned depth, unsigned nest, unsigned loops);
+    void genFunction();
+
+public:
+    ProgramGenerator(uint64_t seed) : state(seed ? seed : 0x9E3779B97F4A7C15ull) {}
+
+    /// About 2 KB of source per function, 64 functions and 32 globals per unit of scale.
+    std::string generate(unsigned scale);
+};
@@ -0,0 +1,295 @@
+/** @file tcc_bench.cpp
+* @brief Times each front-end phase on generated programs of growing size
+**/
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include "ProgramGenerator.h"
+#include "lexer.h"
+#include "Parser.h"
+#include "Sema.h"
+#include "CodeGenerator.h"
+#include "CompactAST.h"
+
+#pragma warning(push, 0)
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#pragma warning(pop)
+
+static cl::OptionCategory benchCategory("tcc_bench options");
+
+static cl::list<unsigned> scales("scales", cl::desc("Program sizes to run, in units of 64 functions"), cl::CommaSeparated, cl::cat(benchCategory));
+static cl::opt<unsigned> seed("seed", cl::desc("Generator seed"), cl::init(1), cl::cat(benchCategory));
+static cl::opt<unsigned> repeat("repeat", cl::desc("Runs per size; the fastest is reported"), cl::init(3), cl::cat(benchCategory));
+static cl::opt<bool> printProgram("print-program", cl::desc("Print the program for the first size and exit"), cl::cat(benchCategory));
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double secondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    /// Peak resident set size in KB since the last resetPeakRSS().
+    long readPeakRSS()
+    {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line))
+        {
+            if (line.compare(0, 6, "VmHWM:") == 0)
+            {
+                return std::stol(line.substr(6));
+            }
+        }
+        return 0;
+    }
+
+    void resetPeakRSS()
+    {
+        std::ofstream("/proc/self/clear_refs") << "5";
+    }
+
+    struct PhaseTimes
+    {
+        double lex = 1e30, parse = 1e30, skim = 1e30, sema = 1e30, codegen = 1e30, print = 1e30;
+        size_t tokens = 0, nodes = 0, instructions = 0;
+    };
+
+    /// One pass of every phase; each time is kept if it beats the earlier runs.
+    void runOnce(const SourceManager& SM, PhaseTimes& times)
+    {
+        IdentifierTable idents;
+        Lexer lexer(SM, idents);
+        auto start = Clock::now();
+        std::vector<Token> tokens = lexer.LexAll();
+        times.lex = std::min(times.lex, secondsSince(start));
+        times.tokens = tokens.size();
+
+        // The parser pulls from the tokens lexed above, so lexing is not counted twice.
+        TokenArraySource source(tokens);
+        ASTContext context;
+        Parser parser(source, SM, context, "<bench>");
+        start = Clock::now();
+        Decl* ast = parser.parse();
+        times.parse = std::min(times.parse, secondsSince(start));
+        times.nodes = parser.getNumNodes();
+        if (!ast)
+        {
+            llvm::errs() << "generated program failed to parse\n";
+            exit(1);
+        }
+
+        // Parsing with lazy bodies only matches the braces of each function body.
+        TokenArraySource skimSource(tokens);
+        ASTContext skimContext;
+        Parser skimmer(skimSource, SM, skimContext, "<bench>");
+        skimmer.setLazyBodies(true);
+        start = Clock::now();
+        skimmer.parse();
+        times.skim = std::min(times.skim, secondsSince(start));
+
+        start = Clock::now();
+        Sema(context).bind(*ast);
+        times.sema = std::min(times.sema, secondsSince(start));
+
+        auto generator = std::make_unique<CodeGenerator>();
+        start = Clock::now();
+        generator->gen(*ast);
+        times.codegen = std::min(times.codegen, secondsSince(start));
+        times.instructions = 0;
+        for (const Function& F : generator->getModule())
+        {
+            times.instructions += F.getInstructionCount();
+        }
+
+        start = Clock::now();
+        generator->print("/dev/null");
+        times.print = std::min(times.print, secondsSince(start));
+    }
+
+    /// Counts the nodes of a tree; measures the cost of a bare traversal.
+    class NodeCounter : public RecursiveASTVisitor<NodeCounter>
+    {
+    public:
+        size_t count = 0;
+
+        bool visitASTNode(const ASTNode&)
+        {
+            count++;
+            return true;
+        }
+    };
+
+    struct CompactTimes
+    {
+        double walk = 1e30, flatten = 1e30, treeDump = 1e30, compactDump = 1e30, codegen = 1e30;
+        size_t nodes = 0, treeBytes = 0, compactBytes = 0, instructions = 0;
+    };
+
+    /// Compares the class tree with its CompactAST on the passes both support.
+    void runCompact(const SourceManager& SM, CompactTimes& times)
+    {
+        IdentifierTable idents;
+        Lexer lexer(SM, idents);
+        ASTContext context;
+        Parser parser(lexer, SM, context, "<bench>");
+        Decl* ast = parser.parse();
+        Sema(context).bind(*ast);
+
+        auto start = Clock::now();
+        NodeCounter counter;
+        counter.traverse(ast);
+        times.walk = std::min(times.walk, secondsSince(start));
+        // Unlike the parser's count this includes the casts BinaryOperator and Sema add.
+        times.nodes = counter.count;
+
+        start = Clock::now();
+        CompactAST compact(*ast);
+        times.flatten = std::min(times.flatten, secondsSince(start));
+        times.treeBytes = context.getTotalMemory();
+        times.compactBytes = compact.getMemorySize();
+
+        start = Clock::now();
+        std::string treeJson = ast->toJson().dump(4);
+        times.treeDump = std::min(times.treeDump, secondsSince(start));
+
+        llvm::raw_null_ostream null;
+        start = Clock::now();
+        compact.dumpJson(null);
+        times.compactDump = std::min(times.compactDump, secondsSince(start));
+
+        auto generator = std::make_unique<CodeGenerator>();
+        start = Clock::now();
+        generator->gen(compact);
+        times.codegen = std::min(times.codegen, secondsSince(start));
+        times.instructions = 0;
+        for (const Function& F : generator->getModule())
+        {
+            times.instructions += F.getInstructionCount();
+        }
+    }
+
+    struct CodegenTimes
+    {
+        double codegen = 1e30, verify = 1e30, print = 1e30, optimize = 1e30;
+        size_t instructions = 0, optimized = 0;
+    };
+
+    /// Generates, verifies, prints and optimizes a tree Sema has bound, with or
+    /// without building SSA directly.
+    void runCodegen(const Decl& ast, bool ssa, CodegenTimes& times)
+    {
+        auto generator = std::make_unique<CodeGenerator>();
+        generator->setSSA(ssa);
+        auto start = Clock::now();
+        generator->gen(ast);
+        times.codegen = std::min(times.codegen, secondsSince(start));
+        times.instructions = 0;
+        for (const Function& F : generator->getModule())
+        {
+            times.instructions += F.getInstructionCount();
+        }
+
+        start = Clock::now();
+        verifyModule(generator->getModule());
+        times.verify = std::min(times.verify, secondsSince(start));
+
+        llvm::raw_null_ostream null;
+        start = Clock::now();
+        generator->getModule().print(null, nullptr);
+        times.print = std::min(times.print, secondsSince(start));
+
+        start = Clock::now();
+        generator->optimize(OptimizationLevel::O2);
+        times.optimize = std::min(times.optimize, secondsSince(start));
+        times.optimized = generator->getModule().getInstructionCount();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    cl::HideUnrelatedOptions(benchCategory);
+    cl::ParseCommandLineOptions(argc, argv, "ToyCC front-end benchmark\n");
+    std::vector<unsigned> sizes(scales.begin(), scales.end());
+    if (sizes.empty())
+    {
+        sizes = { 1, 2, 4, 8, 16 };
+    }
+
+    llvm::raw_ostream& out = llvm::outs();
+    if (printProgram)
+    {
+        out << ProgramGenerator(seed).generate(sizes.front());
+        return 0;
+    }
+
+    std::vector<std::string> programs;
+    for (unsigned scale : sizes)
+    {
+        programs.push_back(ProgramGenerator(seed).generate(scale));
+    }
+
+    out << " scale        KB    tokens    tokens/s     nodes     nodes/s  skim tok/s      sema/s     insts     insts/s    print   peakRSS\n";
+    for (size_t s = 0; s < sizes.size(); s++)
+    {
+        const std::string& program = programs[s];
+        SourceManager SM(llvm::MemoryBuffer::getMemBuffer(program, "<bench>", false));
+        resetPeakRSS();
+        PhaseTimes times;
+        for (unsigned i = 0; i < std::max(1u, repeat.getValue()); i++)
+        {
+            runOnce(SM, times);
+        }
+        out << llvm::format("%6u %9.0f %9zu %11.3g %9zu %11.3g %11.3g %11.3g %9zu %11.3g %6.1fms %7ldKB\n",
+            sizes[s], program.size() / 1024.0, times.tokens, times.tokens / times.lex, times.nodes, times.nodes / times.parse,
+            times.tokens / times.skim, times.nodes / times.sema, times.instructions, times.instructions / times.codegen, times.print * 1e3, readPeakRSS());
+        out.flush();
+    }
+
+    out << "\n scale     nodes  tree B/node  compact B/node     walk/s  flatten/s  tree json/s  compact json/s  compact insts/s\n";
+    for (size_t s = 0; s < sizes.size(); s++)
+    {
+        SourceManager SM(llvm::MemoryBuffer::getMemBuffer(programs[s], "<bench>", false));
+        CompactTimes times;
+        for (unsigned i = 0; i < std::max(1u, repeat.getValue()); i++)
+        {
+            runCompact(SM, times);
+        }
+        double nodes = static_cast<double>(times.nodes);
+        out << llvm::format("%6u %9zu %12.1f %15.1f %10.3g %10.3g %12.3g %15.3g %16.3g\n", sizes[s], times.nodes,
+            times.treeBytes / nodes, times.compactBytes / nodes, nodes / times.walk, nodes / times.flatten, nodes / times.treeDump,
+            nodes / times.compactDump, times.instructions / times.codegen);
+        out.flush();
+    }
+
+    out << "\n scale   alloca insts      ssa insts   alloca cg   ssa cg  alloca verify  ssa verify  alloca print  ssa print"
+        "  alloca -O2   ssa -O2  -O2 insts\n";
+    for (size_t s = 0; s < sizes.size(); s++)
+    {
+        SourceManager SM(llvm::MemoryBuffer::getMemBuffer(programs[s], "<bench>", false));
+        IdentifierTable idents;
+        Lexer lexer(SM, idents);
+        ASTContext context;
+        Parser parser(lexer, SM, context, "<bench>");
+        Decl* ast = parser.parse();
+        Sema(context).bind(*ast);
+        CodegenTimes memory, ssa;
+        for (unsigned i = 0; i < std::max(1u, repeat.getValue()); i++)
+        {
+            runCodegen(*ast, false, memory);
+            runCodegen(*ast, true, ssa);
+        }
+        out << llvm::format("%6u %14zu %14zu %9.1fms %6.1fms %12.1fms %9.1fms %11.1fms %8.1fms %9.0fms %7.0fms %10zu\n", sizes[s],
+            memory.instructions, ssa.instructions, memory.codegen * 1e3, ssa.codegen * 1e3, memory.verify * 1e3,
+            ssa.verify * 1e3, memory.print * 1e3, ssa.print * 1e3, memory.optimize * 1e3, ssa.optimize * 1e3, ssa.optimized);
+        out.flush();
+    }
+    return 0;
+}
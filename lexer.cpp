@@ -4,285 +4,149 @@
 
 #include <iostream>
 #include <cstring>
+#include <algorithm>
 #include "token.h"
 #include "lexer.h"
+#include "CharInfo.h"
+#include "TokenTables.h"
 using namespace std;
 
-/**
- * @brief Add a token to the Trie
- * @param rt Root of the Trie
- * @param s The string to insert
- * @param kind of the token
-*/
-void Lexer::add(int rt, string s, TokenKind kind)
+bool Lexer::LexRaw(Token& tok)
 {
-	int pos = rt;
-	int m = s.length();
-	for (int i = 0; i < m; i++)
+	const charinfo::Kernels& kernels = charinfo::getKernels();
+	const char* cur = bufferPtr;
+	while (cur != bufferEnd)
 	{
-		if (!tr[pos][s[i]])
+		if (!readin)
 		{
-			tr[pos][s[i]] = ++cnt;
-		}
-		pos = tr[pos][s[i]];
-	}
-	f[pos] = kind;
-}
-void Lexer::spsolve_root(int rt, TokenKind flag)
-{
-	f[rt] = flag;
-}
-int Lexer::build_alpha()
-{
-	int rt = ++cnt;
-	add(rt, "int", TokenKind::kw_int);
-	add(rt, "void", TokenKind::kw_void);
-	add(rt, "if", TokenKind::kw_if);
-	add(rt, "else", TokenKind::kw_else);
-	add(rt, "while", TokenKind::kw_while);
-	add(rt, "return", TokenKind::kw_return);
-	spsolve_root(rt, TokenKind::identifier);
-	return rt;
-}
-int Lexer::build_number()
-{
-	int rt = ++cnt;
-	spsolve_root(rt, TokenKind::numeric_constant);
-	return rt;
-}
-int Lexer::build_sign()
-{
-	int rt = ++cnt;
-	add(rt, "=", TokenKind::equal);
-	add(rt, "+", TokenKind::plus);
-	add(rt, "+=", TokenKind::plusequal);
-	add(rt, "-", TokenKind::minus);
-	add(rt, "-=", TokenKind::minusequal);
-	add(rt, "*", TokenKind::star);
-	add(rt, "*=", TokenKind::starequal);
-	add(rt, "/", TokenKind::slash);
-	add(rt, "/=", TokenKind::slashequal);
-	add(rt, "%", TokenKind::percent);
-	add(rt, "%=", TokenKind::percentequal);
-	add(rt, "==", TokenKind::equalequal);
-	add(rt, ">", TokenKind::greater);
-	add(rt, ">>", TokenKind::greatergreater);
-	add(rt, ">>=", TokenKind::greatergreaterequal);
-	add(rt, ">=", TokenKind::greaterequal);
-	add(rt, "<", TokenKind::less);
-	add(rt, "<<", TokenKind::lessless);
-	add(rt, "<<=", TokenKind::lesslessequal);
-	add(rt, "<=", TokenKind::lessequal);
-	add(rt, "!=", TokenKind::exclaimequal);
-	add(rt, "^", TokenKind::caret);
-	add(rt, "^=", TokenKind::caretequal);
-	add(rt, "&", TokenKind::amp);
-	add(rt, "&=", TokenKind::ampequal);
-	add(rt, "&&", TokenKind::ampamp);
-	add(rt, "|", TokenKind::pipe);
-	add(rt, "||", TokenKind::pipepipe);
-	add(rt, "|=", TokenKind::pipeequal);
-	add(rt, ";", TokenKind::semi);
-	add(rt, ",", TokenKind::comma);
-	add(rt, "#", TokenKind::eof);
-	add(rt, "(", TokenKind::l_paren);
-	add(rt, ")", TokenKind::r_paren);
-	add(rt, "{", TokenKind::l_brace);
-	add(rt, "}", TokenKind::r_brace);
-	add(rt, "//", TokenKind::s_comment);
-	add(rt, "/*", TokenKind::lm_comment);
-	add(rt, "*/", TokenKind::rm_comment);
-	return rt;
-}
-std::vector<Token> Lexer::Lex()
-{
-	char s[1025];
-	while (in.getline(s, 1024))
-	{
-		row++;
-		int max_col = strlen(s);
-		for (col = 0; col < max_col; col++)
-		{
-			int length = 0;
-			TokenKind flag = TokenKind::unknown;
-			switch (check_classify(s[col]))
-			{
-				case 1:
-					solve_alpha(root_alpha, s, max_col, col, length, flag);
-					break;
-				case 2:
-					solve_number(root_number, s, max_col, col, length, flag);
-					break;
-				case 3:
-					solve_sign(root_sign, s, max_col, col, length, flag);
-					break;
-				case 4:
-					flag = TokenKind::unknown;
-					break;
-			}
-			if (flag == TokenKind::unknown)
-			{
-				continue;
-			}
-			else if (flag == TokenKind::s_comment)
+			// Inside /* */ every token is dropped, and only '*', '/' and
+			// newlines can start one that matters.
+			cur = kernels.skipCommentBody(cur, bufferEnd);
+			if (cur == bufferEnd)
 			{
 				break;
 			}
-			else if (flag == TokenKind::lm_comment)
-			{
-				readin = 0;
-			}
-			else if (flag == TokenKind::rm_comment)
-			{
-				readin = 1;
-			}
-			else
+		}
+		if (*cur == '\n')
+		{
+			if (stop)
 			{
-				if (!readin)
-				{
-					col += length - 1;
-					continue;
-				}
-				if (flag == TokenKind::eof)
-				{
-					stop = 1;
-				}
-				
-				//tokens[tot].kind = flag;
-				string tmp;
-				for (int i = col; i <= col + length - 1; i++)
-					tmp = tmp + s[i];
-				Location loc{ row,col+1 };
-				tokens.emplace_back(Token{ flag,tmp,loc });
+				// nothing after the line holding '#' is ever lexed
+				bufferEnd = ++cur;
+				break;
 			}
-			col += length - 1;
+			cur++;
+			continue;
 		}
-		if (stop)
+		int length = 1;
+		TokenKind flag = TokenKind::unknown;
+		switch (check_classify(*cur))
 		{
-			break;
-		}
-	}
-	if (tokens.rbegin()->kind != TokenKind::eof)
-	{
-		tokens.push_back({ TokenKind::eof, "", Location{row + 1, 0} });
-	}
-	return tokens;
-}
-int Lexer::check_classify(char ch)
-{
-	if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z'))
-		return 1;
-	else if (ch >= '0' && ch <= '9')
-		return 2;
-	else
-	{
-		switch (ch)
-		{
-			case '=':
-			case '+':
-			case '-':
-			case '*':
-			case '/':
-			case '%':
-			case '>':
-			case '<':
-			case '!':
-			case ';':
-			case ',':
-			case '#':
-			case '(':
-			case ')':
-			case '{':
-			case '}':
-			case '^':
-			case '|':
-			case '&':
-				return 3;
+			case 1:
+				solve_alpha(cur, bufferEnd, length, flag);
 				break;
-			default:
-				return 4;
+			case 2:
+				solve_number(cur, bufferEnd, length, flag);
+				break;
+			case 3:
+				solve_sign(cur, bufferEnd, length, flag);
+				break;
+			case 4:
+				flag = TokenKind::unknown;
 				break;
 		}
-	}
-	return 0;
-}
-void Lexer::solve_alpha(int rt, char* s, int m, int l, int& len, TokenKind& flag)
-{
-	int pos = rt;
-	bool sg = 0;
-	len = 0;
-	for (int i = l; i < m; i++)
-	{
-		if (check_classify(s[i]) < 3)
+		if (flag == TokenKind::unknown)
+		{
+			cur = charinfo::isHorizontalSpace(*cur) ? kernels.skipHorizontalSpace(cur, bufferEnd) : cur + 1;
+			continue;
+		}
+		else if (flag == TokenKind::s_comment)
+		{
+			// skip the rest of the line, the newline itself is handled above
+			const void* eol = memchr(cur, '\n', bufferEnd - cur);
+			cur = eol ? static_cast<const char*>(eol) : bufferEnd;
+			continue;
+		}
+		else if (flag == TokenKind::lm_comment)
+		{
+			readin = 0;
+		}
+		else if (flag == TokenKind::rm_comment)
+		{
+			readin = 1;
+		}
+		else if (readin)
 		{
-			len++;
-			if (tr[pos][s[i]] && !sg)
+			if (flag == TokenKind::eof)
 			{
-				pos = tr[pos][s[i]];
+				stop = 1;
 			}
-			else
+			if (length > Token::maxLength)
 			{
-				sg = 1;
+				flag = TokenKind::unknown;
 			}
+			tok.kind = flag;
+			tok.length = static_cast<unsigned short>(std::min(length, Token::maxLength));
+			tok.offset = static_cast<uint32_t>(cur - bufferStart);
+			tok.identID = flag == TokenKind::identifier ? idents.get(llvm::StringRef(cur, tok.length)) : 0;
+			bufferPtr = cur + length;
+			lastKind = flag;
+			return true;
 		}
-		else
-		{
-			break;
-		}
+		cur += length;
 	}
-	if (!sg && f[pos]!=TokenKind::unknown)
+	bufferPtr = cur;
+	return false;
+}
+bool Lexer::Lex(Token& tok)
+{
+	if (LexRaw(tok))
 	{
-		flag = f[pos];
+		return true;
 	}
-	else
+	if (lastKind == TokenKind::eof)
 	{
-		flag = f[rt];
+		return false;
 	}
+	// an empty eof token right after the last line read
+	tok = { TokenKind::eof, 0, static_cast<uint32_t>(bufferPtr - bufferStart), 0 };
+	lastKind = TokenKind::eof;
+	return true;
 }
-void Lexer::solve_number(int rt, char* s, int m, int l, int& len, TokenKind& flag)
+std::vector<Token> Lexer::LexAll()
 {
-	len = 0;
-	for (int i = l; i < m; i++)
+	std::vector<Token> tokens;
+	// Every token but eof is at least one byte long. Reserving for one token
+	// every two bytes avoids regrowing (and refaulting) the vector; pages that
+	// are never written are never touched.
+	tokens.reserve((bufferEnd - bufferPtr) / 2 + 1);
+	Token tok;
+	while (Lex(tok))
 	{
-		if (check_classify(s[i]) == 2)
-		{
-			len++;
-
-		}
-		else
-		{
-			break;
-		}
+		tokens.push_back(tok);
 	}
-	flag = f[rt];
+	return tokens;
 }
-void Lexer::solve_sign(int rt, char* s, int m, int l, int& len, TokenKind& flag)
+int Lexer::check_classify(char ch)
 {
-	int pos = rt;
-	bool sg = 0;
-	len = 0;
-	for (int i = l; i < m; i++)
-	{
-		if (check_classify(s[i]) == 3)
-		{
-			if (tr[pos][s[i]])
-			{
-				pos = tr[pos][s[i]];
-				len++;
-			}
-			else
-			{
-				break;
-			}
-		}
-		else
-		{
-			break;
-		}
-	}
-	if (f[pos]!=TokenKind::unknown)
+	return charinfo::classify(ch);
+}
+void Lexer::solve_alpha(const char* s, const char* end, int& len, TokenKind& flag)
+{
+	len = static_cast<int>(charinfo::getKernels().skipAlnum(s, end) - s);
+	flag = toktables::lookupKeyword(s, len);
+}
+void Lexer::solve_number(const char* s, const char* end, int& len, TokenKind& flag)
+{
+	len = static_cast<int>(charinfo::getKernels().skipDigits(s, end) - s);
+	flag = TokenKind::numeric_constant;
+}
+void Lexer::solve_sign(const char* s, const char* end, int& len, TokenKind& flag)
+{
+	len = static_cast<int>(toktables::matchPunctuator(s, end, flag));
+	if (!len)
 	{
-		flag = f[pos];
+		len = 1;
+		flag = TokenKind::unknown;
 	}
 }
-
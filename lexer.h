@@ -1,46 +1,71 @@
 #pragma once
 #include "token.h"
+#include "SourceManager.h"
+#include "IdentifierTable.h"
+#include "TokenStream.h"
 #include <vector>
 #include <string>
 #include <cstring>
-#include <fstream>
 
 using namespace std;
-const int N = 255;
 
-class Lexer
+/**
+ * @brief Keywords and punctuators are recognized with the read-only tables in
+ * TokenTables.h, so constructing a Lexer costs nothing.
+ *
+ * Tokens are produced one at a time through Lex(Token&); LexAll() collects
+ * them when the whole stream is wanted.
+*/
+class Lexer : public TokenSource
 {
-    std::vector<Token> tokens;
-    int tr[N][131];
-    int cnt, tot;
-    TokenKind f[N];
-    ifstream in;
-    int row, col;
-    int root_alpha, root_number, root_sign;
+    IdentifierTable& idents;
+    const char* bufferStart;
+    const char* bufferEnd;
+    const char* bufferPtr;
+    TokenKind lastKind;
     bool stop, readin;
-    void add(int rt, string s, TokenKind kind);
-    void spsolve_root(int rt, TokenKind flag);
-    int build_alpha();
-    int build_number();
-    int build_sign();
 public:
-    Lexer(std::ifstream& in):in(std::move(in)) 
+    /**
+     * @param SM Holds the whole translation unit (mmapped, or read in one go
+     * for pipes). It is scanned in place, without a line buffer.
+     * @param idents Receives the spelling of every identifier
+     */
+    Lexer(const SourceManager& SM, IdentifierTable& idents) :idents(idents)
     {
-        cnt = 0;
-        col = 0;
-        tot = 0;
-        row = 0;
+        bufferStart = SM.getBufferStart();
+        bufferEnd = SM.getBufferEnd();
+        bufferPtr = bufferStart;
+        lastKind = TokenKind::unknown;
         stop = 0;
         readin = 1;
-        memset(tr, 0, sizeof(tr));
-        fill(std::begin(f), std::end(f), TokenKind::unknown);
-        root_alpha = build_alpha();
-        root_number = build_number();
-        root_sign = build_sign();
     }
-    std::vector<Token> Lex();
+    /**
+     * @brief Lexes only [begin, end), which must start at a line boundary
+     * or at the first character of a token.
+     * Token offsets stay relative to the start of SM's buffer.
+     * @param inComment Whether [begin, end) starts inside a block comment
+     */
+    Lexer(const SourceManager& SM, IdentifierTable& idents, const char* begin, const char* end, bool inComment) :idents(idents)
+    {
+        bufferStart = SM.getBufferStart();
+        bufferEnd = end;
+        bufferPtr = begin;
+        lastKind = TokenKind::unknown;
+        stop = 0;
+        readin = !inComment;
+    }
+    virtual bool Lex(Token& tok) override;
+    /// Like Lex, but never makes up the final eof token. Returns false at the
+    /// end of the range or after the line holding '#'.
+    bool LexRaw(Token& tok);
+    std::vector<Token> LexAll();
+    bool isInComment() const { return !readin; }
+    /// Whether a '#' was lexed, which ends the translation unit at its line.
+    bool hasStopped() const { return stop; }
+    /// Where the next token would start.
+    const char* getBufferPtr() const { return bufferPtr; }
     int check_classify(char ch);
-    void solve_alpha(int rt, char* s, int m, int l, int& len, TokenKind& flag);
-    void solve_number(int rt, char* s, int m, int l, int& len, TokenKind& flag);
-    void solve_sign(int rt, char* s, int m, int l, int& len, TokenKind& flag);
+    void solve_alpha(const char* s, const char* end, int& len, TokenKind& flag);
+    void solve_number(const char* s, const char* end, int& len, TokenKind& flag);
+    void solve_sign(const char* s, const char* end, int& len, TokenKind& flag);
 };
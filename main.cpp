@@ -1,69 +1,482 @@
 #include <iostream>
 #include <fstream>
 #include <cstring>
+#include <chrono>
 
 #pragma warning(push, 0)
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Threading.h"
 #pragma warning(pop)
 
 #include "lexer.h"
+#include "ParallelLexer.h"
+#include "TokenDumper.h"
+#include "CharInfo.h"
 #include "Parser.h"
+#include "Sema.h"
+#include "ASTFolder.h"
 #include "CodeGenerator.h"
+#include "DiskObjectCache.h"
+#include "JIT.h"
+#include "Repl.h"
 using namespace std;
 
-static cl::opt<string> inputFile(cl::Positional, cl::desc("<input file>"), cl::Required);
-static cl::opt<string> outputFile("o", cl::desc("Output file name"), cl::value_desc("filename"), cl::init("a.out"));
-static cl::opt<bool> dumpTokens("dump-tokens", cl::desc("Run preprocessor, dump internal rep of tokens"));
-static cl::opt<bool> dumpAST("dump-ast", cl::desc("Run parser, dump AST"));
+/// Only these are listed by --help, not the options of the LLVM libraries.
+static cl::OptionCategory tccCategory("tcc options");
+
+static cl::opt<string> inputFile(cl::Positional, cl::desc("<input file>"), cl::init("-"), cl::cat(tccCategory));
+static cl::opt<string> outputFile("o", cl::desc("Output file name"), cl::value_desc("filename"), cl::init("a.out"), cl::cat(tccCategory));
+static cl::opt<bool> dumpTokens("dump-tokens", cl::desc("Run preprocessor, dump internal rep of tokens"), cl::cat(tccCategory));
+static cl::opt<bool> ndjson("ndjson", cl::desc("With --dump-tokens, write one JSON object per line"), cl::cat(tccCategory));
+static cl::opt<string> tokenEdits("token-edits", cl::desc("With --dump-tokens, then apply the edits in file (- for stdin), one JSON object per line, and write the tokens each one changes"),
+    cl::value_desc("file"), cl::cat(tccCategory));
+static cl::opt<bool> dumpAST("dump-ast", cl::desc("Run parser, dump AST"), cl::cat(tccCategory));
+static cl::opt<bool> compactAST("compact-ast", cl::desc("Flatten the AST into arrays before dumping it or generating code"), cl::cat(tccCategory));
+static cl::opt<bool> ssa("ssa", cl::desc("Generate locals as SSA values instead of allocas"), cl::cat(tccCategory));
+static cl::opt<char> optLevel("O", cl::desc("Optimization level: -O0, -O1, -O2, -O3, -Os or -Oz (default -O0)"), cl::Prefix, cl::init('0'), cl::cat(tccCategory));
+static cl::opt<string> passPipeline("passes", cl::desc("Run these passes instead of the -O pipeline, as in opt -passes="), cl::value_desc("pipeline"), cl::cat(tccCategory));
+static cl::opt<bool> optStats("opt-stats", cl::desc("Report the time spent optimizing"), cl::cat(tccCategory));
+static cl::opt<bool> emitObject("c", cl::desc("Write an object file for the host"), cl::cat(tccCategory));
+static cl::opt<bool> emitAssembly("S", cl::desc("Write assembly for the host"), cl::cat(tccCategory));
+static cl::opt<bool> emitLLVM("emit-llvm", cl::desc("Write textual LLVM IR, the default (bitcode with -c)"), cl::cat(tccCategory));
+static cl::opt<bool> emitBitcode("emit-bc", cl::desc("Write LLVM bitcode"), cl::cat(tccCategory));
+static cl::opt<string> targetCPU("mcpu", cl::desc("Target CPU, or native for the host CPU and its features"), cl::value_desc("cpu-name"),
+    cl::init("generic"), cl::cat(tccCategory));
+static cl::opt<bool> run("run", cl::desc("Compile the program in memory and run it, with the arguments after the input file"), cl::cat(tccCategory));
+static cl::list<string> runArgs(cl::Positional, cl::desc("[--] <program arguments>..."), cl::cat(tccCategory));
+static cl::opt<bool> repl("repl", cl::desc("Read declarations and statements from stdin and run each as it is entered"), cl::cat(tccCategory));
+static cl::opt<bool> runStats("run-stats", cl::desc("With --run, report the time spent compiling and running"), cl::cat(tccCategory));
+static cl::opt<string> cacheDir("cache-dir", cl::desc("Where --run keeps compiled programs (default: tcc in the user's cache directory)"),
+    cl::value_desc("dir"), cl::cat(tccCategory));
+static cl::opt<unsigned> cacheSize("cache-size", cl::desc("Size of the --run cache; the least recently used programs are evicted first, and 0 caches nothing, as --no-cache"),
+    cl::value_desc("MB"), cl::init(256), cl::cat(tccCategory));
+static cl::opt<bool> noCache("no-cache", cl::desc("With --run, neither use nor fill the cache"), cl::cat(tccCategory));
+static cl::opt<string> targetFeatures("mattr", cl::desc("Target features to enable or disable"), cl::value_desc("+a1,-a2,..."), cl::cat(tccCategory));
+static cl::opt<string> lexKernel("lex-kernel", cl::desc("Character scanning kernels: auto, scalar, sse2 or avx2"), cl::init("auto"), cl::cat(tccCategory));
+static cl::opt<bool> lexStats("lex-stats", cl::desc("Report lexer throughput"), cl::cat(tccCategory));
+static cl::opt<bool> lazyBodies("lazy-bodies", cl::desc("Skip function bodies while parsing and parse each one when it is first used"), cl::cat(tccCategory));
+static cl::list<string> onlyFunctions("functions", cl::desc("Dump or compile the bodies of these functions only, declaring the rest (implies --lazy-bodies)"),
+    cl::value_desc("name,..."), cl::CommaSeparated, cl::cat(tccCategory));
+static cl::opt<unsigned> lexJobs("lex-jobs", cl::desc("Lex with N threads (0 for all hardware threads)"), cl::value_desc("N"), cl::init(1), cl::cat(tccCategory));
+static cl::opt<unsigned> parseJobs("parse-jobs", cl::desc("Parse function bodies with N threads (0 for all hardware threads)"), cl::value_desc("N"), cl::init(1), cl::cat(tccCategory));
 
 void usage(const char* exeName)
 {
     cout << "Usage : " << exeName << " <inputfile> <outputfile>" << endl;
 }
 
+/// Keeps the bodies of the named functions only. Every other function is
+/// declared once, and its body is never parsed if it was skipped.
+static Decl* keepFunctionBodies(Decl* tu, ASTContext& context, ArrayRef<string> names)
+{
+    SmallVector<Decl*, 32> decls;
+    StringSet<> declared;
+    for (Decl* decl : cast<TranslationUnitDecl>(tu)->getDecls())
+    {
+        auto* function = dyn_cast_or_null<FunctionDecl>(decl);
+        if (function && !is_contained(names, function->getName()))
+        {
+            if (!declared.insert(function->getName()).second)
+            {
+                continue;
+            }
+            function->dropBody();
+        }
+        decls.push_back(decl);
+    }
+    return new (context) TranslationUnitDecl(context.copyArray(decls));
+}
+
+/// The parser has printed what is wrong.
+static int reportParseError()
+{
+    std::cerr << "Error";
+    return 1;
+}
+
+enum class OutputKind
+{
+    IR,
+    Bitcode,
+    Assembly,
+    Object
+};
+
+/// What -c, -S, --emit-llvm and --emit-bc ask for, combined as clang does.
+static OutputKind getOutputKind()
+{
+    if (emitBitcode || (emitLLVM && emitObject))
+    {
+        return OutputKind::Bitcode;
+    }
+    if (emitLLVM)
+    {
+        return OutputKind::IR;
+    }
+    if (emitObject)
+    {
+        return OutputKind::Object;
+    }
+    return emitAssembly ? OutputKind::Assembly : OutputKind::IR;
+}
+
+/// -o, or else the input file with the extension of kind. IR still goes to
+/// a.out by default.
+static string getOutputPath(OutputKind kind)
+{
+    if (outputFile.getNumOccurrences() || kind == OutputKind::IR)
+    {
+        return outputFile;
+    }
+    SmallString<128> path(inputFile == "-" ? "a" : sys::path::filename(inputFile));
+    sys::path::replace_extension(path, kind == OutputKind::Bitcode ? "bc" : kind == OutputKind::Assembly ? "s" : "o");
+    return string(path);
+}
+
+/// The CPU to generate code for. The JIT runs code on this machine, so
+/// for --run and --repl it is the host CPU by default.
+static StringRef getTargetCPU()
+{
+    return (run || repl) && !targetCPU.getNumOccurrences() ? StringRef("native") : StringRef(targetCPU);
+}
+
+/// The object cache of --run, or null if it is disabled or there is no
+/// directory for it.
+static unique_ptr<DiskObjectCache> createObjectCache()
+{
+    // pruneCache would read a size of 0 as no limit at all
+    if (noCache || cacheSize == 0)
+    {
+        return nullptr;
+    }
+    SmallString<128> directory(cacheDir);
+    if (directory.empty())
+    {
+        if (!sys::path::cache_directory(directory))
+        {
+            return nullptr;
+        }
+        sys::path::append(directory, "tcc");
+    }
+    return std::make_unique<DiskObjectCache>(directory, uint64_t(cacheSize) * 1024 * 1024);
+}
+
+/// The cache key of the program source compiled for TM, with every option
+/// that changes the code.
+static string getCacheKey(StringRef source, const TargetMachine& TM)
+{
+    string functions = join(onlyFunctions.begin(), onlyFunctions.end(), ",");
+    return DiskObjectCache::computeKey({ source, TM.getTargetTriple().str(), TM.getTargetCPU(), TM.getTargetFeatureString(),
+        string(1, optLevel), StringRef(passPipeline), ssa ? "ssa" : "alloca", functions });
+}
+
+/// Calls main of the program in jit and returns its exit code. Compiling, or
+/// loading from the cache, is timed from start.
+static int runMain(JIT& jit, chrono::steady_clock::time_point start, bool cached)
+{
+    void* mainFunction = jit.lookup("main");
+    if (!mainFunction)
+    {
+        return 1;
+    }
+    auto runStart = chrono::steady_clock::now();
+    int res = jit.runMain(mainFunction, inputFile, runArgs);
+    if (runStats)
+    {
+        double compileSeconds = chrono::duration<double>(runStart - start).count();
+        double runSeconds = chrono::duration<double>(chrono::steady_clock::now() - runStart).count();
+        cerr << (cached ? "loaded from the cache in " : "compiled in ") << compileSeconds * 1e3 << " ms, ran in "
+            << runSeconds * 1e3 << " ms, main returned " << res << endl;
+    }
+    return res;
+}
+
+/// Hands the generated program to jit, which caches it under cacheKey if it
+/// has a cache, and runs it.
+static int runProgram(CodeGenerator& generator, JIT& jit, StringRef cacheKey, chrono::steady_clock::time_point start)
+{
+    for (const auto& err : generator.getErrors())
+    {
+        cerr << err << endl;
+    }
+    if (!generator.getErrors().empty())
+    {
+        return 1;
+    }
+    // emitFunction has reported what is wrong
+    if (verifyModule(generator.getModule()))
+    {
+        cerr << "Can't run invalid IR" << endl;
+        return 1;
+    }
+    orc::ThreadSafeModule module = generator.takeModule();
+    module.withModuleDo([&](Module& M) { M.setModuleIdentifier(cacheKey); });
+    if (!jit.addModule(std::move(module)))
+    {
+        return 1;
+    }
+    return runMain(jit, start, false);
+}
+
+static bool getOptimizationLevel(char level, OptimizationLevel& res)
+{
+    switch (level)
+    {
+        case '0': res = OptimizationLevel::O0; return true;
+        case '1': res = OptimizationLevel::O1; return true;
+        case '2': res = OptimizationLevel::O2; return true;
+        case '3': res = OptimizationLevel::O3; return true;
+        case 's': res = OptimizationLevel::Os; return true;
+        case 'z': res = OptimizationLevel::Oz; return true;
+        default: return false;
+    }
+}
+
 int main(int argc, char* argv[])
 {
+    cl::HideUnrelatedOptions(tccCategory);
     cl::ParseCommandLineOptions(argc, argv);
-    ifstream fin(inputFile);
-    if (!fin.is_open())
+    auto compileStart = chrono::steady_clock::now();
+    OptimizationLevel level;
+    if (!getOptimizationLevel(optLevel, level))
+    {
+        cout << "Unsupported optimization level -O" << optLevel << endl;
+        return 0;
+    }
+    if (emitObject && emitAssembly)
+    {
+        cout << "-c and -S can't be used together" << endl;
+        return 0;
+    }
+    if (!runArgs.empty() && !run)
+    {
+        cout << "Unexpected arguments after " << inputFile << " (they are for --run)" << endl;
+        return 0;
+    }
+    if (run && (emitObject || emitAssembly))
+    {
+        cout << "--run can't be used with -c or -S" << endl;
+        return 0;
+    }
+    OutputKind outputKind = getOutputKind();
+    if (!charinfo::selectKernels(lexKernel))
+    {
+        cout << "Unsupported lexer kernel " << lexKernel << endl;
+        return 0;
+    }
+    if (!tokenEdits.empty() && (!dumpTokens || (tokenEdits == "-" && inputFile == "-")))
+    {
+        cout << "--token-edits needs --dump-tokens and a source file that is not stdin" << endl;
+        return 0;
+    }
+    if (repl)
+    {
+        auto session = Repl::create(getTargetCPU(), targetFeatures, level);
+        if (!session)
+        {
+            return 1;
+        }
+        session->setSSA(ssa);
+        return session->run();
+    }
+    // Regular files are mmapped, pipes and stdin ("-") are read in one go.
+    auto fileOrErr = MemoryBuffer::getFileOrSTDIN(inputFile);
+    if (!fileOrErr)
     {
         cout << "Can't open " << inputFile << endl;
         return 0;
     }
 
-    Lexer* lexer = new Lexer(fin);
-    auto tokens = lexer->Lex();
-    fin.close();
+    SourceManager SM(std::move(*fileOrErr));
 
-    if (dumpTokens)
+    // For --run the JIT comes first: with the program in the cache there is
+    // nothing else to do.
+    unique_ptr<JIT> jit;
+    unique_ptr<DiskObjectCache> cache;
+    string cacheKey;
+    if (run)
     {
-        json res = json::array();
-        for (size_t i = 0; i < tokens.size(); i++)
+        auto TM = CodeGenerator::createTargetMachine(getTargetCPU(), targetFeatures, level);
+        cache = createObjectCache();
+        jit = TM ? JIT::create(*TM, cache.get()) : nullptr;
+        if (!jit)
+        {
+            return 1;
+        }
+        if (cache)
         {
-            res.push_back(json({
-                    {"id",i + 1},
-                    {"content",tokens[i].content},
-                    {"prop",tokens[i].getKindName()},
-                    {"loc",to_string(tokens[i].loc.row) + "," + to_string(tokens[i].loc.col)}
-                }));
+            cacheKey = getCacheKey(SM.getBuffer(), *TM);
+            if (auto object = cache->load(cacheKey))
+            {
+                return jit->addObject(std::move(object)) ? runMain(*jit, compileStart, true) : 1;
+            }
         }
-        std::cout << res.dump(4) << std::endl;
+    }
+
+    IdentifierTable idents;
+    // An editor's session: the tokens are kept up to date after each edit
+    // rather than dumped again.
+    if (!tokenEdits.empty())
+    {
+        ifstream editFile;
+        if (tokenEdits != "-")
+        {
+            editFile.open(tokenEdits);
+            if (!editFile.is_open())
+            {
+                cout << "Can't open " << tokenEdits << endl;
+                return 0;
+            }
+        }
+        IncrementalLexer incremental(SM.getBuffer().str(), idents);
+        TokenArraySource tokens(incremental.getTokens());
+        dumpTokenStream(tokens, incremental.getSourceManager(), llvm::outs(), ndjson);
+        llvm::outs().flush();
+        return dumpTokenEdits(incremental, tokenEdits == "-" ? cin : editFile, llvm::outs()) ? 0 : 1;
+    }
+    Lexer* lexer = new Lexer(SM, idents);
+    if (lexStats)
+    {
+        // A separate pass, since the parser pulls its tokens interleaved with parsing.
+        IdentifierTable scratchIdents;
+        Lexer statsLexer(SM, scratchIdents);
+        Token tok;
+        size_t tokenCount = 0;
+        auto lexStart = chrono::steady_clock::now();
+        if (lexJobs == 1)
+        {
+            while (statsLexer.Lex(tok))
+            {
+                tokenCount++;
+            }
+        }
+        else
+        {
+            tokenCount = lexInParallel(SM, scratchIdents, lexJobs).size();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - lexStart).count();
+        double megabytes = SM.getBuffer().size() / 1e6;
+        cerr << "lexed " << megabytes << " MB, " << tokenCount << " tokens in " << seconds * 1e3 << " ms ("
+            << megabytes / seconds << " MB/s, " << charinfo::getKernels().name << " kernels, "
+            << llvm::hardware_concurrency(lexJobs).compute_thread_count() << " threads)" << endl;
+    }
+
+    // With several lexing threads the tokens are lexed up front and replayed.
+    TokenSource* source = lexer;
+    std::vector<Token> tokens;
+    if (lexJobs != 1)
+    {
+        tokens = lexInParallel(SM, idents, lexJobs);
+        source = new TokenArraySource(tokens);
+    }
+
+    if (dumpTokens)
+    {
+        dumpTokenStream(*source, SM, llvm::outs(), ndjson);
         return 0;
     }
-    Parser* p = new Parser(tokens, inputFile);
+    ASTContext context;
+    Parser* p = new Parser(*source, SM, context, inputFile);
+    p->setLazyBodies(lazyBodies || onlyFunctions.getNumOccurrences());
+    p->setJobs(parseJobs);
     auto res = p->parse();
     if (!res)
     {
-        std::cerr << "Error";
-        return 0;
+        return reportParseError();
+    }
+    if (onlyFunctions.getNumOccurrences())
+    {
+        res = keepFunctionBodies(res, context, onlyFunctions);
     }
     if (dumpAST)
     {
-        std::cout << res->toJson().dump(4) << std::endl;
+        // the tree as parsed, before Sema adds its casts
+        if (compactAST)
+        {
+            CompactAST ast(*res);
+            if (p->hasFailedBodies())
+            {
+                return reportParseError();
+            }
+            ast.dumpJson(llvm::outs());
+            llvm::outs() << '\n';
+        }
+        else
+        {
+            json tree = res->toJson();
+            if (p->hasFailedBodies())
+            {
+                return reportParseError();
+            }
+            std::cout << tree.dump(4) << std::endl;
+        }
         return 0;
     }
+    Sema(context).bind(*res);
+    // Sema has parsed whatever bodies were skipped
+    if (p->hasFailedBodies())
+    {
+        return reportParseError();
+    }
+    if (!ASTFolder(context, SM, inputFile).fold(*res))
+    {
+        return 1;
+    }
     CodeGenerator* generator = new CodeGenerator();
-    res->genCode(*generator);
-    generator->print(outputFile.getValue().c_str());
+    generator->setSSA(ssa);
+    bool native = run || outputKind == OutputKind::Object || outputKind == OutputKind::Assembly;
+    if ((native || targetCPU.getNumOccurrences() || targetFeatures.getNumOccurrences()) &&
+        !generator->setTarget(getTargetCPU(), targetFeatures, level))
+    {
+        return run ? 1 : 0;
+    }
+    if (native)
+    {
+        generator->discardValueNames();
+    }
+    if (compactAST)
+    {
+        generator->gen(CompactAST(*res));
+    }
+    else
+    {
+        generator->gen(*res);
+    }
+    size_t instructions = generator->getModule().getInstructionCount();
+    auto optStart = chrono::steady_clock::now();
+    if (!generator->optimize(level, passPipeline))
+    {
+        return 0;
+    }
+    if (optStats)
+    {
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - optStart).count();
+        cerr << "optimized with " << (passPipeline.empty() ? "-O" + std::string(1, optLevel) : "-passes=" + passPipeline)
+            << " in " << seconds * 1e3 << " ms, " << instructions << " -> "
+            << generator->getModule().getInstructionCount() << " instructions" << endl;
+    }
+    if (run)
+    {
+        return runProgram(*generator, *jit, cacheKey, compileStart);
+    }
+    string outputPath = getOutputPath(outputKind);
+    switch (outputKind)
+    {
+        case OutputKind::IR:
+            generator->print(outputPath.c_str());
+            break;
+        case OutputKind::Bitcode:
+            generator->printBitcode(outputPath.c_str());
+            break;
+        case OutputKind::Assembly:
+            generator->emitFile(outputPath.c_str(), CGFT_AssemblyFile);
+            break;
+        case OutputKind::Object:
+            generator->emitFile(outputPath.c_str(), CGFT_ObjectFile);
+            break;
+    }
     return 0;
 }
@@ -0,0 +1,19 @@
+int never(int x)
+{
+    return x;
+}
+
+int main()
+{
+    int x;
+    x = 1;
+    if (1 < 0)
+        x = never(x);
+    while (0)
+        x = never(x);
+    if (2)
+        x = x + 1;
+    else
+        x = never(x);
+    return x;
+}
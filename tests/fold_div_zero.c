@@ -0,0 +1,9 @@
+int f(int x)
+{
+    return x / 0;
+}
+
+int main()
+{
+    return 0;
+}
@@ -0,0 +1,6 @@
+int z = 1 / 0;
+
+int main()
+{
+    return z;
+}
@@ -0,0 +1,20 @@
+int a = 2 * 3 + 4;
+int b = (1 << 4) - 1;
+int c = 7 / 2 % 2;
+int d = 0 - 2147483647 - 1;
+int e = 5 > 3 && 2 < 1;
+
+int main()
+{
+    if (a != 10)
+        return 1;
+    if (b != 15)
+        return 2;
+    if (c != 1)
+        return 3;
+    if (d + 2147483647 != 0 - 1)
+        return 4;
+    if (e)
+        return 5;
+    return 0;
+}
@@ -0,0 +1,6 @@
+int main()
+{
+    int x;
+    x = 5;
+    return 2*3+x*0;
+}
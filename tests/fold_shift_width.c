@@ -0,0 +1,9 @@
+int f(int x)
+{
+    return 1 << 32;
+}
+
+int main()
+{
+    return 0;
+}
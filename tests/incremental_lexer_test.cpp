@@ -0,0 +1,124 @@
+/** @file incremental_lexer_test.cpp
+* @brief Checks IncrementalLexer against a full Lexer::LexAll after every edit
+**/
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "IncrementalLexer.h"
+#include "lexer.h"
+
+namespace
+{
+    const char* const Source =
+        "int g = 1;\n"
+        "/* a comment\n"
+        "   over two lines */\n"
+        "int f(int a, int b)\n"
+        "{\n"
+        "    int c;\n"
+        "    c = a <<= b; // shift\n"
+        "    while (c >= 10) { c = c / 2; }\n"
+        "    return c + g;\n"
+        "}\n"
+        "int main()\n"
+        "{\n"
+        "    return f(1, 2);\n"
+        "}\n";
+
+    struct Edit
+    {
+        uint32_t offset;
+        uint32_t removed;
+        const char* inserted;
+    };
+
+    /// Each applied to the result of the ones before.
+    const Edit Scripted[] = {
+        { 42, 2, "" },             // removes the */ of the two-line comment,
+        { 42, 0, "*/" },           // which then runs to the end, and puts it back
+        { 45, 0, "/* " },          // opens a comment that is never closed
+        { 45, 3, "" },
+        { 11, 2, "" },             // removes the /* of the two-line comment
+        { 11, 0, "/*" },
+        { 0, 0, "#include\n" },    // a '#' line ends the translation unit
+        { 0, 9, "" },
+        { 67, 0, "#\n" },          // and one in the middle
+        { 67, 2, "" },
+        { 88, 3, "<" },            // punctuators that split and merge
+        { 89, 0, "<=" },
+        { 8, 0, "0" },             // a number that grows
+        { 0, 0, "" },
+    };
+
+    bool sameTokens(const std::vector<Token>& a, const std::vector<Token>& b)
+    {
+        if (a.size() != b.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            if (a[i].kind != b[i].kind || a[i].offset != b[i].offset || a[i].length != b[i].length ||
+                a[i].identID != b[i].identID)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// Applies the edit to both and compares the tokens with a full re-lex.
+    bool check(IncrementalLexer& incremental, std::string& text, IdentifierTable& idents, const Edit& edit,
+               const std::string& what)
+    {
+        text.replace(edit.offset, edit.removed, edit.inserted);
+        incremental.edit(edit.offset, edit.removed, edit.inserted);
+        SourceManager SM(llvm::MemoryBuffer::getMemBuffer(text, "", false));
+        Lexer lexer(SM, idents);
+        if (sameTokens(incremental.getTokens(), lexer.LexAll()))
+        {
+            return true;
+        }
+        std::cerr << what << ": tokens differ from a full re-lex after replacing " << edit.removed << " bytes at "
+            << edit.offset << " by \"" << edit.inserted << "\"" << std::endl;
+        return false;
+    }
+}
+
+int main()
+{
+    IdentifierTable idents;
+    std::string text = Source;
+    IncrementalLexer incremental(text, idents);
+    for (size_t i = 0; i < sizeof(Scripted) / sizeof(Scripted[0]); i++)
+    {
+        if (!check(incremental, text, idents, Scripted[i], "scripted edit " + std::to_string(i)))
+        {
+            return 1;
+        }
+    }
+
+    // Random edits made of fragments that open and close comments, start a
+    // '#' line or glue onto punctuators.
+    const char* const fragments[] = { "/*", "*/", "/", "*", "#", "\n", " ", "a", "1", "+", "=", "<", "<<=", "int ",
+                                      "(", ")", "//", "\t", "x = 1;\n" };
+    std::mt19937 rng(7);
+    std::string inserted;
+    for (unsigned i = 0; i < 2000; i++)
+    {
+        uint32_t offset = rng() % (text.size() + 1);
+        uint32_t removed = rng() % (std::min<size_t>(text.size() - offset, 6) + 1);
+        inserted.clear();
+        for (unsigned n = rng() % 4; n; n--)
+        {
+            inserted += fragments[rng() % (sizeof(fragments) / sizeof(fragments[0]))];
+        }
+        if (!check(incremental, text, idents, { offset, removed, inserted.c_str() }, "random edit " + std::to_string(i)))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,5 @@
+int main()
+{
+    int inner(int a) { return a + 1; };
+    return 0;
+}
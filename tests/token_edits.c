@@ -0,0 +1,6 @@
+int main()
+{
+    int a;
+    a = 1;
+    return a;
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <cstdint>
 
 enum class TokenKind : unsigned short
 {
@@ -9,17 +10,33 @@ enum class TokenKind : unsigned short
     NUM_TOKENS
 };
 
+/// The name of a token kind as spelled in TokenKinds.def, e.g. "kw_int".
+const char* getTokenName(TokenKind kind);
+
 struct Location
 {
     int row;
     int col;
 };
 
+/**
+ * A token only records where it is. Its text and row/col are looked up
+ * through the SourceManager when a diagnostic or a dump needs them.
+*/
 struct Token
 {
     TokenKind kind;
-    std::string content;
-    Location loc;
+    /// A longer token is lexed as unknown, with its first maxLength
+    /// characters as its spelling, and the parser rejects it.
+    unsigned short length;
+    /// Byte offset of the first character in the source buffer
+    uint32_t offset;
+    /// IdentifierTable id for identifiers, 0 for any other token
+    uint32_t identID;
 
     std::string getKindName() const;
-};
\ No newline at end of file
+
+    static constexpr int maxLength = 0xFFFF;
+};
+
+static_assert(sizeof(Token) == 12, "Token should stay compact");
\ No newline at end of file